@@ -23,11 +23,17 @@
 #define KEY_KPADD 0x6B
 #define KEY_KPSUB 0x6D
 #define KEY_B 0x42
+#define KEY_C 0x43
 #define KEY_F 0x46
+#define KEY_G 0x47
+#define KEY_H 0x48
 #define KEY_L 0x4C
+#define KEY_M 0x4D
 #define KEY_N 0x4E
 #define KEY_O 0x4F
+#define KEY_R 0x52
 #define KEY_T 0x54
+#define KEY_Z 0x5A
 #elif defined(__ANDROID__)
 // Dummy key codes 
 #define KEY_ESCAPE 0x0
@@ -46,11 +52,17 @@
 #define KEY_KPADD 0x9
 #define KEY_KPSUB 0xA
 #define KEY_B 0xB
+#define KEY_C 0x15
 #define KEY_F 0xC
+#define KEY_G 0x19
+#define KEY_H 0x16
 #define KEY_L 0xD
+#define KEY_M 0x18
 #define KEY_N 0xE
 #define KEY_O 0xF
+#define KEY_R 0x17
 #define KEY_T 0x10
+#define KEY_Z 0x1A
 #elif defined(__linux__)
 #define KEY_ESCAPE 0x9
 #define KEY_F1 0x43
@@ -66,11 +78,17 @@
 #define KEY_KPADD 0x56
 #define KEY_KPSUB 0x52
 #define KEY_B 0x38
+#define KEY_C 0x36
 #define KEY_F 0x29
+#define KEY_G 0x2A
+#define KEY_H 0x2B
 #define KEY_L 0x2E
+#define KEY_M 0x3A
 #define KEY_N 0x39
 #define KEY_O 0x20
+#define KEY_R 0x1B
 #define KEY_T 0x1C
+#define KEY_Z 0x34
 #endif
 
 // todo: Android gamepad keycodes outside of define for now
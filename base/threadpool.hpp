@@ -6,8 +6,12 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <vector>
 #include <thread>
+#include <memory>
+#include <functional>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
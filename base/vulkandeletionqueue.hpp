@@ -0,0 +1,72 @@
+/*
+* Deferred destruction of Vulkan resources
+*
+* Resources that are replaced while older frames may still be pending on the GPU are queued
+* together with the frame they were retired in and destroyed once that frame has completed
+* Entries must be pushed in frame order
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+
+namespace vk
+{
+	class DeletionQueue
+	{
+	private:
+		struct Entry
+		{
+			// Frame the resources were retired in, it no longer uses them
+			uint64_t frame;
+			std::function<void()> destroy;
+		};
+		std::deque<Entry> entries;
+		// Number of frames that may be pending on the GPU at the same time
+		uint32_t framesInFlight;
+
+	public:
+		DeletionQueue(uint32_t framesInFlight = 1) : framesInFlight(framesInFlight) {}
+
+		void push(uint64_t frame, std::function<void()> destroy)
+		{
+			Entry entry;
+			entry.frame = frame;
+			entry.destroy = destroy;
+			entries.push_back(entry);
+		}
+
+		// Destroys the resources of all entries that are no longer used by a pending frame
+		// Called with the last submitted frame, frames older than the number of frames in flight have completed
+		void collect(uint64_t frame)
+		{
+			while ((!entries.empty()) && (entries.front().frame + framesInFlight <= frame + 1))
+			{
+				entries.front().destroy();
+				entries.pop_front();
+			}
+		}
+
+		// Destroys all queued resources, the device must be idle
+		// Must be called before the device is destroyed
+		void flush()
+		{
+			for (auto& entry : entries)
+			{
+				entry.destroy();
+			}
+			entries.clear();
+		}
+
+		size_t size()
+		{
+			return entries.size();
+		}
+	};
+}
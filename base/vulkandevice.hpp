@@ -29,6 +29,8 @@ namespace vk
 		VkPhysicalDeviceProperties properties;
 		/** @brief Features of the physical device that an application can use to check if a feature is supported */
 		VkPhysicalDeviceFeatures features;
+		/** @brief Features that have actually been enabled upon logical device creation (requested and supported) */
+		VkPhysicalDeviceFeatures enabledFeatures = {};
 		/** @brief Memory types and heaps of the physical device */
 		VkPhysicalDeviceMemoryProperties memoryProperties;
 		/** @brief Queue family properties of the physical device */
@@ -216,7 +218,7 @@ namespace vk
 		/**
 		* Create the logical device based on the assigned physical device, also gets default queue family indices
 		*
-		* @param enabledFeatures Can be used to enable certain features upon device creation
+		* @param enabledFeatures Can be used to enable certain features upon device creation, features not supported by the physical device are ignored
 		* @param useSwapChain Set to false for headless rendering to omit the swapchain device extensions
 		* @param requestedQueueTypes Bit flags specifying the queue types to be requested from the device  
 		*
@@ -305,6 +307,15 @@ namespace vk
 			deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 			deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());;
 			deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+			// Only request features that are supported, device creation would fail otherwise
+			// Applications can check the enabledFeatures member for what has actually been enabled
+			const VkBool32 *supported = reinterpret_cast<const VkBool32*>(&features);
+			VkBool32 *requested = reinterpret_cast<VkBool32*>(&enabledFeatures);
+			for (size_t i = 0; i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); i++)
+			{
+				requested[i] = requested[i] && supported[i];
+			}
+			this->enabledFeatures = enabledFeatures;
 			deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
 			// Enable the debug marker extension if it is present (likely meaning a debugging tool is present)
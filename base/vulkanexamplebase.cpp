@@ -10,6 +10,36 @@
 
 std::vector<const char*> VulkanExampleBase::args;
 
+// "VKPC"
+#define PIPELINE_CACHE_FILE_MAGIC 0x43504B56
+#define PIPELINE_CACHE_FILE_VERSION 1
+
+// Header of the stored pipeline cache, followed by the data returned by vkGetPipelineCacheData
+// Identifies the device and driver the data was created with and a checksum to detect corrupted files
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint32_t checksum;
+	uint64_t dataSize;
+};
+
+// FNV-1a hash
+static uint32_t pipelineCacheChecksum(const uint8_t *data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 VkResult VulkanExampleBase::createInstance(bool enableValidation)
 {
 	this->enableValidation = enableValidation;
@@ -192,11 +222,151 @@ void VulkanExampleBase::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueu
 	}
 }
 
+std::string VulkanExampleBase::getPipelineCacheFileName()
+{
+#if defined(__ANDROID__)
+	// Assets are read-only, so store the cache in the app's internal storage
+	return std::string(androidApp->activity->internalDataPath) + "/pipelinecache.bin";
+#else
+	return "pipelinecache.bin";
+#endif
+}
+
+bool VulkanExampleBase::loadPipelineCacheData(std::vector<uint8_t> &data)
+{
+	std::string fileName = getPipelineCacheFileName();
+	FILE *file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	PipelineCacheFileHeader header;
+	bool valid = (fileSize > static_cast<long>(sizeof(header))) && (fread(&header, sizeof(header), 1, file) == 1);
+	valid = valid && (header.magic == PIPELINE_CACHE_FILE_MAGIC) && (header.version == PIPELINE_CACHE_FILE_VERSION);
+	// Size stored in the header is only trusted if it matches the file, before anything is allocated for it
+	valid = valid && (header.dataSize == static_cast<uint64_t>(fileSize) - sizeof(header));
+	if (valid)
+	{
+		data.resize(static_cast<size_t>(header.dataSize));
+		valid = (header.dataSize > 0) && (fread(data.data(), 1, data.size(), file) == data.size());
+	}
+	fclose(file);
+
+	if (!valid || (pipelineCacheChecksum(data.data(), data.size()) != header.checksum))
+	{
+		std::cout << "Pipeline cache file \"" << fileName << "\" is corrupted, starting with an empty cache" << std::endl;
+		return false;
+	}
+
+	// Data is only valid for the same device and driver
+	if ((header.vendorID != deviceProperties.vendorID) || (header.deviceID != deviceProperties.deviceID) || (header.driverVersion != deviceProperties.driverVersion) || (memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0))
+	{
+		std::cout << "Pipeline cache file was created for a different device or driver, starting with an empty cache" << std::endl;
+		return false;
+	}
+
+	// Also check the header written by the implementation (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+	struct {
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	} cacheHeader;
+	if (data.size() < sizeof(cacheHeader))
+	{
+		return false;
+	}
+	memcpy(&cacheHeader, data.data(), sizeof(cacheHeader));
+	if ((cacheHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) || (cacheHeader.vendorID != deviceProperties.vendorID) || (cacheHeader.deviceID != deviceProperties.deviceID) || (memcmp(cacheHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0))
+	{
+		std::cout << "Pipeline cache data does not match the device, starting with an empty cache" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void VulkanExampleBase::savePipelineCache()
+{
+	if (pipelineCache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	size_t dataSize = 0;
+	if ((vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) || (dataSize == 0))
+	{
+		return;
+	}
+	std::vector<uint8_t> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	PipelineCacheFileHeader header = {};
+	header.magic = PIPELINE_CACHE_FILE_MAGIC;
+	header.version = PIPELINE_CACHE_FILE_VERSION;
+	header.vendorID = deviceProperties.vendorID;
+	header.deviceID = deviceProperties.deviceID;
+	header.driverVersion = deviceProperties.driverVersion;
+	memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.checksum = pipelineCacheChecksum(data.data(), dataSize);
+	header.dataSize = dataSize;
+
+	// Write to a temporary file first and replace the old cache file afterwards,
+	// so an interrupted write never leaves a partial cache file behind
+	std::string fileName = getPipelineCacheFileName();
+	std::string tempFileName = fileName + ".tmp";
+	FILE *file = fopen(tempFileName.c_str(), "wb");
+	if (!file)
+	{
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	written = written && (fwrite(data.data(), 1, dataSize, file) == dataSize);
+	written = (fclose(file) == 0) && written;
+	if (!written)
+	{
+		remove(tempFileName.c_str());
+		return;
+	}
+#if defined(_WIN32)
+	// rename does not replace existing files on Windows
+	MoveFileExA(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	rename(tempFileName.c_str(), fileName.c_str());
+#endif
+}
+
 void VulkanExampleBase::createPipelineCache()
 {
+	std::vector<uint8_t> data;
+	pipelineCacheWarm = !clearPipelineCache && loadPipelineCacheData(data);
+
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	if (pipelineCacheWarm)
+	{
+		pipelineCacheCreateInfo.initialDataSize = data.size();
+		pipelineCacheCreateInfo.pInitialData = data.data();
+	}
+	VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	if ((result != VK_SUCCESS) && pipelineCacheWarm)
+	{
+		// Implementation rejected the stored data, fall back to an empty cache
+		std::cout << "Could not create pipeline cache from stored data, starting with an empty cache" << std::endl;
+		pipelineCacheWarm = false;
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	}
+	VK_CHECK_RESULT(result);
 }
 
 void VulkanExampleBase::prepare()
@@ -221,6 +391,19 @@ void VulkanExampleBase::prepare()
 #if defined(__ANDROID__)
 	textureLoader->assetManager = androidApp->activity->assetManager;
 #endif
+	// All SPIR-V shaders packed into one file (see tools/shaderpack.cpp)
+	shaderPack = new vk::ShaderPack(device);
+#if defined(__ANDROID__)
+	shaderPack->assetManager = androidApp->activity->assetManager;
+#endif
+	if (shaderPack->open(getAssetPath() + "shaders/shaders.pack"))
+	{
+		std::cout << "Shader pack: " << shaderPack->getEntryCount() << " shaders" << std::endl;
+	}
+	else
+	{
+		std::cout << "No valid shader pack found, loading shaders from separate files" << std::endl;
+	}
 	if (enableTextOverlay)
 	{
 		// Load the text rendering shaders
@@ -235,7 +418,8 @@ void VulkanExampleBase::prepare()
 			depthFormat,
 			&width,
 			&height,
-			shaderStages
+			shaderStages,
+			pipelineCache
 			);
 		updateTextOverlay();
 	}
@@ -246,14 +430,9 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 	VkPipelineShaderStageCreateInfo shaderStage = {};
 	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	shaderStage.stage = stage;
-#if defined(__ANDROID__)
-	shaderStage.module = vkTools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device, stage);
-#else
-	shaderStage.module = vkTools::loadShader(fileName.c_str(), device, stage);
-#endif
+	shaderStage.module = shaderPack->getShaderModule(fileName);
 	shaderStage.pName = "main"; // todo : make param
 	assert(shaderStage.module != NULL);
-	shaderModules.push_back(shaderStage.module);
 	return shaderStage;
 }
 
@@ -689,6 +868,10 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation, PFN_GetEnabledFeatur
 		{
 			enableVSync = true;
 		}
+		if (arg == std::string("-clearpipelinecache"))
+		{
+			clearPipelineCache = true;
+		}
 	}
 #if defined(__ANDROID__)
 	// Vulkan library is loaded dynamically on Android
@@ -740,14 +923,15 @@ VulkanExampleBase::~VulkanExampleBase()
 		vkDestroyFramebuffer(device, frameBuffers[i], nullptr);
 	}
 
-	for (auto& shaderModule : shaderModules)
+	if (shaderPack)
 	{
-		vkDestroyShaderModule(device, shaderModule, nullptr);
+		delete shaderPack;
 	}
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
 
+	savePipelineCache();
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
 	if (textureLoader)
@@ -1660,14 +1844,19 @@ void VulkanExampleBase::windowResize()
 
 	flushSetupCommandBuffer();
 
+	camera.updateAspectRatio((float)width / (float)height);
+
 	// Command buffers need to be recreated as they may store
 	// references to the recreated frame buffer
+	// No frame is pending at this point (submitFrame waits for the queue), so no additional device wait is required
 	destroyCommandBuffers();
 	createCommandBuffers();
-	buildCommandBuffers();
 
-	vkQueueWaitIdle(queue);
-	vkDeviceWaitIdle(device);
+	// Notify derived class
+	// Called before the command buffers are built, so size dependent resources of the derived class can be recreated first
+	windowResized();
+
+	buildCommandBuffers();
 
 	if (enableTextOverlay)
 	{
@@ -1675,10 +1864,6 @@ void VulkanExampleBase::windowResize()
 		updateTextOverlay();
 	}
 
-	camera.updateAspectRatio((float)width / (float)height);
-
-	// Notify derived class
-	windowResized();
 	viewChanged();
 
 	prepared = true;
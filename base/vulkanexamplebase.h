@@ -42,6 +42,7 @@
 #include "vulkanTextureLoader.hpp"
 #include "vulkanMeshLoader.hpp"
 #include "vulkantextoverlay.hpp"
+#include "vulkanshaderpack.hpp"
 #include "camera.hpp"
 
 // Function pointer for getting physical device fetures to be enabled
@@ -71,6 +72,12 @@ private:
 	bool resizing = false;
 	// Called if the window is resized and some resources have to be recreatesd
 	void windowResize();
+	// Set to true to ignore the pipeline cache stored by a previous run (e.g. for measuring cold pipeline creation)
+	bool clearPipelineCache = false;
+	// Pipeline cache persistence across runs
+	std::string getPipelineCacheFileName();
+	bool loadPipelineCacheData(std::vector<uint8_t> &data);
+	void savePipelineCache();
 protected:
 	// Last frame time, measured using a high performance timer (if available)
 	float frameTimer = 1.0f;
@@ -117,10 +124,12 @@ protected:
 	uint32_t currentBuffer = 0;
 	// Descriptor set pool
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-	// List of shader modules created (stored for cleanup)
-	std::vector<VkShaderModule> shaderModules;
+	// Packed SPIR-V library, owns all shader modules created by loadShader
+	vk::ShaderPack *shaderPack = nullptr;
 	// Pipeline cache object
-	VkPipelineCache pipelineCache;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	// Set if the pipeline cache has been initialized with data stored by a previous run
+	bool pipelineCacheWarm = false;
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
 	// Synchronization semaphores
@@ -280,13 +289,14 @@ public:
 	// Note : Waits for the queue to become idle
 	void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free);
 
-	// Create a cache pool for rendering pipelines
+	// Create a cache pool for rendering pipelines, initialized with the data stored by a previous run (if valid)
 	void createPipelineCache();
 
 	// Prepare commonly used Vulkan functions
 	virtual void prepare();
 
-	// Load a SPIR-V shader
+	// Load a SPIR-V shader from the shader pack (or the loose file if not packed)
+	// The module is shared and stays valid until shaderPack->releaseShaderModules() is called
 	VkPipelineShaderStageCreateInfo loadShader(std::string fileName, VkShaderStageFlagBits stage);
 	
 	// Create a buffer, fill it with data (if != NULL) and bind buffer memory
@@ -0,0 +1,232 @@
+/*
+* GPU timestamp profiler
+*
+* Named scopes write a timestamp at their start and end, results are read back once the
+* frame has finished and smoothed over several frames
+* Scopes may be recorded into pre-recorded command buffers, as long as reset() is recorded
+* into the first command buffer submitted each frame
+* With the pipeline statistics query feature, scopes can also count their fragment shader invocations
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "vulkan/vulkan.h"
+#include "vulkantools.h"
+
+#define GPUPROFILER_MAX_SCOPES 32
+// Weight of the latest frame in the smoothed times
+#define GPUPROFILER_SMOOTHING 0.1
+
+namespace vk
+{
+	class GpuProfiler
+	{
+	private:
+		VkDevice device;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		// One fragment shader invocation query per scope, only created if pipeline statistics are supported
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		// Nanoseconds per timestamp tick
+		float timestampPeriod;
+		uint64_t timestampMask;
+
+		struct Scope
+		{
+			std::string name;
+			// Smoothed time in ms
+			double time = 0.0;
+			// Written in the last frame
+			bool active = false;
+			// Fragment shader invocations of the last frame, if counted
+			uint64_t fragmentInvocations = 0;
+			bool statisticsActive = false;
+		};
+		std::vector<Scope> scopes;
+		std::unordered_map<std::string, uint32_t> scopeIndices;
+
+		uint32_t getScopeIndex(const std::string &name)
+		{
+			auto it = scopeIndices.find(name);
+			if (it != scopeIndices.end())
+			{
+				return it->second;
+			}
+			assert(scopes.size() < GPUPROFILER_MAX_SCOPES);
+			uint32_t index = static_cast<uint32_t>(scopes.size());
+			Scope scope;
+			scope.name = name;
+			scopes.push_back(scope);
+			scopeIndices[name] = index;
+			return index;
+		}
+
+	public:
+		// Timestamps are only supported if the graphics queue has valid timestamp bits
+		GpuProfiler(VkDevice device, const VkPhysicalDeviceLimits &limits, uint32_t timestampValidBits, bool pipelineStatistics = false) : device(device)
+		{
+			timestampPeriod = limits.timestampPeriod;
+			timestampMask = (timestampValidBits >= 64) ? ~0ULL : ((1ULL << timestampValidBits) - 1);
+			if (timestampValidBits > 0)
+			{
+				VkQueryPoolCreateInfo queryPoolInfo = {};
+				queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+				queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+				queryPoolInfo.queryCount = GPUPROFILER_MAX_SCOPES * 2;
+				VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+			}
+			if (pipelineStatistics)
+			{
+				VkQueryPoolCreateInfo queryPoolInfo = {};
+				queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+				queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+				queryPoolInfo.queryCount = GPUPROFILER_MAX_SCOPES;
+				queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+				VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &statisticsPool));
+			}
+		}
+
+		~GpuProfiler()
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkDestroyQueryPool(device, queryPool, nullptr);
+			}
+			if (statisticsPool != VK_NULL_HANDLE)
+			{
+				vkDestroyQueryPool(device, statisticsPool, nullptr);
+			}
+		}
+
+		bool supported()
+		{
+			return queryPool != VK_NULL_HANDLE;
+		}
+
+		bool statisticsSupported()
+		{
+			return statisticsPool != VK_NULL_HANDLE;
+		}
+
+		// Must be recorded outside of a render pass before any scope of the frame
+		void reset(VkCommandBuffer commandBuffer)
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, GPUPROFILER_MAX_SCOPES * 2);
+			}
+			if (statisticsPool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(commandBuffer, statisticsPool, 0, GPUPROFILER_MAX_SCOPES);
+			}
+		}
+
+		// Each scope may only be recorded once per frame
+		void begin(VkCommandBuffer commandBuffer, const std::string &name)
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, getScopeIndex(name) * 2);
+			}
+		}
+
+		void end(VkCommandBuffer commandBuffer, const std::string &name)
+		{
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, getScopeIndex(name) * 2 + 1);
+			}
+		}
+
+		// Counts the fragment shader invocations of the scope, independent of its timestamps
+		// Only one scope can be counted at a time, begin and end must both be recorded outside of a render pass or inside the same subpass
+		void beginStatistics(VkCommandBuffer commandBuffer, const std::string &name)
+		{
+			if (statisticsPool != VK_NULL_HANDLE)
+			{
+				vkCmdBeginQuery(commandBuffer, statisticsPool, getScopeIndex(name), 0);
+			}
+		}
+
+		void endStatistics(VkCommandBuffer commandBuffer, const std::string &name)
+		{
+			if (statisticsPool != VK_NULL_HANDLE)
+			{
+				vkCmdEndQuery(commandBuffer, statisticsPool, getScopeIndex(name));
+			}
+		}
+
+		// Read back the timestamps and statistics of the last frame, must only be called once the frame's command buffers have completed
+		// Scopes that were not recorded in the last frame are marked as inactive
+		void update()
+		{
+			if (statisticsPool != VK_NULL_HANDLE)
+			{
+				for (uint32_t i = 0; i < static_cast<uint32_t>(scopes.size()); i++)
+				{
+					// Invocation count and availability
+					uint64_t results[2] = {};
+					vkGetQueryPoolResults(device, statisticsPool, i, 1, sizeof(results), results, sizeof(results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+					scopes[i].statisticsActive = (results[1] != 0);
+					scopes[i].fragmentInvocations = scopes[i].statisticsActive ? results[0] : 0;
+				}
+			}
+			if (queryPool == VK_NULL_HANDLE)
+			{
+				return;
+			}
+			for (uint32_t i = 0; i < static_cast<uint32_t>(scopes.size()); i++)
+			{
+				// Value and availability for the start and end timestamps
+				uint64_t results[4] = {};
+				vkGetQueryPoolResults(device, queryPool, i * 2, 2, sizeof(results), results, 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+				Scope &scope = scopes[i];
+				if ((results[1] == 0) || (results[3] == 0))
+				{
+					scope.active = false;
+					continue;
+				}
+				double time = (double)((results[2] - results[0]) & timestampMask) * timestampPeriod / 1000000.0;
+				scope.time = scope.active ? (scope.time + (time - scope.time) * GPUPROFILER_SMOOTHING) : time;
+				scope.active = true;
+			}
+		}
+
+		// Smoothed time of the scope in ms, 0 if it was not recorded in the last frame
+		double getTime(const std::string &name)
+		{
+			auto it = scopeIndices.find(name);
+			if ((it == scopeIndices.end()) || (!scopes[it->second].active))
+			{
+				return 0.0;
+			}
+			return scopes[it->second].time;
+		}
+
+		bool isActive(const std::string &name)
+		{
+			auto it = scopeIndices.find(name);
+			return (it != scopeIndices.end()) && scopes[it->second].active;
+		}
+
+		// Fragment shader invocations of the scope in the last frame, 0 if they were not counted
+		uint64_t getFragmentInvocations(const std::string &name)
+		{
+			auto it = scopeIndices.find(name);
+			if ((it == scopeIndices.end()) || (!scopes[it->second].statisticsActive))
+			{
+				return 0;
+			}
+			return scopes[it->second].fragmentInvocations;
+		}
+	};
+}
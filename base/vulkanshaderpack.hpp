@@ -0,0 +1,349 @@
+/*
+* Packed SPIR-V shader library
+*
+* All SPIR-V binaries are stored in a single file that is memory mapped at startup
+* Shader modules are created on demand and shared by all requests for the same code (content hash)
+* Loose .spv files are used for shaders not found in the pack (or if there is no pack)
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
+
+#include "vulkan/vulkan.h"
+#include "vulkantools.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__ANDROID__)
+#include <android/asset_manager.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// "SPK1"
+#define SHADERPACK_FILE_MAGIC 0x314B5053
+#define SHADERPACK_FILE_VERSION 1
+#define SHADERPACK_MAX_NAME 112
+
+// File layout: header, entryCount entries, SPIR-V data
+// Entries with identical code share the same data (offset and size)
+struct ShaderPackHeader
+{
+	uint32_t magic = SHADERPACK_FILE_MAGIC;
+	uint32_t version = SHADERPACK_FILE_VERSION;
+	uint32_t entryCount = 0;
+	uint32_t dataSize = 0;
+};
+
+struct ShaderPackEntry
+{
+	// Path relative to the pack's directory, using forward slashes
+	char name[SHADERPACK_MAX_NAME];
+	uint64_t hash;
+	// Offset from the start of the file, aligned to four bytes
+	uint32_t offset;
+	uint32_t size;
+};
+
+// 64 bit FNV-1a
+inline uint64_t shaderPackHash(const void *data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const uint8_t *bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+namespace vk
+{
+	class ShaderPack
+	{
+	private:
+		VkDevice device;
+		// Directory of the pack, stripped from requested file names
+		std::string basePath;
+		const uint8_t *data = nullptr;
+		size_t size = 0;
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#elif defined(__ANDROID__)
+		AAsset *asset = nullptr;
+#else
+		int file = -1;
+#endif
+		// Immutable once the pack has been opened
+		std::unordered_map<std::string, const ShaderPackEntry*> entries;
+		// Guards modules and stats
+		std::mutex mutex;
+		std::unordered_map<uint64_t, VkShaderModule> modules;
+
+		// Fallback for shaders not contained in the pack
+		bool readFile(const std::string &fileName, std::vector<uint8_t> &code)
+		{
+#if defined(__ANDROID__)
+			AAsset *looseAsset = AAssetManager_open(assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
+			if (!looseAsset)
+			{
+				return false;
+			}
+			code.resize(AAsset_getLength(looseAsset));
+			AAsset_read(looseAsset, code.data(), code.size());
+			AAsset_close(looseAsset);
+			return true;
+#else
+			FILE *looseFile = fopen(fileName.c_str(), "rb");
+			if (!looseFile)
+			{
+				return false;
+			}
+			fseek(looseFile, 0, SEEK_END);
+			code.resize(ftell(looseFile));
+			fseek(looseFile, 0, SEEK_SET);
+			size_t read = fread(code.data(), 1, code.size(), looseFile);
+			fclose(looseFile);
+			return read == code.size();
+#endif
+		}
+
+		bool validate()
+		{
+			if (size < sizeof(ShaderPackHeader))
+			{
+				return false;
+			}
+			const ShaderPackHeader *header = (const ShaderPackHeader*)data;
+			if ((header->magic != SHADERPACK_FILE_MAGIC) || (header->version != SHADERPACK_FILE_VERSION))
+			{
+				return false;
+			}
+			const size_t tableSize = sizeof(ShaderPackHeader) + (size_t)header->entryCount * sizeof(ShaderPackEntry);
+			if ((tableSize > size) || (tableSize + header->dataSize != size))
+			{
+				return false;
+			}
+			const ShaderPackEntry *packEntries = (const ShaderPackEntry*)(data + sizeof(ShaderPackHeader));
+			for (uint32_t i = 0; i < header->entryCount; i++)
+			{
+				const ShaderPackEntry &entry = packEntries[i];
+				if ((entry.offset < tableSize) || (entry.offset % 4 != 0) || (entry.size % 4 != 0) || ((size_t)entry.offset + entry.size > size) || (entry.name[SHADERPACK_MAX_NAME - 1] != '\0'))
+				{
+					entries.clear();
+					return false;
+				}
+				entries[entry.name] = &entry;
+			}
+			return true;
+		}
+
+		void unmap()
+		{
+#if defined(_WIN32)
+			if (data)
+			{
+				UnmapViewOfFile(data);
+			}
+			if (mapping)
+			{
+				CloseHandle(mapping);
+			}
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+			}
+			file = INVALID_HANDLE_VALUE;
+			mapping = NULL;
+#elif defined(__ANDROID__)
+			if (asset)
+			{
+				AAsset_close(asset);
+			}
+			asset = nullptr;
+#else
+			if (data)
+			{
+				munmap((void*)data, size);
+			}
+			if (file != -1)
+			{
+				close(file);
+			}
+			file = -1;
+#endif
+			data = nullptr;
+			size = 0;
+			entries.clear();
+		}
+
+	public:
+#if defined(__ANDROID__)
+		AAssetManager *assetManager = nullptr;
+#endif
+		struct Stats
+		{
+			uint32_t requests = 0;
+			uint32_t modulesCreated = 0;
+			uint32_t looseFiles = 0;
+			size_t looseBytes = 0;
+		} stats;
+
+		ShaderPack(VkDevice device) : device(device) {};
+
+		~ShaderPack()
+		{
+			releaseShaderModules();
+			unmap();
+		}
+
+		// Map the pack file into memory, shaders are loaded from loose files if this fails
+		bool open(const std::string &fileName)
+		{
+			unmap();
+			size_t separator = fileName.find_last_of("/\\");
+			basePath = (separator != std::string::npos) ? fileName.substr(0, separator + 1) : "";
+#if defined(_WIN32)
+			file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			GetFileSizeEx(file, &fileSize);
+			size = (size_t)fileSize.QuadPart;
+			mapping = (size > 0) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+			data = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#elif defined(__ANDROID__)
+			asset = AAssetManager_open(assetManager, fileName.c_str(), AASSET_MODE_BUFFER);
+			if (!asset)
+			{
+				return false;
+			}
+			size = AAsset_getLength(asset);
+			data = (const uint8_t*)AAsset_getBuffer(asset);
+#else
+			file = ::open(fileName.c_str(), O_RDONLY);
+			if (file == -1)
+			{
+				return false;
+			}
+			struct stat fileStat;
+			fstat(file, &fileStat);
+			size = (size_t)fileStat.st_size;
+			void *mapped = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+			data = (mapped != MAP_FAILED) ? (const uint8_t*)mapped : nullptr;
+#endif
+			if (!data || !validate())
+			{
+				unmap();
+				return false;
+			}
+			return true;
+		}
+
+		bool isOpen()
+		{
+			return data != nullptr;
+		}
+
+		uint32_t getEntryCount()
+		{
+			return static_cast<uint32_t>(entries.size());
+		}
+
+		// Returns a module for the given .spv file, shared with all other requests for identical code
+		// The module stays valid until releaseShaderModules() is called, can be called from multiple threads
+		VkShaderModule getShaderModule(const std::string &fileName)
+		{
+			const uint8_t *code = nullptr;
+			size_t codeSize = 0;
+			uint64_t hash = 0;
+			std::vector<uint8_t> looseCode;
+
+			std::string name = fileName;
+			std::replace(name.begin(), name.end(), '\\', '/');
+			if ((!basePath.empty()) && (name.compare(0, basePath.size(), basePath) == 0))
+			{
+				name = name.substr(basePath.size());
+			}
+			auto entry = entries.find(name);
+			if (entry != entries.end())
+			{
+				code = data + entry->second->offset;
+				codeSize = entry->second->size;
+				hash = entry->second->hash;
+			}
+			else
+			{
+				if (!readFile(fileName, looseCode))
+				{
+					std::cerr << "Error: Could not open shader file \"" << fileName << "\"" << std::endl;
+					return VK_NULL_HANDLE;
+				}
+				code = looseCode.data();
+				codeSize = looseCode.size();
+				hash = shaderPackHash(code, codeSize);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.requests++;
+			if (!looseCode.empty())
+			{
+				stats.looseFiles++;
+				stats.looseBytes += looseCode.size();
+			}
+			auto module = modules.find(hash);
+			if (module != modules.end())
+			{
+				return module->second;
+			}
+
+			VkShaderModuleCreateInfo moduleCreateInfo = {};
+			moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			moduleCreateInfo.codeSize = codeSize;
+			moduleCreateInfo.pCode = (const uint32_t*)code;
+			VkShaderModule shaderModule;
+			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &shaderModule));
+			modules[hash] = shaderModule;
+			stats.modulesCreated++;
+			return shaderModule;
+		}
+
+		uint32_t getModuleCount()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return static_cast<uint32_t>(modules.size());
+		}
+
+		// Modules are only required for creating pipelines, must not be called while pipelines are created
+		void releaseShaderModules()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& module : modules)
+			{
+				vkDestroyShaderModule(device, module.second, nullptr);
+			}
+			modules.clear();
+		}
+	};
+}
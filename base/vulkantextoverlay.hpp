@@ -61,6 +61,8 @@ private:
 	VkDescriptorSet descriptorSet;
 	VkPipelineLayout pipelineLayout;
 	VkPipelineCache pipelineCache;
+	// Set if the pipeline cache has been created by the text overlay (instead of being passed in)
+	bool ownsPipelineCache = false;
 	VkPipeline pipeline;
 	VkRenderPass renderPass;
 	VkCommandPool commandPool;
@@ -87,6 +89,7 @@ public:
 	* Default constructor
 	*
 	* @param vulkanDevice Pointer to a valid VulkanDevice
+	* @param pipelineCache (Optional) Pipeline cache used for creating the text overlay pipeline, a new one is created if not set
 	*/
 	VulkanTextOverlay(
 		vk::VulkanDevice *vulkanDevice,
@@ -96,9 +99,11 @@ public:
 		VkFormat depthformat,
 		uint32_t *framebufferwidth,
 		uint32_t *framebufferheight,
-		std::vector<VkPipelineShaderStageCreateInfo> shaderstages)
+		std::vector<VkPipelineShaderStageCreateInfo> shaderstages,
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE)
 	{
 		this->vulkanDevice = vulkanDevice;
+		this->pipelineCache = pipelineCache;
 		this->queue = queue;
 		this->colorFormat = colorformat;
 		this->depthFormat = depthformat;
@@ -134,7 +139,10 @@ public:
 		vkDestroyDescriptorSetLayout(vulkanDevice->logicalDevice, descriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(vulkanDevice->logicalDevice, descriptorPool, nullptr);
 		vkDestroyPipelineLayout(vulkanDevice->logicalDevice, pipelineLayout, nullptr);
-		vkDestroyPipelineCache(vulkanDevice->logicalDevice, pipelineCache, nullptr);
+		if (ownsPipelineCache)
+		{
+			vkDestroyPipelineCache(vulkanDevice->logicalDevice, pipelineCache, nullptr);
+		}
 		vkDestroyPipeline(vulkanDevice->logicalDevice, pipeline, nullptr);
 		vkDestroyRenderPass(vulkanDevice->logicalDevice, renderPass, nullptr);
 		vkFreeCommandBuffers(vulkanDevice->logicalDevice, commandPool, static_cast<uint32_t>(cmdBuffers.size()), cmdBuffers.data());
@@ -344,9 +352,13 @@ public:
 		vkUpdateDescriptorSets(vulkanDevice->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
 		// Pipeline cache
-		VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-		VK_CHECK_RESULT(vkCreatePipelineCache(vulkanDevice->logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+		if (pipelineCache == VK_NULL_HANDLE)
+		{
+			VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+			pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			VK_CHECK_RESULT(vkCreatePipelineCache(vulkanDevice->logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+			ownsPipelineCache = true;
+		}
 
 		// Command buffer execution fence
 		VkFenceCreateInfo fenceCreateInfo = vkTools::initializers::fenceCreateInfo();
@@ -4,25 +4,65 @@
 #extension GL_ARB_shading_language_420pack : enable
 
 layout (binding = 0) uniform sampler2D samplerSSAO;
+// Depth at the resolution of the SSAO input
+layout (binding = 1) uniform sampler2D samplerDepth;
+// Depth at the resolution of the blur target, differs from the input's when upsampling
+layout (binding = 2) uniform sampler2D samplerTargetDepth;
+
+layout (binding = 3) uniform UBO 
+{
+	mat4 projection;
+	mat4 invProjection;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
+} ubo;
+
+layout (constant_id = 0) const int BLUR_RADIUS = 4;
+layout (constant_id = 1) const int BLUR_VERTICAL = 0;
+
+// Higher values preserve more edges but leave more noise on surfaces at grazing angles
+const float DEPTH_SHARPNESS = 200.0;
 
 layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out float outFragColor;
 
+// Distance to the camera plane
+float linearDepth(float depth)
+{
+	vec4 pos = ubo.invProjection * vec4(0.0, 0.0, depth, 1.0);
+	return abs(pos.z / pos.w);
+}
+
 void main() 
 {
-	const int blurRange = 2;
-	int n = 0;
-	vec2 texelSize = 1.0 / vec2(textureSize(samplerSSAO, 0));
+	// Samples are clamped to the rendered part of the input
+	ivec2 texDim = ivec2(ceil(vec2(textureSize(samplerSSAO, 0)) * ubo.renderScale));
+	ivec2 center = clamp(ivec2(inUV * vec2(texDim)), ivec2(0), texDim - 1);
+	ivec2 direction = (BLUR_VERTICAL == 1) ? ivec2(0, 1) : ivec2(1, 0);
+
+	float centerDepth = linearDepth(texelFetch(samplerTargetDepth, ivec2(gl_FragCoord.xy), 0).r);
+	
+	// Gaussian spatial weights, reduced by the relative depth difference to the target pixel
+	const float sigma = float(BLUR_RADIUS) * 0.5 + 0.5;
 	float result = 0.0;
-	for (int x = -blurRange; x < blurRange; x++) 
+	float totalWeight = 0.0;
+	for (int i = -BLUR_RADIUS; i <= BLUR_RADIUS; i++)
 	{
-		for (int y = -blurRange; y < blurRange; y++) 
-		{
-			vec2 offset = vec2(float(x), float(y)) * texelSize;
-			result += texture(samplerSSAO, inUV + offset).r;
-			n++;
-		}
+		ivec2 samplePixel = clamp(center + direction * i, ivec2(0), texDim - 1);
+		float sampleDepth = linearDepth(texelFetch(samplerDepth, samplePixel, 0).r);
+		float depthDelta = (sampleDepth - centerDepth) / centerDepth;
+		float weight = exp(-float(i * i) / (2.0 * sigma * sigma) - depthDelta * depthDelta * DEPTH_SHARPNESS);
+		result += texelFetch(samplerSSAO, samplePixel, 0).r * weight;
+		totalWeight += weight;
 	}
-	outFragColor = result / (float(n));
+
+	// No sample on the target pixel's surface (e.g. thin geometry that was lost when downsampling)
+	if (totalWeight < 0.0001)
+	{
+		outFragColor = texelFetch(samplerSSAO, center, 0).r;
+		return;
+	}
+
+	outFragColor = result / totalWeight;
 }
\ No newline at end of file
@@ -3,99 +3,192 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout (binding = 1) uniform sampler2D samplerposition;
+// Positions are reconstructed from the depth attachment
+layout (binding = 1) uniform sampler2D samplerDepth;
 layout (binding = 2) uniform sampler2D samplerNormal;
-layout (binding = 3) uniform usampler2D samplerAlbedo;
+layout (binding = 3) uniform sampler2D samplerAlbedo;
 layout (binding = 4) uniform sampler2D samplerSSAO;
+// Result of the tiled lighting compute pass or the light volumes
+layout (binding = 6) uniform sampler2D samplerLighting;
+layout (binding = 9) uniform sampler2D samplerSky;
 
 layout (constant_id = 0) const int SSAO_ENABLED = 1;
 layout (constant_id = 1) const float AMBIENT_FACTOR = 0.0;
+// Lighting has already been done in a separate pass (tiled compute or light volumes), only output its result
+layout (constant_id = 2) const int RESOLVE_LIGHTING = 0;
+// Only apply the lights assigned to the fragment's cluster
+layout (constant_id = 3) const int CLUSTERED_LIGHTING = 0;
+
+// Must match the cluster assignment compute shader
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 256
+
+// Sphere the sky texture is mapped onto, must match skysphere.dae as loaded by the mesh loader
+#define SKY_CENTER vec3(0.0, -0.951, 0.0)
+#define SKY_RADIUS 4.0
+const float PI = 3.14159265;
 
 layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
 struct Light {
+	// View space position, range in w
 	vec4 position;
+	// Color, intensity in w
 	vec4 color;
-	float radius;
-	float quadraticFalloff;
-	float linearFalloff;
-	float _pad;
 };
 
-#define NUM_LIGHTS 17
+layout (std430, binding = 5) readonly buffer Lights
+{
+	uint lightCount;
+	Light lights[];
+};
 
-layout (binding = 5) uniform UBO 
+struct Cluster {
+	uint lightCount;
+	uint lightIndices[CLUSTER_MAX_LIGHTS];
+};
+
+layout (std430, binding = 7) readonly buffer Clusters
 {
-	Light lights[NUM_LIGHTS];
-	vec4 viewPos;
-	mat4 view;
-	mat4 model;
-} ubo;
+	Cluster clusters[];
+};
 
+layout (binding = 8) uniform UBO 
+{
+	mat4 invProjection;
+	float zNear;
+	float zFar;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
+	mat4 invView;
+} uboCamera;
+
+// Screen tile from the G-Buffer coordinates, exponential depth slice from the view space depth
+uint getClusterIndex(vec3 fragPos)
+{
+	uvec2 tile = min(uvec2(inUV * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	float slice = log(max(-fragPos.z, uboCamera.zNear) / uboCamera.zNear) / log(uboCamera.zFar / uboCamera.zNear) * float(CLUSTER_GRID_Z);
+	uint z = min(uint(slice), uint(CLUSTER_GRID_Z - 1));
+	return tile.x + tile.y * CLUSTER_GRID_X + z * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+}
+
+// Normals are stored octahedral encoded
+vec3 decodeNormal(vec2 f)
+{
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = max(-n.z, 0.0);
+	n.x += (n.x >= 0.0) ? -t : t;
+	n.y += (n.y >= 0.0) ? -t : t;
+	return normalize(n);
+}
+
+// View space position from the G-Buffer depth
+vec3 getViewPos(vec2 uv, float depth)
+{
+	vec4 pos = uboCamera.invProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return pos.xyz / pos.w;
+}
+
+// The view ray is intersected with the sky sphere, the texture is mapped by the spherical coordinates of the hit point
+vec3 skyColor(vec2 uv)
+{
+	vec3 dir = normalize(mat3(uboCamera.invView) * getViewPos(uv, 1.0));
+	float b = dot(dir, SKY_CENTER);
+	float t = b + sqrt(b * b - dot(SKY_CENTER, SKY_CENTER) + SKY_RADIUS * SKY_RADIUS);
+	vec3 n = (dir * t - SKY_CENTER) / SKY_RADIUS;
+	vec2 skyUV = vec2(fract(atan(-n.z, n.x) / (2.0 * PI) - 0.25), acos(clamp(-n.y, -1.0, 1.0)) / PI);
+	// Texture coordinates wrap around at the seam, so the mip level is not derived from their derivatives
+	return textureLod(samplerSky, skyUV, 0.0).rgb;
+}
+
+// Bilinear samples at the border of the rendered part must not read the unrendered texels next to it
+vec2 clampToRendered(vec2 uv, ivec2 texDim)
+{
+	return min(uv, uboCamera.renderScale - 0.5 / vec2(texDim));
+}
+
+vec3 pointLight(Light light, vec3 fragPos, vec3 N, vec3 V, vec3 albedo, float specular)
+{
+	vec3 L = light.position.xyz - fragPos;
+	float dist = length(L);
+	L = L / dist;
+
+	// Attenuation, offset to reach zero at the light's range
+	float atten = max(light.color.w / (dist * dist + 1.0) - light.color.w / (light.position.w * light.position.w + 1.0), 0.0);
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = light.color.rgb * albedo * NdotL * atten;
+
+	// Specular part
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	vec3 spec = light.color.rgb * specular * pow(NdotR, 16.0) * (atten * 1.5);
+
+	return diff + spec;
+}
 
 void main() 
 {
-	// Get G-Buffer values
-	vec3 fragPos = texture(samplerposition, inUV).rgb;
-	vec3 normal = texture(samplerNormal, inUV).rgb * 2.0 - 1.0;
+	// Only the scaled part of the G-Buffer has been rendered, it's upscaled to the screen
+	// G-Buffer values are fetched from the nearest texel, lighting and occlusion are filtered
+	vec2 uv = inUV * uboCamera.renderScale;
 
-	// unpack
 	ivec2 texDim = textureSize(samplerAlbedo, 0);
-	//uvec4 albedo = texture(samplerAlbedo, inUV.st, 0);
-	uvec4 albedo = texelFetch(samplerAlbedo, ivec2(inUV.st * texDim ), 0);
+	ivec2 pixel = ivec2(uv * texDim);
+	float depth = texelFetch(samplerDepth, pixel, 0).r;
 
-	vec4 color;
-	color.rg = unpackHalf2x16(albedo.r);
-	color.ba = unpackHalf2x16(albedo.g);
-	vec4 spec;
-	spec.rg = unpackHalf2x16(albedo.b);	
-
-	vec3 ambient = color.rgb * AMBIENT_FACTOR;	
-	vec3 fragcolor  = ambient;
-	
-	if (length(fragPos) == 0.0)
+	// The sky isn't rendered into the G-Buffer, pixels without depth are shaded from their view ray
+	if (depth == 1.0)
 	{
-		fragcolor = color.rgb;
+		outFragcolor = vec4(skyColor(inUV), 1.0);
+		return;
 	}
-	else
-	{	
-		for(int i = 0; i < NUM_LIGHTS; ++i)
+
+	if (RESOLVE_LIGHTING == 1)
+	{
+		outFragcolor = vec4(texture(samplerLighting, clampToRendered(uv, textureSize(samplerLighting, 0))).rgb, 1.0);
+		return;
+	}
+
+	// Get G-Buffer values
+	// Specular intensity is stored in alpha
+	vec4 color = texelFetch(samplerAlbedo, pixel, 0);
+	vec4 spec = vec4(color.a);
+
+	vec3 fragcolor = color.rgb * AMBIENT_FACTOR;
+
+	// Positions are in view space, so the viewer is at the origin
+	vec3 fragPos = getViewPos((vec2(pixel) + 0.5) / (vec2(texDim) * uboCamera.renderScale), depth);
+	vec3 N = decodeNormal(texelFetch(samplerNormal, pixel, 0).rg);
+	vec3 V = normalize(-fragPos);
+
+	if (CLUSTERED_LIGHTING == 1)
+	{
+		uint clusterIndex = getClusterIndex(fragPos);
+		uint clusterLightCount = clusters[clusterIndex].lightCount;
+		for (uint i = 0; i < clusterLightCount; ++i)
 		{
-			// Light to fragment
-			vec3 lightPos = vec3(ubo.view * ubo.model * vec4(ubo.lights[i].position.xyz, 1.0));
-			vec3 L = lightPos - fragPos;
-			float dist = length(L);
-			L = normalize(L);
-
-			// Viewer to fragment
-			vec3 viewPos = vec3(ubo.view * ubo.model * vec4(ubo.viewPos.xyz, 1.0));
-			vec3 V = viewPos - fragPos;
-			V = normalize(V);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			vec3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			vec3 diff = ubo.lights[i].color.rgb * color.rgb * NdotL * atten;
-
-			// Specular part
-			vec3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			vec3 spec = ubo.lights[i].color.rgb * spec.r * pow(NdotR, 16.0) * (atten * 1.5);
-
-			fragcolor += diff + spec;				
-		}    	
-
-		if (SSAO_ENABLED == 1)
+			fragcolor += pointLight(lights[clusters[clusterIndex].lightIndices[i]], fragPos, N, V, color.rgb, spec.r);
+		}
+	}
+	else
+	{
+		for (uint i = 0; i < lightCount; ++i)
 		{
-			float ao = texture(samplerSSAO, inUV).r;
-			fragcolor *= ao.rrr;
+			fragcolor += pointLight(lights[i], fragPos, N, V, color.rgb, spec.r);
 		}
 	}
+
+	if (SSAO_ENABLED == 1)
+	{
+		float ao = texture(samplerSSAO, clampToRendered(uv, textureSize(samplerSSAO, 0))).r;
+		fragcolor *= ao.rrr;
+	}
    
 	outFragcolor = vec4(fragcolor, 1.0);	
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Composition subpass of the merged G-Buffer pass, same lighting as composition.frag
+// The G-Buffer values of the pixel are read from the input attachments written by the first subpass,
+// so they never have to leave the tile memory of tile based GPUs
+// Only the pixel's own values can be read, so there is no SSAO in this path
+
+layout (input_attachment_index = 0, binding = 0) uniform subpassInput inputDepth;
+layout (input_attachment_index = 1, binding = 1) uniform subpassInput inputNormal;
+layout (input_attachment_index = 2, binding = 2) uniform subpassInput inputAlbedo;
+layout (binding = 6) uniform sampler2D samplerSky;
+
+layout (constant_id = 1) const float AMBIENT_FACTOR = 0.0;
+// Only apply the lights assigned to the fragment's cluster
+layout (constant_id = 3) const int CLUSTERED_LIGHTING = 0;
+
+// Must match the cluster assignment compute shader
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 256
+
+// Must match composition.frag
+#define SKY_CENTER vec3(0.0, -0.951, 0.0)
+#define SKY_RADIUS 4.0
+const float PI = 3.14159265;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragcolor;
+
+struct Light {
+	// View space position, range in w
+	vec4 position;
+	// Color, intensity in w
+	vec4 color;
+};
+
+layout (std430, binding = 3) readonly buffer Lights
+{
+	uint lightCount;
+	Light lights[];
+};
+
+struct Cluster {
+	uint lightCount;
+	uint lightIndices[CLUSTER_MAX_LIGHTS];
+};
+
+layout (std430, binding = 4) readonly buffer Clusters
+{
+	Cluster clusters[];
+};
+
+layout (binding = 5) uniform UBO
+{
+	mat4 invProjection;
+	float zNear;
+	float zFar;
+	// Not used, the merged pass isn't scaled
+	vec2 renderScale;
+	mat4 invView;
+} uboCamera;
+
+// Screen tile from the screen coordinates, exponential depth slice from the view space depth
+uint getClusterIndex(vec3 fragPos)
+{
+	uvec2 tile = min(uvec2(inUV * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	float slice = log(max(-fragPos.z, uboCamera.zNear) / uboCamera.zNear) / log(uboCamera.zFar / uboCamera.zNear) * float(CLUSTER_GRID_Z);
+	uint z = min(uint(slice), uint(CLUSTER_GRID_Z - 1));
+	return tile.x + tile.y * CLUSTER_GRID_X + z * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+}
+
+// Normals are stored octahedral encoded
+vec3 decodeNormal(vec2 f)
+{
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = max(-n.z, 0.0);
+	n.x += (n.x >= 0.0) ? -t : t;
+	n.y += (n.y >= 0.0) ? -t : t;
+	return normalize(n);
+}
+
+// View space position from the G-Buffer depth
+vec3 getViewPos(vec2 uv, float depth)
+{
+	vec4 pos = uboCamera.invProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return pos.xyz / pos.w;
+}
+
+// Same sky lookup as composition.frag
+vec3 skyColor(vec2 uv)
+{
+	vec3 dir = normalize(mat3(uboCamera.invView) * getViewPos(uv, 1.0));
+	float b = dot(dir, SKY_CENTER);
+	float t = b + sqrt(b * b - dot(SKY_CENTER, SKY_CENTER) + SKY_RADIUS * SKY_RADIUS);
+	vec3 n = (dir * t - SKY_CENTER) / SKY_RADIUS;
+	vec2 skyUV = vec2(fract(atan(-n.z, n.x) / (2.0 * PI) - 0.25), acos(clamp(-n.y, -1.0, 1.0)) / PI);
+	return textureLod(samplerSky, skyUV, 0.0).rgb;
+}
+
+vec3 pointLight(Light light, vec3 fragPos, vec3 N, vec3 V, vec3 albedo, float specular)
+{
+	vec3 L = light.position.xyz - fragPos;
+	float dist = length(L);
+	L = L / dist;
+
+	// Attenuation, offset to reach zero at the light's range
+	float atten = max(light.color.w / (dist * dist + 1.0) - light.color.w / (light.position.w * light.position.w + 1.0), 0.0);
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = light.color.rgb * albedo * NdotL * atten;
+
+	// Specular part
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	vec3 spec = light.color.rgb * specular * pow(NdotR, 16.0) * (atten * 1.5);
+
+	return diff + spec;
+}
+
+void main()
+{
+	// Get G-Buffer values
+	float depth = subpassLoad(inputDepth).r;
+
+	// The sky isn't rendered into the G-Buffer, pixels without depth are shaded from their view ray
+	if (depth == 1.0)
+	{
+		outFragcolor = vec4(skyColor(inUV), 1.0);
+		return;
+	}
+
+	// Specular intensity is stored in alpha
+	vec4 color = subpassLoad(inputAlbedo);
+	float specular = color.a;
+
+	// Positions are in view space, so the viewer is at the origin
+	vec3 fragPos = getViewPos(inUV, depth);
+	vec3 N = decodeNormal(subpassLoad(inputNormal).rg);
+	vec3 V = normalize(-fragPos);
+
+	vec3 fragcolor = color.rgb * AMBIENT_FACTOR;
+	if (CLUSTERED_LIGHTING == 1)
+	{
+		uint clusterIndex = getClusterIndex(fragPos);
+		uint clusterLightCount = clusters[clusterIndex].lightCount;
+		for (uint i = 0; i < clusterLightCount; ++i)
+		{
+			fragcolor += pointLight(lights[clusters[clusterIndex].lightIndices[i]], fragPos, N, V, color.rgb, specular);
+		}
+	}
+	else
+	{
+		for (uint i = 0; i < lightCount; ++i)
+		{
+			fragcolor += pointLight(lights[i], fragPos, N, V, color.rgb, specular);
+		}
+	}
+
+	outFragcolor = vec4(fragcolor, 1.0);
+}
\ No newline at end of file
@@ -11,12 +11,16 @@ layout (binding = 0) uniform UBO
 {
 	mat4 projection;
 	mat4 model;
+	mat4 view;
+	vec2 viewportDim;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
 } ubo;
 
 layout (location = 0) out vec3 outUV;
 
 void main() 
 {
-	outUV = vec3(inUV.st, inNormal.z);
+	outUV = vec3(inUV.st * ubo.renderScale, inNormal.z);
 	gl_Position = ubo.projection * ubo.model * vec4(inPos.xyz, 1.0);
 }
@@ -0,0 +1,44 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Depth only pre-pass for the opaque scene geometry, reads positions from a separate position only vertex stream
+// The position must be transformed exactly like in mrt.vert, as the G-Buffer pass tests against this depth for equality
+
+layout (location = 0) in vec4 inPos;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	mat4 view;
+} ubo;
+
+struct Instance
+{
+	mat4 model;
+	mat4 normal;
+};
+
+layout (set = 1, binding = 1) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+layout (push_constant) uniform DrawData
+{
+	uint instance;
+	uint material;
+} draw;
+
+out gl_PerVertex
+{
+	invariant vec4 gl_Position;
+};
+
+void main() 
+{
+	mat4 model = instances[draw.instance].model;
+	gl_Position = ubo.projection * ubo.view * model * inPos;
+}
\ No newline at end of file
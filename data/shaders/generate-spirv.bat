@@ -0,0 +1,25 @@
+glslangvalidator -V blur.frag -o blur.frag.spv
+glslangvalidator -V cluster_lights.comp -o cluster_lights.comp.spv
+glslangvalidator -V composition.frag -o composition.frag.spv
+glslangvalidator -V composition_subpass.frag -o composition_subpass.frag.spv
+glslangvalidator -V composition.vert -o composition.vert.spv
+glslangvalidator -V depth_prepass.vert -o depth_prepass.vert.spv
+glslangvalidator -V debug.frag -o debug.frag.spv
+glslangvalidator -V debug.vert -o debug.vert.spv
+glslangvalidator -V fullscreen.vert -o fullscreen.vert.spv
+glslangvalidator -V light_ambient.frag -o light_ambient.frag.spv
+glslangvalidator -V light_volume.frag -o light_volume.frag.spv
+glslangvalidator -V light_volume.vert -o light_volume.vert.spv
+glslangvalidator -V mrt.frag -o mrt.frag.spv
+glslangvalidator -V mrt.vert -o mrt.vert.spv
+glslangvalidator -V mrt_bindless.frag -o mrt_bindless.frag.spv
+glslangvalidator -V particle.frag -o particle.frag.spv
+glslangvalidator -V particle.vert -o particle.vert.spv
+glslangvalidator -V ssao.frag -o ssao.frag.spv
+glslangvalidator -V ssao_blur.comp -o ssao_blur.comp.spv
+glslangvalidator -V ssao_depth_mips.comp -o ssao_depth_mips.comp.spv
+glslangvalidator -V ssao_downsample.frag -o ssao_downsample.frag.spv
+glslangvalidator -V ssao_horizon.comp -o ssao_horizon.comp.spv
+glslangvalidator -V ssao_temporal.frag -o ssao_temporal.frag.spv
+glslangvalidator -V tiled_lighting.comp -o tiled_lighting.comp.spv
+..\..\bin\shaderpack shaders.pack . blur.frag.spv cluster_lights.comp.spv composition.frag.spv composition.vert.spv composition_subpass.frag.spv debug.frag.spv debug.vert.spv depth_prepass.vert.spv fullscreen.vert.spv light_ambient.frag.spv light_volume.frag.spv light_volume.vert.spv mrt.frag.spv mrt.vert.spv mrt_bindless.frag.spv particle.frag.spv particle.vert.spv ssao.frag.spv ssao_blur.comp.spv ssao_depth_mips.comp.spv ssao_downsample.frag.spv ssao_horizon.comp.spv ssao_temporal.frag.spv tiled_lighting.comp.spv base/textoverlay.vert.spv base/textoverlay.frag.spv
\ No newline at end of file
@@ -0,0 +1,35 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Ambient term and background of the light volume path, the light volumes are added on top
+
+layout (binding = 1) uniform sampler2D samplerDepth;
+layout (binding = 3) uniform sampler2D samplerAlbedo;
+layout (binding = 4) uniform sampler2D samplerSSAO;
+
+layout (constant_id = 0) const int SSAO_ENABLED = 1;
+layout (constant_id = 1) const float AMBIENT_FACTOR = 0.0;
+
+layout (location = 0) out vec4 outFragcolor;
+
+void main() 
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(samplerDepth, pixel, 0).r;
+	vec4 color = texelFetch(samplerAlbedo, pixel, 0);
+
+	// Pixels without depth are replaced by the sky in the composition
+	vec3 fragcolor = color.rgb;
+	if (depth < 1.0)
+	{
+		fragcolor = color.rgb * AMBIENT_FACTOR;
+		if (SSAO_ENABLED == 1)
+		{
+			fragcolor *= texelFetch(samplerSSAO, pixel, 0).r;
+		}
+	}
+
+	outFragcolor = vec4(fragcolor, 1.0);
+}
\ No newline at end of file
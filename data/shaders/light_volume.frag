@@ -0,0 +1,99 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Shades the pixels covered by a light volume (marked in the stencil buffer), blended additively
+
+// Depth is also bound as the pass' depth/stencil attachment, but only its stencil aspect is written
+layout (binding = 1) uniform sampler2D samplerDepth;
+layout (binding = 2) uniform sampler2D samplerNormal;
+layout (binding = 3) uniform sampler2D samplerAlbedo;
+layout (binding = 4) uniform sampler2D samplerSSAO;
+
+layout (binding = 6) uniform UBO 
+{
+	mat4 invProjection;
+	float zNear;
+	float zFar;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
+} ubo;
+
+struct Light {
+	// View space position, range in w
+	vec4 position;
+	// Color, intensity in w
+	vec4 color;
+};
+
+layout (std430, binding = 5) readonly buffer Lights
+{
+	uint lightCount;
+	Light lights[];
+};
+
+layout (constant_id = 0) const int SSAO_ENABLED = 1;
+
+layout (location = 0) flat in uint inLightIndex;
+
+layout (location = 0) out vec4 outFragcolor;
+
+// Normals are stored octahedral encoded
+vec3 decodeNormal(vec2 f)
+{
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = max(-n.z, 0.0);
+	n.x += (n.x >= 0.0) ? -t : t;
+	n.y += (n.y >= 0.0) ? -t : t;
+	return normalize(n);
+}
+
+// View space position from the G-Buffer depth
+vec3 getViewPos(vec2 uv, float depth)
+{
+	vec4 pos = ubo.invProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return pos.xyz / pos.w;
+}
+
+vec3 pointLight(Light light, vec3 fragPos, vec3 N, vec3 V, vec3 albedo, float specular)
+{
+	vec3 L = light.position.xyz - fragPos;
+	float dist = length(L);
+	L = L / dist;
+
+	// Attenuation, offset to reach zero at the light's range
+	float atten = max(light.color.w / (dist * dist + 1.0) - light.color.w / (light.position.w * light.position.w + 1.0), 0.0);
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = light.color.rgb * albedo * NdotL * atten;
+
+	// Specular part
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	vec3 spec = light.color.rgb * specular * pow(NdotR, 16.0) * (atten * 1.5);
+
+	return diff + spec;
+}
+
+void main() 
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(samplerDepth, pixel, 0).r;
+	// Specular intensity is stored in alpha
+	vec4 color = texelFetch(samplerAlbedo, pixel, 0);
+
+	// Positions are in view space, so the viewer is at the origin
+	vec3 fragPos = getViewPos(gl_FragCoord.xy / (vec2(textureSize(samplerDepth, 0)) * ubo.renderScale), depth);
+	vec3 N = decodeNormal(texelFetch(samplerNormal, pixel, 0).rg);
+	vec3 V = normalize(-fragPos);
+	vec3 fragcolor = pointLight(lights[inLightIndex], fragPos, N, V, color.rgb, color.a);
+
+	if (SSAO_ENABLED == 1)
+	{
+		fragcolor *= texelFetch(samplerSSAO, pixel, 0).r;
+	}
+
+	outFragcolor = vec4(fragcolor, 0.0);
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Bounding volume of a single point light, selected by the instance index
+
+layout (location = 0) in vec3 inPos;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	mat4 view;
+	vec2 viewportDim;
+} ubo;
+
+struct Light {
+	// View space position, range in w
+	vec4 position;
+	// Color, intensity in w
+	vec4 color;
+};
+
+layout (std430, binding = 5) readonly buffer Lights
+{
+	uint lightCount;
+	Light lights[];
+};
+
+layout (location = 0) flat out uint outLightIndex;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	outLightIndex = gl_InstanceIndex;
+	// Unit volume is scaled by the light's range, light positions are already in view space
+	vec4 light = lights[gl_InstanceIndex].position;
+	gl_Position = ubo.projection * vec4(light.xyz + inPos * light.w, 1.0);
+}
\ No newline at end of file
@@ -1,8 +1,27 @@
 #version 450
 
-layout (binding = 1) uniform sampler2D samplerColor;
-layout (binding = 2) uniform sampler2D samplerSpecular;
-layout (binding = 3) uniform sampler2D samplerNormal;
+layout (set = 2, binding = 0) uniform sampler2D samplerColor;
+layout (set = 2, binding = 1) uniform sampler2D samplerSpecular;
+layout (set = 2, binding = 2) uniform sampler2D samplerNormal;
+
+struct Material
+{
+	uint diffuse;
+	uint specular;
+	uint bump;
+	uint flags;
+};
+
+layout (set = 1, binding = 0) readonly buffer Materials
+{
+	Material materials[];
+};
+
+layout (push_constant) uniform DrawData
+{
+	uint instance;
+	uint material;
+} draw;
 
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec2 inUV;
@@ -11,28 +30,37 @@ layout (location = 3) in vec3 inWorldPos;
 layout (location = 4) in vec3 inTangent;
 layout (location = 5) in vec3 inBitangent;
 
-layout (location = 0) out vec4 outPosition;
-layout (location = 1) out vec4 outNormal;
-layout (location = 2) out uvec4 outAlbedo;
+// Positions are reconstructed from depth, so only normals and material properties are stored
+layout (location = 0) out vec2 outNormal;
+layout (location = 1) out vec4 outAlbedo;
 
-layout (constant_id = 0) const float NEAR_PLANE = 0.1f;
-layout (constant_id = 1) const float FAR_PLANE = 64.0f;
 layout (constant_id = 2) const int ENABLE_DISCARD = 0;
+// Material features, pipeline variants without them skip the texture fetches
+layout (constant_id = 4) const int HAS_NORMALMAP = 1;
+layout (constant_id = 5) const int HAS_SPECULARMAP = 1;
 
-float linearDepth(float depth)
+// Octahedral encoding of the unit normal, two components in [-1, 1]
+vec2 encodeNormal(vec3 n)
 {
-	float z = depth * 2.0f - 1.0f; 
-	return (2.0f * NEAR_PLANE * FAR_PLANE) / (FAR_PLANE + NEAR_PLANE - z * (FAR_PLANE - NEAR_PLANE));	
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2((n.x >= 0.0) ? 1.0 : -1.0, (n.y >= 0.0) ? 1.0 : -1.0);
+	}
+	return n.xy;
 }
 
 void main() 
 {
-	outPosition = vec4(inWorldPos, linearDepth(gl_FragCoord.z));
-
 	vec4 color = texture(samplerColor, inUV);
 
 	// Discard by alpha for transparent objects if enabled via specialization constant
-	if (ENABLE_DISCARD == 0)
+	if ((ENABLE_DISCARD == 1) && (color.a < 0.5))
+	{
+		discard;
+	}
+
+	if (HAS_NORMALMAP == 1)
 	{
 		vec3 N = normalize(inNormal);
 		vec3 B = normalize(inBitangent);
@@ -40,21 +68,15 @@ void main()
 		mat3 TBN = mat3(T, B, N);
 		vec3 nm = texture(samplerNormal, inUV).xyz * 2.0 - vec3(1.0);
 		nm = TBN * normalize(nm);
-		outNormal = vec4(nm * 0.5 + 0.5, 0.0);
+		outNormal = encodeNormal(normalize(nm));
 	}
 	else
 	{
-		outNormal = vec4(normalize(inNormal) * 0.5 + 0.5, 0.0);
-		if (color.a < 0.5)
-		{
-			discard;
-		}
+		outNormal = encodeNormal(normalize(inNormal));
 	}
 
-	// Pack
-	float specular = texture(samplerSpecular, inUV).r;
+	// Specular intensity is stored in alpha
+	float specular = (HAS_SPECULARMAP == 1) ? texture(samplerSpecular, inUV).r : 0.0;
 
-	outAlbedo.r = packHalf2x16(color.rg);
-	outAlbedo.g = packHalf2x16(color.ba);
-	outAlbedo.b = packHalf2x16(vec2(specular, 0.0));
+	outAlbedo = vec4(color.rgb, specular);
 }
\ No newline at end of file
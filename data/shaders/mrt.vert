@@ -7,13 +7,30 @@ layout (location = 3) in vec3 inNormal;
 layout (location = 4) in vec3 inTangent;
 layout (location = 5) in vec3 inBitangent;
 
-layout (binding = 0) uniform UBO 
+layout (set = 0, binding = 0) uniform UBO 
 {
 	mat4 projection;
 	mat4 model;
 	mat4 view;
 } ubo;
 
+struct Instance
+{
+	mat4 model;
+	mat4 normal;
+};
+
+layout (set = 1, binding = 1) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+layout (push_constant) uniform DrawData
+{
+	uint instance;
+	uint material;
+} draw;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec2 outUV;
 layout (location = 2) out vec3 outColor;
@@ -21,9 +38,16 @@ layout (location = 3) out vec3 outWorldPos;
 layout (location = 4) out vec3 outTangent;
 layout (location = 5) out vec3 outBitangent;
 
+// Must match the depth pre-pass exactly, the pass tests against its depth for equality
+out gl_PerVertex
+{
+	invariant vec4 gl_Position;
+};
+
 void main() 
 {
-	gl_Position = ubo.projection * ubo.view * ubo.model * inPos;
+	mat4 model = instances[draw.instance].model;
+	gl_Position = ubo.projection * ubo.view * model * inPos;
 	
 	outUV = inUV;
 	outUV.t = 1.0 - outUV.t;
@@ -31,18 +55,16 @@ void main()
 	// Vertex position in world space
 	outWorldPos = inPos.xyz;
 
-	outWorldPos = vec3(ubo.view * ubo.model * inPos);
+	outWorldPos = vec3(ubo.view * model * inPos);
 
 	// GL to Vulkan coord space
 	//outWorldPos.y = -outWorldPos.y;
 	
-	// Normal in world space
-	mat3 mNormal = transpose(inverse(mat3(ubo.model)));
-	outNormal = mNormal * normalize(inNormal);	
+	// Normal matrix is precomputed per instance
+	mat3 mNormal = mat3(instances[draw.instance].normal);
 
-	// Normal in view space
-	mat3 normalMatrix = transpose(inverse(mat3(ubo.view * ubo.model)));
-	outNormal = normalMatrix * inNormal;
+	// Normal in view space (view matrix is a rigid transform, so it can be applied directly)
+	outNormal = mat3(ubo.view) * mNormal * inNormal;
 
 	outTangent = mNormal * normalize(inTangent);
 
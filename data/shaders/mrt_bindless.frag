@@ -0,0 +1,85 @@
+#version 450
+
+// All scene textures in one array, bound once for the whole G-Buffer pass
+layout (constant_id = 3) const int TEXTURE_COUNT = 128;
+layout (set = 2, binding = 0) uniform sampler2D textures[TEXTURE_COUNT];
+
+struct Material
+{
+	uint diffuse;
+	uint specular;
+	uint bump;
+	uint flags;
+};
+
+layout (set = 1, binding = 0) readonly buffer Materials
+{
+	Material materials[];
+};
+
+layout (push_constant) uniform DrawData
+{
+	uint instance;
+	uint material;
+} draw;
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inColor;
+layout (location = 3) in vec3 inWorldPos;
+layout (location = 4) in vec3 inTangent;
+layout (location = 5) in vec3 inBitangent;
+
+// Positions are reconstructed from depth, so only normals and material properties are stored
+layout (location = 0) out vec2 outNormal;
+layout (location = 1) out vec4 outAlbedo;
+
+layout (constant_id = 2) const int ENABLE_DISCARD = 0;
+// Material features, pipeline variants without them skip the texture fetches
+layout (constant_id = 4) const int HAS_NORMALMAP = 1;
+layout (constant_id = 5) const int HAS_SPECULARMAP = 1;
+
+// Octahedral encoding of the unit normal, two components in [-1, 1]
+vec2 encodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2((n.x >= 0.0) ? 1.0 : -1.0, (n.y >= 0.0) ? 1.0 : -1.0);
+	}
+	return n.xy;
+}
+
+void main() 
+{
+	// Per-material indices into the texture array
+	Material material = materials[draw.material];
+
+	vec4 color = texture(textures[material.diffuse], inUV);
+
+	// Discard by alpha for transparent objects if enabled via specialization constant
+	if ((ENABLE_DISCARD == 1) && (color.a < 0.5))
+	{
+		discard;
+	}
+
+	if (HAS_NORMALMAP == 1)
+	{
+		vec3 N = normalize(inNormal);
+		vec3 B = normalize(inBitangent);
+		vec3 T = normalize(inTangent);
+		mat3 TBN = mat3(T, B, N);
+		vec3 nm = texture(textures[material.bump], inUV).xyz * 2.0 - vec3(1.0);
+		nm = TBN * normalize(nm);
+		outNormal = encodeNormal(normalize(nm));
+	}
+	else
+	{
+		outNormal = encodeNormal(normalize(inNormal));
+	}
+
+	// Specular intensity is stored in alpha
+	float specular = (HAS_SPECULARMAP == 1) ? texture(textures[material.specular], inUV).r : 0.0;
+
+	outAlbedo = vec4(color.rgb, specular);
+}
\ No newline at end of file
@@ -5,7 +5,7 @@
 
 layout (binding = 1) uniform sampler2D samplerSmoke;
 layout (binding = 2) uniform sampler2DArray samplerFire;
-layout (binding = 3) uniform sampler2D samplerPositionDepth;
+layout (binding = 3) uniform sampler2D samplerDepth;
 
 layout (location = 0) in vec4 inColor;
 layout (location = 1) in float inPointSize;
@@ -14,27 +14,26 @@ layout (location = 3) in flat int inType;
 layout (location = 4) in float inRotation;
 layout (location = 5) in vec2 inViewportDim;
 layout (location = 6) in float inArrayPos;
+layout (location = 7) in flat vec2 inRenderScale;
 
 layout (location = 0) out vec4 outColor;
 
-layout (constant_id = 0) const float NEAR_PLANE = 1.0f;
-layout (constant_id = 1) const float FAR_PLANE = 512.0f;
-
-float linearDepth(float depth)
-{
-	float z = depth * 2.0f - 1.0f; 
-	return (2.0f * NEAR_PLANE * FAR_PLANE) / (FAR_PLANE + NEAR_PLANE - z * (FAR_PLANE - NEAR_PLANE));	
-}
+// Depth is tested against the depth attachment of the merged G-Buffer pass instead of sampling the G-Buffer depth
+layout (constant_id = 0) const int DEPTH_ATTACHMENT_TEST = 0;
 
 void main () 
 {
 	// Sample depth from deferred depth buffer and discard if obscured
-	vec2 ndcPos = gl_FragCoord.xy / inViewportDim.xy; 
-	float depth = texture(samplerPositionDepth, ndcPos).w;
-	if (linearDepth(gl_FragCoord.z) > depth)
+	// Particles use the same projection as the G-Buffer pass, so depths can be compared directly
+	// Particles are drawn at the screen's resolution, the G-Buffer may have been rendered at a lower one
+	if (DEPTH_ATTACHMENT_TEST == 0)
 	{
-		discard;
-	};
+		float depth = texelFetch(samplerDepth, ivec2(gl_FragCoord.xy * inRenderScale), 0).r;
+		if (gl_FragCoord.z > depth)
+		{
+			discard;
+		};
+	}
 
 	vec4 color;
 	float alpha = (inAlpha <= 1.0) ? inAlpha : 2.0 - inAlpha;
@@ -17,6 +17,7 @@ layout (location = 3) out flat int outType;
 layout (location = 4) out float outRotation;
 layout (location = 5) out vec2 outViewportDim;
 layout (location = 6) out float outArrayPos;
+layout (location = 7) out flat vec2 outRenderScale;
 
 layout (binding = 0) uniform UBO 
 {
@@ -24,6 +25,8 @@ layout (binding = 0) uniform UBO
 	mat4 view;
 	mat4 model;
 	vec2 viewportDim;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
 } ubo;
 
 void main () 
@@ -34,6 +37,7 @@ void main ()
 	outType = inType;
 	outRotation = inRotation;
 	outViewportDim = ubo.viewportDim;
+	outRenderScale = ubo.renderScale;
 	  
 	vec4 eyePos = ubo.view * ubo.model * vec4(inPos.xyz, 1.0);
 	vec4 projVoxel = ubo.projection * vec4(gl_PointSize, gl_PointSize, eyePos.z, eyePos.w);
@@ -3,13 +3,15 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout (binding = 0) uniform sampler2D samplerPositionDepth;
+layout (binding = 0) uniform sampler2D samplerDepth;
 layout (binding = 1) uniform sampler2D samplerNormal;
 layout (binding = 2) uniform sampler2D ssaoNoise;
 
 layout (constant_id = 0) const int SSAO_KERNEL_SIZE = 64;
 layout (constant_id = 1) const float SSAO_RADIUS = 0.5;
 layout (constant_id = 2) const float SSAO_POWER = 1.0;
+// Samples taken per frame, if smaller than the kernel size the kernel is cycled over several frames (temporal SSAO)
+layout (constant_id = 3) const int SSAO_SAMPLE_COUNT = 64;
 
 layout (binding = 3) uniform UBOSSAOKernel
 {
@@ -19,22 +21,60 @@ layout (binding = 3) uniform UBOSSAOKernel
 layout (binding = 4) uniform UBO 
 {
 	mat4 projection;
+	mat4 invProjection;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
 } ubo;
 
+layout (binding = 5) uniform UBOTemporal
+{
+	mat4 reprojection;
+	uint frameIndex;
+	uint historyValid;
+} uboTemporal;
+
 layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out float outFragColor;
 
+// Normals are stored octahedral encoded
+vec3 decodeNormal(vec2 f)
+{
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = max(-n.z, 0.0);
+	n.x += (n.x >= 0.0) ? -t : t;
+	n.y += (n.y >= 0.0) ? -t : t;
+	return normalize(n);
+}
+
+// View space position from the G-Buffer depth at the given texture coordinate
+vec3 getViewPos(vec2 uv, ivec2 texDim)
+{
+	ivec2 pixel = clamp(ivec2(uv * vec2(texDim)), ivec2(0), texDim - 1);
+	float depth = texelFetch(samplerDepth, pixel, 0).r;
+	vec4 pos = ubo.invProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return pos.xyz / pos.w;
+}
+
 void main() 
 {
 	// Get G-Buffer values
-	vec3 fragPos = texture(samplerPositionDepth, inUV).rgb;
-	vec3 normal = normalize(texture(samplerNormal, inUV).rgb * 2.0 - 1.0);
+	// SSAO target may be smaller than the G-Buffer, so coordinates are scaled to the depth attachment's size
+	// Only its rendered part is covered by the texture coordinates
+	ivec2 texDim = ivec2(ceil(vec2(textureSize(samplerDepth, 0)) * ubo.renderScale));
+	vec3 fragPos = getViewPos(inUV, texDim);
+	vec3 normal = decodeNormal(texelFetch(samplerNormal, clamp(ivec2(inUV * vec2(texDim)), ivec2(0), texDim - 1), 0).rg);
+
+	// Frames needed to take all samples of the kernel, each frame takes every n-th sample so all distances are covered
+	const int frameCount = SSAO_KERNEL_SIZE / SSAO_SAMPLE_COUNT;
+	int kernelOffset = int(uboTemporal.frameIndex % uint(frameCount));
+	// Noise tile is shifted after each cycle through the kernel, so accumulated frames also use different sample rotations
+	uint cycle = uboTemporal.frameIndex / uint(frameCount);
+	vec2 noiseShift = (frameCount > 1) ? vec2(float(cycle % 4u), float((cycle / 4u) % 4u)) : vec2(0.0);
 
 	// Get a random vector using a noise lookup
-	ivec2 texDim = textureSize(samplerPositionDepth, 0); 
 	ivec2 noiseDim = textureSize(ssaoNoise, 0);
-	const vec2 noiseUV = vec2(float(texDim.x)/float(noiseDim.x), float(texDim.y)/(noiseDim.y)) * inUV;  
+	const vec2 noiseUV = vec2(float(texDim.x)/float(noiseDim.x), float(texDim.y)/(noiseDim.y)) * inUV + noiseShift / vec2(noiseDim);  
 	vec3 randomVec = texture(ssaoNoise, noiseUV).xyz * 2.0 - 1.0;
 	
 	// Create TBN matrix
@@ -44,9 +84,9 @@ void main()
 
 	// Calculate occlusion value
 	float occlusion = 0.0f;
-	for(int i = 0; i < SSAO_KERNEL_SIZE; i++)
+	for(int i = 0; i < SSAO_SAMPLE_COUNT; i++)
 	{		
-		vec3 samplePos = TBN * uboSSAOKernel.samples[i].xyz; 
+		vec3 samplePos = TBN * uboSSAOKernel.samples[i * frameCount + kernelOffset].xyz; 
 		samplePos = fragPos + samplePos * SSAO_RADIUS; 
 		
 		// project
@@ -55,7 +95,7 @@ void main()
 		offset.xyz /= offset.w; 
 		offset.xyz = offset.xyz * 0.5f + 0.5f; 
 		
-		float sampleDepth = -texture(samplerPositionDepth, offset.xy).w; 
+		float sampleDepth = getViewPos(offset.xy, texDim).z; 
 
 #define RANGE_CHECK 1
 #ifdef RANGE_CHECK
@@ -66,7 +106,7 @@ void main()
 		occlusion += (sampleDepth >= samplePos.z ? 1.0f : 0.0f);  
 #endif
 	}
-	occlusion = 1.0 - (occlusion / float(SSAO_KERNEL_SIZE));
+	occlusion = 1.0 - (occlusion / float(SSAO_SAMPLE_COUNT));
 	occlusion = pow(occlusion, SSAO_POWER);
 	  
 	outFragColor = occlusion;
@@ -0,0 +1,38 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (binding = 0) uniform sampler2D samplerDepth;
+layout (binding = 1) uniform sampler2D samplerNormal;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out float outDepth;
+layout (location = 1) out vec2 outNormal;
+
+void main() 
+{
+	// Each half resolution pixel covers a 2x2 block of the G-Buffer
+	// Depth and normal are taken from the same sample, averaging them would create surfaces that don't exist at depth discontinuities
+	// Nearest and farthest samples alternate in a checkerboard pattern, so both sides of an edge are kept
+	ivec2 texDim = textureSize(samplerDepth, 0);
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	bool nearest = ((pixel.x + pixel.y) & 1) == 0;
+
+	ivec2 selected = min(pixel * 2, texDim - 1);
+	float selectedDepth = texelFetch(samplerDepth, selected, 0).r;
+	for (int i = 1; i < 4; i++)
+	{
+		ivec2 samplePixel = min(pixel * 2 + ivec2(i & 1, i >> 1), texDim - 1);
+		float depth = texelFetch(samplerDepth, samplePixel, 0).r;
+		if (nearest ? (depth < selectedDepth) : (depth > selectedDepth))
+		{
+			selected = samplePixel;
+			selectedDepth = depth;
+		}
+	}
+
+	outDepth = selectedDepth;
+	outNormal = texelFetch(samplerNormal, selected, 0).rg;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Blends the current frame's occlusion with the reprojected occlusion of the previous frames
+
+layout (binding = 0) uniform sampler2D samplerSSAO;
+// Depth at the resolution of the SSAO target
+layout (binding = 1) uniform sampler2D samplerDepth;
+// Accumulated occlusion (r) and linear depth (g) of the last frame
+layout (binding = 2) uniform sampler2D samplerHistory;
+
+layout (binding = 3) uniform UBO 
+{
+	mat4 projection;
+	mat4 invProjection;
+	// Part of the G-Buffer covered by the rendered image (dynamic resolution)
+	vec2 renderScale;
+} ubo;
+
+layout (binding = 4) uniform UBOTemporal
+{
+	// Current view space to the last frame's clip space
+	mat4 reprojection;
+	uint frameIndex;
+	uint historyValid;
+} uboTemporal;
+
+// Weight of the current frame
+layout (constant_id = 0) const float TEMPORAL_BLEND = 0.15;
+// History is rejected if its depth differs by more than this (relative) from the reprojected depth
+layout (constant_id = 1) const float DEPTH_THRESHOLD = 0.05;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec2 outFragColor;
+
+void main() 
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float occlusion = texelFetch(samplerSSAO, pixel, 0).r;
+	float depth = texelFetch(samplerDepth, pixel, 0).r;
+
+	vec4 viewPos = ubo.invProjection * vec4(inUV * 2.0 - 1.0, depth, 1.0);
+	viewPos /= viewPos.w;
+	float linearDepth = abs(viewPos.z);
+
+	// Position of this pixel's surface in the last frame, clip space w is its view space depth
+	vec4 prevPos = uboTemporal.reprojection * vec4(viewPos.xyz, 1.0);
+	vec2 prevUV = (prevPos.xy / prevPos.w) * 0.5 + 0.5;
+
+	float result = occlusion;
+	if ((uboTemporal.historyValid == 1) && (prevPos.w > 0.0) && all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+	{
+		// Bilinear history across depth edges results in depths that don't match either side and is rejected
+		// History has been rendered at the same scale, it's invalidated when the scale changes
+		vec2 historyUV = min(prevUV * ubo.renderScale, ubo.renderScale - 0.5 / vec2(textureSize(samplerHistory, 0)));
+		vec2 history = texture(samplerHistory, historyUV).rg;
+		if (abs(history.g - prevPos.w) < DEPTH_THRESHOLD * prevPos.w)
+		{
+			result = mix(history.r, occlusion, TEMPORAL_BLEND);
+		}
+	}
+
+	outFragColor = vec2(result, linearDepth);
+}
\ No newline at end of file
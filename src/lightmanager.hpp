@@ -0,0 +1,266 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* CPU light manager
+*
+* Light attributes are stored in separate arrays (structure of arrays), so animation and the
+* view space transform process four lights at once with SSE (scalar fallback on other targets)
+* The result is written as a compact array that's ready to be used by the light storage buffer
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <math.h>
+#include <assert.h>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define LIGHTMANAGER_SSE
+#include <emmintrin.h>
+#endif
+
+// Light layout in the light storage buffer (std430)
+struct LightData
+{
+	// View space position, range in w
+	glm::vec4 position;
+	// Color, intensity in w
+	glm::vec4 color;
+};
+
+class LightManager
+{
+private:
+	// Number of lights, arrays are padded to a multiple of four
+	uint32_t count = 0;
+
+	// World space position without animation
+	std::vector<float> baseX, baseY, baseZ;
+	// Animated world space position
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> colorR, colorG, colorB;
+	// Intensity without flicker
+	std::vector<float> baseIntensity;
+	// Animated intensity
+	std::vector<float> intensity;
+	// Lights are culled by this distance, not affected by flicker
+	std::vector<float> range;
+	// Path offset per axis: amplitude * sin(frequency * time + phase)
+	std::vector<float> pathAmplitudeX, pathAmplitudeY, pathAmplitudeZ;
+	std::vector<float> pathFrequencyX, pathFrequencyY, pathFrequencyZ;
+	std::vector<float> pathPhaseX, pathPhaseY, pathPhaseZ;
+	// Intensity is reduced by up to amount, using two overlapping sines
+	std::vector<float> flickerAmount, flickerFrequency, flickerPhase;
+
+	std::vector<std::vector<float>*> getArrays()
+	{
+		return {
+			&baseX, &baseY, &baseZ, &posX, &posY, &posZ, &colorR, &colorG, &colorB, &baseIntensity, &intensity, &range,
+			&pathAmplitudeX, &pathAmplitudeY, &pathAmplitudeZ, &pathFrequencyX, &pathFrequencyY, &pathFrequencyZ, &pathPhaseX, &pathPhaseY, &pathPhaseZ,
+			&flickerAmount, &flickerFrequency, &flickerPhase
+		};
+	}
+
+#ifdef LIGHTMANAGER_SSE
+	// Parabola fit with one refinement step, max. error ~0.001, good enough for animations
+	static inline __m128 sin_ps(__m128 x)
+	{
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		// Reduce to [-pi, pi]
+		__m128 k = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.15915494f))));
+		x = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(6.28318531f)));
+		__m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.27323954f), x), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-0.40528473f), x), _mm_and_ps(x, absMask)));
+		return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(y, _mm_and_ps(y, absMask)), y)), y);
+	}
+#endif
+
+	static uint32_t padCount(uint32_t count)
+	{
+		return (count + 3) & ~3;
+	}
+
+public:
+	// Light that follows the camera (-1 = none)
+	int32_t attachedLight = -1;
+
+	struct Stats
+	{
+		// CPU time in ms
+		double animationTime = 0.0;
+		double transformTime = 0.0;
+	} stats;
+
+	// Returns the index of the new light
+	uint32_t add(glm::vec3 position, glm::vec3 color, float lightIntensity, float lightRange)
+	{
+		uint32_t index = count++;
+		if (padCount(count) > baseX.size())
+		{
+			for (auto array : getArrays())
+			{
+				array->resize(padCount(count), 0.0f);
+			}
+		}
+		baseX[index] = posX[index] = position.x;
+		baseY[index] = posY[index] = position.y;
+		baseZ[index] = posZ[index] = position.z;
+		colorR[index] = color.r;
+		colorG[index] = color.g;
+		colorB[index] = color.b;
+		baseIntensity[index] = intensity[index] = lightIntensity;
+		range[index] = lightRange;
+		return index;
+	}
+
+	// Lissajous path around the base position, frequencies are in cycles per timer period and should be whole numbers to loop seamlessly
+	void setPath(uint32_t index, glm::vec3 amplitude, glm::vec3 frequency, glm::vec3 phase)
+	{
+		assert(index < count);
+		const float twoPi = 6.28318531f;
+		pathAmplitudeX[index] = amplitude.x;
+		pathAmplitudeY[index] = amplitude.y;
+		pathAmplitudeZ[index] = amplitude.z;
+		pathFrequencyX[index] = frequency.x * twoPi;
+		pathFrequencyY[index] = frequency.y * twoPi;
+		pathFrequencyZ[index] = frequency.z * twoPi;
+		pathPhaseX[index] = phase.x;
+		pathPhaseY[index] = phase.y;
+		pathPhaseZ[index] = phase.z;
+	}
+
+	// Frequency is in cycles per timer period
+	void setFlicker(uint32_t index, float amount, float frequency, float phase)
+	{
+		assert(index < count);
+		flickerAmount[index] = amount;
+		flickerFrequency[index] = frequency * 6.28318531f;
+		flickerPhase[index] = phase;
+	}
+
+	uint32_t size()
+	{
+		return count;
+	}
+
+	glm::vec3 getBasePosition(uint32_t index)
+	{
+		return glm::vec3(baseX[index], baseY[index], baseZ[index]);
+	}
+
+	// Animate the first activeCount lights, time is the example's timer (0..1)
+	void update(uint32_t activeCount, float time, glm::vec3 cameraPosition)
+	{
+		assert(activeCount <= count);
+		auto tStart = std::chrono::high_resolution_clock::now();
+		const uint32_t paddedCount = padCount(activeCount);
+#ifdef LIGHTMANAGER_SSE
+		const __m128 t = _mm_set1_ps(time);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 quarter = _mm_set1_ps(0.25f);
+		const __m128 three = _mm_set1_ps(3.0f);
+		for (uint32_t i = 0; i < paddedCount; i += 4)
+		{
+			__m128 offset = sin_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pathFrequencyX[i]), t), _mm_loadu_ps(&pathPhaseX[i])));
+			_mm_storeu_ps(&posX[i], _mm_add_ps(_mm_loadu_ps(&baseX[i]), _mm_mul_ps(_mm_loadu_ps(&pathAmplitudeX[i]), offset)));
+			offset = sin_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pathFrequencyY[i]), t), _mm_loadu_ps(&pathPhaseY[i])));
+			_mm_storeu_ps(&posY[i], _mm_add_ps(_mm_loadu_ps(&baseY[i]), _mm_mul_ps(_mm_loadu_ps(&pathAmplitudeY[i]), offset)));
+			offset = sin_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pathFrequencyZ[i]), t), _mm_loadu_ps(&pathPhaseZ[i])));
+			_mm_storeu_ps(&posZ[i], _mm_add_ps(_mm_loadu_ps(&baseZ[i]), _mm_mul_ps(_mm_loadu_ps(&pathAmplitudeZ[i]), offset)));
+
+			__m128 angle = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&flickerFrequency[i]), t), _mm_loadu_ps(&flickerPhase[i]));
+			__m128 flicker = _mm_add_ps(half, _mm_mul_ps(quarter, _mm_add_ps(sin_ps(angle), sin_ps(_mm_mul_ps(angle, three)))));
+			flicker = _mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(&flickerAmount[i]), flicker));
+			_mm_storeu_ps(&intensity[i], _mm_mul_ps(_mm_loadu_ps(&baseIntensity[i]), flicker));
+		}
+#else
+		for (uint32_t i = 0; i < paddedCount; i++)
+		{
+			posX[i] = baseX[i] + pathAmplitudeX[i] * sinf(pathFrequencyX[i] * time + pathPhaseX[i]);
+			posY[i] = baseY[i] + pathAmplitudeY[i] * sinf(pathFrequencyY[i] * time + pathPhaseY[i]);
+			posZ[i] = baseZ[i] + pathAmplitudeZ[i] * sinf(pathFrequencyZ[i] * time + pathPhaseZ[i]);
+			float angle = flickerFrequency[i] * time + flickerPhase[i];
+			intensity[i] = baseIntensity[i] * (1.0f - flickerAmount[i] * (0.5f + 0.25f * (sinf(angle) + sinf(angle * 3.0f))));
+		}
+#endif
+		if ((attachedLight >= 0) && ((uint32_t)attachedLight < activeCount))
+		{
+			posX[attachedLight] = cameraPosition.x;
+			posY[attachedLight] = cameraPosition.y;
+			posZ[attachedLight] = cameraPosition.z;
+		}
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		stats.animationTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	}
+
+	// Transform the first activeCount lights to view space and write them to the destination
+	// Writes up to three additional entries (padding), so the destination must hold activeCount rounded up to a multiple of four
+	void write(uint32_t activeCount, const glm::mat4 &view, LightData *dst)
+	{
+		assert(activeCount <= count);
+		auto tStart = std::chrono::high_resolution_clock::now();
+		const uint32_t paddedCount = padCount(activeCount);
+#ifdef LIGHTMANAGER_SSE
+		// glm matrices are column major
+		__m128 m[4][3];
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			for (uint32_t r = 0; r < 3; r++)
+			{
+				m[c][r] = _mm_set1_ps(view[c][r]);
+			}
+		}
+		float *out = (float*)dst;
+		for (uint32_t i = 0; i < paddedCount; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&posX[i]);
+			__m128 y = _mm_loadu_ps(&posY[i]);
+			__m128 z = _mm_loadu_ps(&posZ[i]);
+			__m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], x), _mm_mul_ps(m[1][0], y)), _mm_add_ps(_mm_mul_ps(m[2][0], z), m[3][0]));
+			__m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][1], x), _mm_mul_ps(m[1][1], y)), _mm_add_ps(_mm_mul_ps(m[2][1], z), m[3][1]));
+			__m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][2], x), _mm_mul_ps(m[1][2], y)), _mm_add_ps(_mm_mul_ps(m[2][2], z), m[3][2]));
+			__m128 w = _mm_loadu_ps(&range[i]);
+			// Structure of arrays to array of structures
+			_MM_TRANSPOSE4_PS(vx, vy, vz, w);
+			__m128 r = _mm_loadu_ps(&colorR[i]);
+			__m128 g = _mm_loadu_ps(&colorG[i]);
+			__m128 b = _mm_loadu_ps(&colorB[i]);
+			__m128 a = _mm_loadu_ps(&intensity[i]);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			_mm_storeu_ps(out + 0, vx);
+			_mm_storeu_ps(out + 4, r);
+			_mm_storeu_ps(out + 8, vy);
+			_mm_storeu_ps(out + 12, g);
+			_mm_storeu_ps(out + 16, vz);
+			_mm_storeu_ps(out + 20, b);
+			_mm_storeu_ps(out + 24, w);
+			_mm_storeu_ps(out + 28, a);
+			out += 32;
+		}
+#else
+		for (uint32_t i = 0; i < paddedCount; i++)
+		{
+			dst[i].position = glm::vec4(glm::vec3(view * glm::vec4(posX[i], posY[i], posZ[i], 1.0f)), range[i]);
+			dst[i].color = glm::vec4(colorR[i], colorG[i], colorB[i], intensity[i]);
+		}
+#endif
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		stats.transformTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	}
+
+	static bool simd()
+	{
+#ifdef LIGHTMANAGER_SSE
+		return true;
+#else
+		return false;
+#endif
+	}
+};
@@ -0,0 +1,292 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* Declarative graphics pipeline descriptions compiled in parallel on a thread pool
+* Descriptions with a single compute shader are created as compute pipelines
+*
+* Each description owns all of its state, so pipelines can be created independently on
+* worker threads sharing the (internally synchronized) pipeline cache
+* Shader modules are taken from the shader pack, which shares them between pipelines
+*
+* A batch of pipelines can be compiled and waited for (startup), single pipelines can be
+* compiled in the background and are picked up by the render thread once finished
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+#include <assert.h>
+
+#include <vulkan/vulkan.h>
+#include "vulkantools.h"
+#include "threadpool.hpp"
+#include "vulkanshaderpack.hpp"
+
+struct PipelineShaderDesc
+{
+	std::string fileName;
+	VkShaderStageFlagBits stage;
+	std::vector<VkSpecializationMapEntry> specializationMapEntries;
+	std::vector<uint8_t> specializationData;
+};
+
+struct GraphicsPipelineDesc
+{
+	std::string name;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	// Subpass of the render pass the pipeline is used in
+	uint32_t subpass = 0;
+	std::vector<PipelineShaderDesc> shaders;
+	// Not copied, must stay valid until compilation has finished
+	const VkPipelineVertexInputStateCreateInfo *vertexInputState = nullptr;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+	bool depthTest = true;
+	bool depthWrite = true;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	bool stencilTest = false;
+	VkStencilOpState stencilFront = {};
+	VkStencilOpState stencilBack = {};
+	std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates;
+	bool relaxedRasterizationOrder = false;
+
+	// Results, written by the compiling thread
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	double compileTime = 0.0;
+	// Set for background compilations to identify outdated results
+	uint64_t requestId = 0;
+
+	GraphicsPipelineDesc(std::string name, VkPipelineLayout layout, VkRenderPass renderPass) : name(name), layout(layout), renderPass(renderPass) {};
+
+	// Compute pipelines only use the layout and the shader, all other state is ignored
+	bool isCompute() const
+	{
+		return (shaders.size() == 1) && (shaders[0].stage == VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	void addShader(std::string fileName, VkShaderStageFlagBits stage)
+	{
+		PipelineShaderDesc shader;
+		shader.fileName = fileName;
+		shader.stage = stage;
+		shaders.push_back(shader);
+	}
+
+	// Specialization constants for the last added shader, data is copied
+	template<typename T>
+	void setSpecialization(const std::vector<VkSpecializationMapEntry> &mapEntries, const T &data)
+	{
+		shaders.back().specializationMapEntries = mapEntries;
+		shaders.back().specializationData.resize(sizeof(T));
+		memcpy(shaders.back().specializationData.data(), &data, sizeof(T));
+	}
+};
+
+class PipelineCompiler
+{
+private:
+	VkDevice device;
+	VkPipelineCache pipelineCache;
+	vk::ShaderPack *shaderPack;
+	vkTools::ThreadPool threadPool;
+	uint32_t nextThread = 0;
+	std::chrono::high_resolution_clock::time_point tStart;
+	std::vector<std::chrono::high_resolution_clock::time_point> tEnd;
+
+	// Guards the batch counter and the background results
+	std::mutex mutex;
+	std::condition_variable condition;
+	uint32_t pendingBatchPipelines = 0;
+	uint32_t pendingBackgroundPipelines = 0;
+	uint64_t lastRequestId = 0;
+	std::vector<GraphicsPipelineDesc> finishedPipelines;
+
+	void addJob(std::function<void()> job)
+	{
+		threadPool.threads[nextThread]->addJob(job);
+		nextThread = (nextThread + 1) % getThreadCount();
+	}
+
+	void compilePipeline(GraphicsPipelineDesc &desc)
+	{
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStages(desc.shaders.size());
+		std::vector<VkSpecializationInfo> specializationInfos(desc.shaders.size());
+		for (size_t i = 0; i < desc.shaders.size(); i++)
+		{
+			const PipelineShaderDesc &shader = desc.shaders[i];
+			shaderStages[i] = {};
+			shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStages[i].stage = shader.stage;
+			shaderStages[i].module = shaderPack->getShaderModule(shader.fileName);
+			assert(shaderStages[i].module != VK_NULL_HANDLE);
+			shaderStages[i].pName = "main";
+			if (!shader.specializationMapEntries.empty())
+			{
+				specializationInfos[i] = vkTools::initializers::specializationInfo(static_cast<uint32_t>(shader.specializationMapEntries.size()), shader.specializationMapEntries.data(), shader.specializationData.size(), shader.specializationData.data());
+				shaderStages[i].pSpecializationInfo = &specializationInfos[i];
+			}
+		}
+
+		if (desc.isCompute())
+		{
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vkTools::initializers::computePipelineCreateInfo(desc.layout, 0);
+			computePipelineCreateInfo.stage = shaderStages[0];
+			auto tCompileStart = std::chrono::high_resolution_clock::now();
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &desc.pipeline));
+			desc.compileTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tCompileStart).count();
+			return;
+		}
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vkTools::initializers::pipelineInputAssemblyStateCreateInfo(desc.topology, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vkTools::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, desc.cullMode, desc.frontFace, 0);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vkTools::initializers::pipelineColorBlendStateCreateInfo(static_cast<uint32_t>(desc.blendAttachmentStates.size()), desc.blendAttachmentStates.data());
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vkTools::initializers::pipelineDepthStencilStateCreateInfo(desc.depthTest ? VK_TRUE : VK_FALSE, desc.depthWrite ? VK_TRUE : VK_FALSE, desc.depthCompareOp);
+		if (desc.stencilTest)
+		{
+			depthStencilState.stencilTestEnable = VK_TRUE;
+			depthStencilState.front = desc.stencilFront;
+			depthStencilState.back = desc.stencilBack;
+		}
+		VkPipelineViewportStateCreateInfo viewportState = vkTools::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vkTools::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vkTools::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
+
+		VkPipelineRasterizationStateRasterizationOrderAMD rasterAMD{};
+		if (desc.relaxedRasterizationOrder)
+		{
+			rasterAMD.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_RASTERIZATION_ORDER_AMD;
+			rasterAMD.rasterizationOrder = VK_RASTERIZATION_ORDER_RELAXED_AMD;
+			rasterizationState.pNext = &rasterAMD;
+		}
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vkTools::initializers::pipelineCreateInfo(desc.layout, desc.renderPass, 0);
+		pipelineCreateInfo.pVertexInputState = desc.vertexInputState;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineCreateInfo.pRasterizationState = &rasterizationState;
+		pipelineCreateInfo.pColorBlendState = &colorBlendState;
+		pipelineCreateInfo.pMultisampleState = &multisampleState;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCreateInfo.pStages = shaderStages.data();
+		pipelineCreateInfo.subpass = desc.subpass;
+
+		auto tCompileStart = std::chrono::high_resolution_clock::now();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &desc.pipeline));
+		desc.compileTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tCompileStart).count();
+	}
+
+public:
+	std::vector<GraphicsPipelineDesc> pipelines;
+
+	PipelineCompiler(VkDevice device, VkPipelineCache pipelineCache, vk::ShaderPack *shaderPack) : device(device), pipelineCache(pipelineCache), shaderPack(shaderPack)
+	{
+		threadPool.setThreadCount(std::max(std::thread::hardware_concurrency(), 1u));
+	};
+
+	~PipelineCompiler()
+	{
+		threadPool.wait();
+		for (auto& pipeline : finishedPipelines)
+		{
+			vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+		}
+	}
+
+	GraphicsPipelineDesc &add(std::string name, VkPipelineLayout layout, VkRenderPass renderPass)
+	{
+		pipelines.push_back(GraphicsPipelineDesc(name, layout, renderPass));
+		return pipelines.back();
+	}
+
+	uint32_t getThreadCount()
+	{
+		return static_cast<uint32_t>(threadPool.threads.size());
+	}
+
+	// Start creating all batch pipelines on worker threads, returns immediately
+	// Descriptions must not be added or changed until wait() has returned
+	void compile()
+	{
+		tStart = std::chrono::high_resolution_clock::now();
+		tEnd.assign(pipelines.size(), tStart);
+		pendingBatchPipelines = static_cast<uint32_t>(pipelines.size());
+		for (size_t i = 0; i < pipelines.size(); i++)
+		{
+			addJob([=] {
+				compilePipeline(pipelines[i]);
+				tEnd[i] = std::chrono::high_resolution_clock::now();
+				std::lock_guard<std::mutex> lock(mutex);
+				pendingBatchPipelines--;
+				condition.notify_all();
+			});
+		}
+	}
+
+	// Wait for the batch pipelines, background compilations may still be running
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this] { return pendingBatchPipelines == 0; });
+	}
+
+	// Compile a single pipeline in the background, returns an id to match the result from poll()
+	uint64_t compileAsync(const GraphicsPipelineDesc &desc)
+	{
+		std::shared_ptr<GraphicsPipelineDesc> pipeline = std::make_shared<GraphicsPipelineDesc>(desc);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pipeline->requestId = ++lastRequestId;
+			pendingBackgroundPipelines++;
+		}
+		addJob([=] {
+			compilePipeline(*pipeline);
+			std::lock_guard<std::mutex> lock(mutex);
+			finishedPipelines.push_back(*pipeline);
+			pendingBackgroundPipelines--;
+		});
+		return pipeline->requestId;
+	}
+
+	// Returns the background compilations finished since the last call, ownership of the pipelines is passed to the caller
+	std::vector<GraphicsPipelineDesc> poll()
+	{
+		std::vector<GraphicsPipelineDesc> finished;
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.swap(finishedPipelines);
+		return finished;
+	}
+
+	uint32_t getPendingCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pendingBatchPipelines + pendingBackgroundPipelines;
+	}
+
+	// Wall clock time from the start of compilation until the last pipeline was finished
+	double getElapsedTime()
+	{
+		auto tLast = tStart;
+		for (auto& t : tEnd)
+		{
+			tLast = std::max(tLast, t);
+		}
+		return std::chrono::duration<double, std::milli>(tLast - tStart).count();
+	}
+};
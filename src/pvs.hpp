@@ -0,0 +1,202 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* Potentially visible set (PVS) for the static scene geometry
+*
+* The scene volume is split into a regular grid of cells, and for each cell a bitset
+* stores which of the scene's meshes may be visible from anywhere inside that cell
+* The sets are baked offline (see tools/pvsbake.cpp) and stored next to the scene file
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#endif
+
+// "PVS1"
+#define PVS_FILE_MAGIC 0x31535650
+#define PVS_FILE_VERSION 1
+
+// File layout: header followed by one bitset per cell
+// Cells are stored x first, then y, then z
+// Each bitset has wordsPerCell 32 bit words, bit n is set if mesh n is potentially visible
+struct PVSHeader
+{
+	uint32_t magic = PVS_FILE_MAGIC;
+	uint32_t version = PVS_FILE_VERSION;
+	uint32_t meshCount = 0;
+	uint32_t wordsPerCell = 0;
+	uint32_t dim[3] = { 0, 0, 0 };
+	float origin[3] = { 0.0f, 0.0f, 0.0f };
+	float cellSize = 0.0f;
+};
+
+class PotentiallyVisibleSet
+{
+public:
+	PVSHeader header;
+	std::vector<uint32_t> bits;
+
+	// Allocate empty (nothing visible) sets for the given grid
+	void create(uint32_t meshCount, glm::vec3 origin, float cellSize, glm::uvec3 dim)
+	{
+		header = {};
+		header.meshCount = meshCount;
+		header.wordsPerCell = (meshCount + 31) / 32;
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			header.dim[i] = dim[i];
+			header.origin[i] = origin[i];
+		}
+		header.cellSize = cellSize;
+		bits.assign(cellCount() * header.wordsPerCell, 0);
+	}
+
+	bool valid() const
+	{
+		return !bits.empty();
+	}
+
+	uint32_t cellCount() const
+	{
+		return header.dim[0] * header.dim[1] * header.dim[2];
+	}
+
+	// World space center of the given cell
+	glm::vec3 getCellCenter(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return glm::vec3(header.origin[0], header.origin[1], header.origin[2]) + (glm::vec3(x, y, z) + 0.5f) * header.cellSize;
+	}
+
+	// Returns the cell containing the world space position or -1 if it's outside of the baked volume
+	int32_t getCellIndex(const glm::vec3 &position) const
+	{
+		if (!valid())
+		{
+			return -1;
+		}
+		int32_t cell[3];
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			cell[i] = (int32_t)floorf((position[i] - header.origin[i]) / header.cellSize);
+			if ((cell[i] < 0) || (cell[i] >= (int32_t)header.dim[i]))
+			{
+				return -1;
+			}
+		}
+		return cell[0] + cell[1] * header.dim[0] + cell[2] * header.dim[0] * header.dim[1];
+	}
+
+	// Everything is visible from outside of the baked volume
+	bool isVisible(int32_t cell, uint32_t meshIndex) const
+	{
+		if ((cell < 0) || (meshIndex >= header.meshCount))
+		{
+			return true;
+		}
+		return (bits[cell * header.wordsPerCell + (meshIndex >> 5)] & (1u << (meshIndex & 31))) != 0;
+	}
+
+	void setVisible(uint32_t cell, uint32_t meshIndex)
+	{
+		bits[cell * header.wordsPerCell + (meshIndex >> 5)] |= (1u << (meshIndex & 31));
+	}
+
+	uint32_t visibleCount(int32_t cell) const
+	{
+		if (cell < 0)
+		{
+			return header.meshCount;
+		}
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < header.meshCount; i++)
+		{
+			count += isVisible(cell, i) ? 1 : 0;
+		}
+		return count;
+	}
+
+	// Load from memory, the set is rejected if it was baked for a different mesh count
+	bool load(const void *data, size_t size, uint32_t meshCount)
+	{
+		bits.clear();
+		if (size < sizeof(PVSHeader))
+		{
+			return false;
+		}
+		memcpy(&header, data, sizeof(PVSHeader));
+		if ((header.magic != PVS_FILE_MAGIC) || (header.version != PVS_FILE_VERSION) || (header.meshCount != meshCount) || (header.cellSize <= 0.0f))
+		{
+			return false;
+		}
+		const size_t wordCount = (size_t)cellCount() * header.wordsPerCell;
+		if ((header.wordsPerCell != (meshCount + 31) / 32) || (size != sizeof(PVSHeader) + wordCount * sizeof(uint32_t)))
+		{
+			return false;
+		}
+		bits.resize(wordCount);
+		memcpy(bits.data(), (const uint8_t*)data + sizeof(PVSHeader), wordCount * sizeof(uint32_t));
+		return true;
+	}
+
+#if defined(__ANDROID__)
+	bool loadFromFile(AAssetManager *assetManager, std::string filename, uint32_t meshCount)
+	{
+		AAsset* asset = AAssetManager_open(assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+		if (!asset)
+		{
+			return false;
+		}
+		size_t size = AAsset_getLength(asset);
+		std::vector<uint8_t> data(size);
+		AAsset_read(asset, data.data(), size);
+		AAsset_close(asset);
+		return load(data.data(), size, meshCount);
+	}
+#else
+	bool loadFromFile(std::string filename, uint32_t meshCount)
+	{
+		FILE *file = fopen(filename.c_str(), "rb");
+		if (!file)
+		{
+			return false;
+		}
+		fseek(file, 0, SEEK_END);
+		size_t size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		std::vector<uint8_t> data(size);
+		size_t read = fread(data.data(), 1, size, file);
+		fclose(file);
+		return (read == size) && load(data.data(), size, meshCount);
+	}
+#endif
+
+	bool saveToFile(std::string filename) const
+	{
+		FILE *file = fopen(filename.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		bool result = fwrite(&header, sizeof(PVSHeader), 1, file) == 1;
+		result &= fwrite(bits.data(), sizeof(uint32_t), bits.size(), file) == bits.size();
+		fclose(file);
+		return result;
+	}
+};
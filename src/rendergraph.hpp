@@ -0,0 +1,550 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* Render graph for the passes of a frame
+*
+* Passes declare the named resources they read and write. Compiling the graph culls passes
+* whose results are never read by an output pass, derives the dependencies between the remaining
+* passes and records them as barriers in front of each pass
+* Image layouts are owned by the render passes and the passes' own code, the graph only
+* inserts execution and memory dependencies
+* Images bound to a shared memory slot are tracked together with the other images of the slot,
+* so writing one of them waits for all earlier accesses to the slot's memory. Their lifetimes
+* must not overlap, the passes writing them have to discard the previous contents
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <functional>
+#include <unordered_map>
+#include <assert.h>
+
+#include <vulkan/vulkan.h>
+
+class RenderGraph
+{
+public:
+	enum Access
+	{
+		ACCESS_COLOR_ATTACHMENT,
+		ACCESS_DEPTH_ATTACHMENT,
+		ACCESS_SAMPLED_FRAGMENT,
+		ACCESS_SAMPLED_COMPUTE,
+		ACCESS_STORAGE_FRAGMENT,
+		ACCESS_STORAGE_COMPUTE,
+		ACCESS_TRANSFER,
+	};
+
+	struct Resource
+	{
+		std::string name;
+		bool image;
+		VkFormat format;
+		uint32_t width, height;
+		VkDeviceSize size;
+		// Index of the first and last pass using the resource, -1 if it's unused
+		int32_t firstUse, lastUse;
+		// Memory slot shared with other images, -1 if the image is bound to its own memory
+		int32_t slot;
+	};
+
+	struct ResourceAccess
+	{
+		uint32_t resource;
+		Access access;
+		bool write;
+	};
+
+	// Dependency of a pass on an earlier pass
+	struct Barrier
+	{
+		uint32_t resource;
+		uint32_t srcPass;
+		VkPipelineStageFlags srcStageMask;
+		VkAccessFlags srcAccessMask;
+		VkPipelineStageFlags dstStageMask;
+		VkAccessFlags dstAccessMask;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		// Recorded outside of the graph (e.g. into the swap chain command buffers), never culled
+		bool output;
+		std::function<void(VkCommandBuffer)> record;
+		std::vector<ResourceAccess> accesses;
+		bool culled;
+		std::vector<Barrier> barriers;
+		RenderGraph *graph;
+
+		Pass &read(const std::string &resource, Access access)
+		{
+			accesses.push_back({ graph->getResourceIndex(resource), access, false });
+			return *this;
+		}
+
+		Pass &write(const std::string &resource, Access access)
+		{
+			accesses.push_back({ graph->getResourceIndex(resource), access, true });
+			return *this;
+		}
+	};
+
+	struct Stats
+	{
+		uint32_t passes = 0;
+		uint32_t culledPasses = 0;
+		uint32_t barriers = 0;
+		uint32_t aliasedImages = 0;
+		uint32_t memorySlots = 0;
+		// Memory of the used images in shared slots without and with aliasing
+		VkDeviceSize aliasedImageSize = 0;
+		VkDeviceSize memorySlotSize = 0;
+	} stats;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+
+	void clear()
+	{
+		resources.clear();
+		passes.clear();
+		resourceIndices.clear();
+		stats = Stats();
+	}
+
+	void addImage(const std::string &name, VkFormat format, uint32_t width, uint32_t height, VkDeviceSize size, int32_t slot = -1)
+	{
+		Resource resource = {};
+		resource.name = name;
+		resource.image = true;
+		resource.format = format;
+		resource.width = width;
+		resource.height = height;
+		resource.size = size;
+		resource.slot = slot;
+		addResource(resource);
+	}
+
+	void addBuffer(const std::string &name, VkDeviceSize size)
+	{
+		Resource resource = {};
+		resource.name = name;
+		resource.image = false;
+		resource.format = VK_FORMAT_UNDEFINED;
+		resource.size = size;
+		resource.slot = -1;
+		addResource(resource);
+	}
+
+	// Passes are executed in the order they are added
+	// The returned reference is only valid until the next pass is added
+	Pass &addPass(const std::string &name, std::function<void(VkCommandBuffer)> record)
+	{
+		Pass pass;
+		pass.name = name;
+		pass.output = false;
+		pass.record = record;
+		pass.culled = false;
+		pass.graph = this;
+		passes.push_back(pass);
+		return passes.back();
+	}
+
+	Pass &addOutputPass(const std::string &name)
+	{
+		Pass &pass = addPass(name, nullptr);
+		pass.output = true;
+		return pass;
+	}
+
+	void compile()
+	{
+		cullPasses();
+		buildBarriers();
+		checkMemorySlots();
+	}
+
+	// Records all passes that have not been culled, each one after its dependencies
+	// Dependencies of the output passes are recorded at the end, so they also apply to later command buffers on the same queue
+	void execute(VkCommandBuffer commandBuffer)
+	{
+		std::vector<Barrier> outputBarriers;
+		for (auto& pass : passes)
+		{
+			if (pass.culled)
+			{
+				continue;
+			}
+			if (pass.output)
+			{
+				outputBarriers.insert(outputBarriers.end(), pass.barriers.begin(), pass.barriers.end());
+				continue;
+			}
+			recordBarriers(commandBuffer, pass.barriers);
+			pass.record(commandBuffer);
+		}
+		recordBarriers(commandBuffer, outputBarriers);
+	}
+
+	std::string toJSON()
+	{
+		std::stringstream ss;
+		ss << "{\n  \"resources\": [\n";
+		for (size_t i = 0; i < resources.size(); i++)
+		{
+			const Resource &resource = resources[i];
+			ss << "    { \"name\": \"" << resource.name << "\", \"type\": \"" << (resource.image ? "image" : "buffer") << "\"";
+			if (resource.image)
+			{
+				ss << ", \"format\": " << resource.format << ", \"width\": " << resource.width << ", \"height\": " << resource.height;
+			}
+			ss << ", \"size\": " << resource.size << ", \"firstUse\": " << resource.firstUse << ", \"lastUse\": " << resource.lastUse << ", \"slot\": " << resource.slot << " }";
+			ss << ((i + 1 < resources.size()) ? ",\n" : "\n");
+		}
+		ss << "  ],\n  \"passes\": [\n";
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			const Pass &pass = passes[i];
+			ss << "    { \"name\": \"" << pass.name << "\", \"output\": " << (pass.output ? "true" : "false") << ", \"culled\": " << (pass.culled ? "true" : "false");
+			ss << ", \"reads\": [" << getAccessList(pass, false) << "], \"writes\": [" << getAccessList(pass, true) << "], \"barriers\": [";
+			for (size_t j = 0; j < pass.barriers.size(); j++)
+			{
+				const Barrier &barrier = pass.barriers[j];
+				ss << (j > 0 ? ", " : "") << "{ \"resource\": \"" << resources[barrier.resource].name << "\", \"after\": \"" << passes[barrier.srcPass].name << "\"";
+				ss << ", \"srcStageMask\": " << barrier.srcStageMask << ", \"srcAccessMask\": " << barrier.srcAccessMask << ", \"dstStageMask\": " << barrier.dstStageMask << ", \"dstAccessMask\": " << barrier.dstAccessMask << " }";
+			}
+			ss << "] }" << ((i + 1 < passes.size()) ? ",\n" : "\n");
+		}
+		ss << "  ]\n}\n";
+		return ss.str();
+	}
+
+	// Passes are boxes, resources ellipses, culled passes are drawn dashed and images sharing a memory slot have the same fill color
+	std::string toDOT()
+	{
+		std::stringstream ss;
+		ss << "digraph rendergraph {\n  rankdir=LR;\n";
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			ss << "  pass" << i << " [shape=box, label=\"" << passes[i].name << "\"" << (passes[i].culled ? ", style=dashed" : "") << (passes[i].output ? ", peripheries=2" : "") << "];\n";
+		}
+		for (size_t i = 0; i < resources.size(); i++)
+		{
+			ss << "  res" << i << " [shape=ellipse, label=\"" << resources[i].name;
+			if (resources[i].slot >= 0)
+			{
+				ss << "\\nslot " << resources[i].slot << "\", style=filled, colorscheme=set312, fillcolor=" << (resources[i].slot % 12) + 1;
+			}
+			else
+			{
+				ss << "\"";
+			}
+			ss << "];\n";
+		}
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			for (auto& access : passes[i].accesses)
+			{
+				if (access.write)
+				{
+					ss << "  pass" << i << " -> res" << access.resource << ";\n";
+				}
+				else
+				{
+					ss << "  res" << access.resource << " -> pass" << i << ";\n";
+				}
+			}
+		}
+		ss << "}\n";
+		return ss.str();
+	}
+
+private:
+	std::unordered_map<std::string, uint32_t> resourceIndices;
+
+	void addResource(Resource &resource)
+	{
+		assert(resourceIndices.find(resource.name) == resourceIndices.end());
+		resource.firstUse = -1;
+		resource.lastUse = -1;
+		resourceIndices[resource.name] = static_cast<uint32_t>(resources.size());
+		resources.push_back(resource);
+	}
+
+	uint32_t getResourceIndex(const std::string &name)
+	{
+		auto it = resourceIndices.find(name);
+		assert(it != resourceIndices.end());
+		return it->second;
+	}
+
+	static VkPipelineStageFlags getStageMask(Access access)
+	{
+		switch (access)
+		{
+		case ACCESS_COLOR_ATTACHMENT:
+			return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		case ACCESS_DEPTH_ATTACHMENT:
+			return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		case ACCESS_SAMPLED_FRAGMENT:
+		case ACCESS_STORAGE_FRAGMENT:
+			return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		case ACCESS_SAMPLED_COMPUTE:
+		case ACCESS_STORAGE_COMPUTE:
+			return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		case ACCESS_TRANSFER:
+			return VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	}
+
+	static VkAccessFlags getAccessMask(Access access, bool write)
+	{
+		switch (access)
+		{
+		case ACCESS_COLOR_ATTACHMENT:
+			return write ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		case ACCESS_DEPTH_ATTACHMENT:
+			return write ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		case ACCESS_SAMPLED_FRAGMENT:
+		case ACCESS_SAMPLED_COMPUTE:
+		case ACCESS_STORAGE_FRAGMENT:
+		case ACCESS_STORAGE_COMPUTE:
+			return write ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+		case ACCESS_TRANSFER:
+			return write ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+		}
+		return VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	}
+
+	std::string getAccessList(const Pass &pass, bool write)
+	{
+		std::string list;
+		for (auto& access : pass.accesses)
+		{
+			if (access.write == write)
+			{
+				list += (list.empty() ? "\"" : ", \"") + resources[access.resource].name + "\"";
+			}
+		}
+		return list;
+	}
+
+	// Walks the passes backwards from the output passes, a pass is kept if a kept pass reads one of its writes
+	// A read is resolved to the last earlier pass writing the resource
+	void cullPasses()
+	{
+		std::vector<bool> needed(resources.size(), false);
+		for (int32_t i = static_cast<int32_t>(passes.size()) - 1; i >= 0; i--)
+		{
+			Pass &pass = passes[i];
+			pass.culled = !pass.output;
+			for (auto& access : pass.accesses)
+			{
+				if (access.write && needed[access.resource])
+				{
+					pass.culled = false;
+				}
+			}
+			if (pass.culled)
+			{
+				continue;
+			}
+			// Writes satisfy the reads of later passes, reads have to be satisfied by earlier ones
+			for (auto& access : pass.accesses)
+			{
+				if (access.write)
+				{
+					needed[access.resource] = false;
+				}
+			}
+			for (auto& access : pass.accesses)
+			{
+				if (!access.write)
+				{
+					needed[access.resource] = true;
+				}
+			}
+		}
+		stats.passes = 0;
+		stats.culledPasses = 0;
+		for (auto& pass : passes)
+		{
+			(pass.culled ? stats.culledPasses : stats.passes)++;
+		}
+	}
+
+	// Read after write and write after write need a memory dependency, write after read only an execution dependency
+	void buildBarriers()
+	{
+		struct State
+		{
+			int32_t writer = -1;
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			// Passes and stages that have read the resource since the last write
+			std::vector<std::pair<uint32_t, VkPipelineStageFlags>> readers;
+		};
+		// Images of a memory slot share the state of the slot, which follows the states of the resources
+		int32_t slotCount = 0;
+		for (auto& resource : resources)
+		{
+			slotCount = std::max(slotCount, resource.slot + 1);
+		}
+		std::vector<State> states(resources.size() + slotCount);
+		stats.barriers = 0;
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(passes.size()); i++)
+		{
+			Pass &pass = passes[i];
+			pass.barriers.clear();
+			if (pass.culled)
+			{
+				continue;
+			}
+			for (auto& access : pass.accesses)
+			{
+				Resource &resource = resources[access.resource];
+				if (resource.firstUse < 0)
+				{
+					resource.firstUse = i;
+				}
+				resource.lastUse = i;
+
+				State &state = states[getStateIndex(access.resource)];
+				const VkPipelineStageFlags stages = getStageMask(access.access);
+				if ((state.writer >= 0) && (!access.write || state.readers.empty()))
+				{
+					addBarrier(pass, { access.resource, static_cast<uint32_t>(state.writer), state.writeStages, state.writeAccess, stages, getAccessMask(access.access, access.write) });
+				}
+				if (access.write)
+				{
+					for (auto& reader : state.readers)
+					{
+						if (reader.first != i)
+						{
+							addBarrier(pass, { access.resource, reader.first, reader.second, 0, stages, 0 });
+						}
+					}
+				}
+			}
+			// State is updated after all accesses of the pass, so a pass reading and writing the same resource depends on the earlier ones
+			for (auto& access : pass.accesses)
+			{
+				State &state = states[getStateIndex(access.resource)];
+				if (access.write)
+				{
+					if (state.writer != static_cast<int32_t>(i))
+					{
+						state.writeStages = 0;
+						state.writeAccess = 0;
+						state.readers.clear();
+					}
+					state.writer = i;
+					state.writeStages |= getStageMask(access.access);
+					state.writeAccess |= getAccessMask(access.access, true);
+				}
+				else
+				{
+					state.readers.push_back(std::make_pair(i, getStageMask(access.access)));
+				}
+			}
+			stats.barriers += static_cast<uint32_t>(pass.barriers.size());
+		}
+	}
+
+	uint32_t getStateIndex(uint32_t resource)
+	{
+		return (resources[resource].slot >= 0) ? static_cast<uint32_t>(resources.size() + resources[resource].slot) : resource;
+	}
+
+	// The contents of an image in a shared memory slot are lost once another image of the slot is written,
+	// so images of the same slot must not be used by overlapping ranges of passes
+	void checkMemorySlots()
+	{
+		std::vector<uint32_t> order;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(resources.size()); i++)
+		{
+			if ((resources[i].slot >= 0) && (resources[i].firstUse >= 0))
+			{
+				order.push_back(i);
+			}
+		}
+		std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return resources[a].firstUse < resources[b].firstUse; });
+
+		// Last use and size of the largest image of each slot
+		std::vector<std::pair<int32_t, VkDeviceSize>> slots;
+		stats.aliasedImages = static_cast<uint32_t>(order.size());
+		stats.memorySlots = 0;
+		stats.aliasedImageSize = 0;
+		stats.memorySlotSize = 0;
+		for (auto index : order)
+		{
+			const Resource &resource = resources[index];
+			if (resource.slot >= static_cast<int32_t>(slots.size()))
+			{
+				slots.resize(resource.slot + 1, std::make_pair(-1, 0));
+			}
+			auto &slot = slots[resource.slot];
+			assert(slot.first < resource.firstUse);
+			if (slot.first < 0)
+			{
+				stats.memorySlots++;
+			}
+			slot.first = resource.lastUse;
+			slot.second = std::max(slot.second, resource.size);
+			stats.aliasedImageSize += resource.size;
+		}
+		for (auto& slot : slots)
+		{
+			stats.memorySlotSize += slot.second;
+		}
+	}
+
+	// Merges dependencies on the same resource and pass
+	void addBarrier(Pass &pass, const Barrier &barrier)
+	{
+		for (auto& existing : pass.barriers)
+		{
+			if ((existing.resource == barrier.resource) && (existing.srcPass == barrier.srcPass))
+			{
+				existing.srcStageMask |= barrier.srcStageMask;
+				existing.srcAccessMask |= barrier.srcAccessMask;
+				existing.dstStageMask |= barrier.dstStageMask;
+				existing.dstAccessMask |= barrier.dstAccessMask;
+				return;
+			}
+		}
+		pass.barriers.push_back(barrier);
+	}
+
+	// All dependencies of a pass are combined into a single global memory barrier
+	void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers)
+	{
+		if (barriers.empty())
+		{
+			return;
+		}
+		VkPipelineStageFlags srcStageMask = 0;
+		VkPipelineStageFlags dstStageMask = 0;
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		for (auto& barrier : barriers)
+		{
+			srcStageMask |= barrier.srcStageMask;
+			dstStageMask |= barrier.dstStageMask;
+			memoryBarrier.srcAccessMask |= barrier.srcAccessMask;
+			memoryBarrier.dstAccessMask |= barrier.dstAccessMask;
+		}
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+};
@@ -0,0 +1,308 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* Render queue with 64 bit sort keys
+*
+* Draws are collected with a key built from pass, pipeline, material and depth,
+* radix sorted and then recorded while only emitting state binds that actually change
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <string.h>
+#include <assert.h>
+
+#include <vulkan/vulkan.h>
+
+// Key layout (msb to lsb): pass (4 bits), pipeline (12 bits), material (16 bits), depth (32 bits)
+#define RENDERQUEUE_PASS_SHIFT 60
+#define RENDERQUEUE_PIPELINE_SHIFT 48
+#define RENDERQUEUE_MATERIAL_SHIFT 32
+// Max. size of per-draw push constant data in bytes
+#define RENDERQUEUE_MAX_PUSH_CONSTANT_SIZE 32
+// Max. number of descriptor sets bound per draw
+#define RENDERQUEUE_MAX_DESCRIPTOR_SETS 4
+
+class RenderQueue
+{
+public:
+	struct DrawCommand
+	{
+		uint64_t key;
+		VkPipeline pipeline;
+		VkPipelineLayout pipelineLayout;
+		// Sets are bound starting at set 0
+		uint32_t descriptorSetCount;
+		VkDescriptorSet descriptorSets[RENDERQUEUE_MAX_DESCRIPTOR_SETS];
+		VkBuffer vertexBuffer;
+		// VK_NULL_HANDLE for non-indexed draws
+		VkBuffer indexBuffer;
+		// Index count for indexed, vertex count for non-indexed draws
+		uint32_t count;
+		uint32_t firstIndex;
+		uint32_t instanceCount;
+		uint32_t firstInstance;
+		// Optional viewport change before the draw
+		bool setViewport;
+		VkViewport viewport;
+		// Optional push constant data (e.g. material indices) written before the draw
+		VkShaderStageFlags pushConstantStages;
+		uint32_t pushConstantSize;
+		uint32_t pushConstants[RENDERQUEUE_MAX_PUSH_CONSTANT_SIZE / sizeof(uint32_t)];
+	};
+
+	struct Stats
+	{
+		uint32_t draws = 0;
+		uint32_t pipelineBinds = 0;
+		uint32_t descriptorSetBinds = 0;
+		uint32_t vertexBufferBinds = 0;
+		uint32_t indexBufferBinds = 0;
+		uint32_t pushConstantUpdates = 0;
+		// Binds a naive per-draw recording would have issued but were skipped as the state was already set
+		uint32_t redundantBindsAvoided = 0;
+		double sortTime = 0.0;
+	} stats;
+
+	std::vector<DrawCommand> commands;
+
+	// Builds a sort key, depth is the distance to the camera (>= 0)
+	// Opaque draws should be sorted front to back, blended ones back to front
+	static uint64_t makeKey(uint32_t pass, uint32_t pipelineId, uint32_t materialId, float depth, bool backToFront = false)
+	{
+		// Bit pattern of a positive float sorts like an unsigned integer
+		uint32_t depthBits;
+		depth = (depth > 0.0f) ? depth : 0.0f;
+		memcpy(&depthBits, &depth, sizeof(float));
+		if (backToFront)
+		{
+			depthBits = ~depthBits;
+		}
+		return ((uint64_t)(pass & 0xF) << RENDERQUEUE_PASS_SHIFT) | ((uint64_t)(pipelineId & 0xFFF) << RENDERQUEUE_PIPELINE_SHIFT) | ((uint64_t)(materialId & 0xFFFF) << RENDERQUEUE_MATERIAL_SHIFT) | (uint64_t)depthBits;
+	}
+
+	// Returns a small and stable id for a pipeline to be used in sort keys
+	uint32_t getPipelineId(VkPipeline pipeline)
+	{
+		auto it = pipelineIds.find((uint64_t)pipeline);
+		if (it != pipelineIds.end())
+		{
+			return it->second;
+		}
+		uint32_t id = static_cast<uint32_t>(pipelineIds.size());
+		pipelineIds[(uint64_t)pipeline] = id;
+		return id;
+	}
+
+	void clear()
+	{
+		commands.clear();
+		sorted = false;
+	}
+
+	void addIndexed(uint64_t key, VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, VkBuffer vertexBuffer, VkBuffer indexBuffer, uint32_t indexCount, uint32_t firstIndex, uint32_t firstInstance = 0)
+	{
+		DrawCommand command = {};
+		command.key = key;
+		command.pipeline = pipeline;
+		command.pipelineLayout = pipelineLayout;
+		command.descriptorSetCount = 1;
+		command.descriptorSets[0] = descriptorSet;
+		command.vertexBuffer = vertexBuffer;
+		command.indexBuffer = indexBuffer;
+		command.count = indexCount;
+		command.firstIndex = firstIndex;
+		command.instanceCount = 1;
+		command.firstInstance = firstInstance;
+		commands.push_back(command);
+		sorted = false;
+	}
+
+	void add(uint64_t key, VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, VkBuffer vertexBuffer, uint32_t vertexCount)
+	{
+		DrawCommand command = {};
+		command.key = key;
+		command.pipeline = pipeline;
+		command.pipelineLayout = pipelineLayout;
+		command.descriptorSetCount = 1;
+		command.descriptorSets[0] = descriptorSet;
+		command.vertexBuffer = vertexBuffer;
+		command.indexBuffer = VK_NULL_HANDLE;
+		command.count = vertexCount;
+		command.instanceCount = 1;
+		commands.push_back(command);
+		sorted = false;
+	}
+
+	// Change the viewport before the last added draw
+	void setViewport(VkViewport viewport)
+	{
+		commands.back().setViewport = true;
+		commands.back().viewport = viewport;
+	}
+
+	// Replace the descriptor sets of the last added draw, for pipeline layouts with multiple sets
+	// Sets should be ordered by update frequency, as only the sets starting at the first changed one are rebound
+	void setDescriptorSets(uint32_t count, const VkDescriptorSet *descriptorSets)
+	{
+		assert(count <= RENDERQUEUE_MAX_DESCRIPTOR_SETS);
+		commands.back().descriptorSetCount = count;
+		memcpy(commands.back().descriptorSets, descriptorSets, count * sizeof(VkDescriptorSet));
+	}
+
+	// Push constants for the last added draw, only written if they differ from the previous draw
+	void setPushConstants(VkShaderStageFlags stages, uint32_t size, const void *data)
+	{
+		assert(size <= RENDERQUEUE_MAX_PUSH_CONSTANT_SIZE);
+		commands.back().pushConstantStages = stages;
+		commands.back().pushConstantSize = size;
+		memcpy(commands.back().pushConstants, data, size);
+	}
+
+	// LSD radix sort over the keys, 8 bits per pass
+	// Passes where all keys share the same byte are skipped
+	void sort()
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		const size_t count = commands.size();
+		order.resize(count);
+		scratch.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			order[i] = i;
+		}
+
+		for (uint32_t shift = 0; (shift < 64) && (count > 0); shift += 8)
+		{
+			uint32_t histogram[256] = {};
+			for (size_t i = 0; i < count; i++)
+			{
+				histogram[(commands[i].key >> shift) & 0xFF]++;
+			}
+			if (histogram[(commands[0].key >> shift) & 0xFF] == count)
+			{
+				continue;
+			}
+			uint32_t offset = 0;
+			for (uint32_t b = 0; b < 256; b++)
+			{
+				uint32_t c = histogram[b];
+				histogram[b] = offset;
+				offset += c;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				uint32_t index = order[i];
+				scratch[histogram[(commands[index].key >> shift) & 0xFF]++] = index;
+			}
+			order.swap(scratch);
+		}
+
+		sorted = true;
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		stats.sortTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	}
+
+	// Record all draws in sorted order, state is only bound if it differs from the previous draw
+	void submit(VkCommandBuffer commandBuffer)
+	{
+		if (!sorted)
+		{
+			sort();
+		}
+
+		double sortTime = stats.sortTime;
+		stats = {};
+		stats.sortTime = sortTime;
+
+		VkPipeline currentPipeline = VK_NULL_HANDLE;
+		VkDescriptorSet currentDescriptorSets[RENDERQUEUE_MAX_DESCRIPTOR_SETS] = {};
+		VkBuffer currentVertexBuffer = VK_NULL_HANDLE;
+		VkBuffer currentIndexBuffer = VK_NULL_HANDLE;
+		const DrawCommand *currentPushConstants = nullptr;
+		VkDeviceSize offsets[1] = { 0 };
+		uint32_t naiveBinds = 0;
+
+		for (auto index : order)
+		{
+			const DrawCommand &command = commands[index];
+
+			if (command.pipeline != currentPipeline)
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, command.pipeline);
+				currentPipeline = command.pipeline;
+				stats.pipelineBinds++;
+			}
+			uint32_t firstSet = 0;
+			while ((firstSet < command.descriptorSetCount) && (command.descriptorSets[firstSet] == currentDescriptorSets[firstSet]))
+			{
+				firstSet++;
+			}
+			if (firstSet < command.descriptorSetCount)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, command.pipelineLayout, firstSet, command.descriptorSetCount - firstSet, &command.descriptorSets[firstSet], 0, nullptr);
+				// Sets above the bound ones may have been disturbed by an incompatible layout
+				for (uint32_t i = 0; i < RENDERQUEUE_MAX_DESCRIPTOR_SETS; i++)
+				{
+					currentDescriptorSets[i] = (i < command.descriptorSetCount) ? command.descriptorSets[i] : VK_NULL_HANDLE;
+				}
+				stats.descriptorSetBinds++;
+			}
+			// Draws without a vertex buffer generate their vertices in the shader
+			if ((command.vertexBuffer != VK_NULL_HANDLE) && (command.vertexBuffer != currentVertexBuffer))
+			{
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &command.vertexBuffer, offsets);
+				currentVertexBuffer = command.vertexBuffer;
+				stats.vertexBufferBinds++;
+			}
+			naiveBinds += 3;
+			if (command.pushConstantSize > 0)
+			{
+				naiveBinds++;
+				if ((currentPushConstants == nullptr) || (currentPushConstants->pipelineLayout != command.pipelineLayout) || (currentPushConstants->pushConstantStages != command.pushConstantStages) || (currentPushConstants->pushConstantSize != command.pushConstantSize) || (memcmp(currentPushConstants->pushConstants, command.pushConstants, command.pushConstantSize) != 0))
+				{
+					vkCmdPushConstants(commandBuffer, command.pipelineLayout, command.pushConstantStages, 0, command.pushConstantSize, command.pushConstants);
+					currentPushConstants = &command;
+					stats.pushConstantUpdates++;
+				}
+			}
+			if (command.setViewport)
+			{
+				vkCmdSetViewport(commandBuffer, 0, 1, &command.viewport);
+			}
+			if (command.indexBuffer != VK_NULL_HANDLE)
+			{
+				naiveBinds++;
+				if (command.indexBuffer != currentIndexBuffer)
+				{
+					vkCmdBindIndexBuffer(commandBuffer, command.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+					currentIndexBuffer = command.indexBuffer;
+					stats.indexBufferBinds++;
+				}
+				vkCmdDrawIndexed(commandBuffer, command.count, command.instanceCount, command.firstIndex, 0, command.firstInstance);
+			}
+			else
+			{
+				vkCmdDraw(commandBuffer, command.count, command.instanceCount, 0, command.firstInstance);
+			}
+			stats.draws++;
+		}
+
+		stats.redundantBindsAvoided = naiveBinds - (stats.pipelineBinds + stats.descriptorSetBinds + stats.vertexBufferBinds + stats.indexBufferBinds + stats.pushConstantUpdates);
+	}
+
+private:
+	std::unordered_map<uint64_t, uint32_t> pipelineIds;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> scratch;
+	bool sorted = false;
+};
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <vector>
 #include <random>
+#include <algorithm>
 #include <unordered_map>
 
 #define GLM_FORCE_RADIANS
@@ -23,6 +24,13 @@
 #include <vulkan/vulkan.h>
 #include "vulkanexamplebase.h"
 #include "particlesystem.hpp"
+#include "pvs.hpp"
+#include "renderqueue.hpp"
+#include "pipelinecompiler.hpp"
+#include "vulkanprofiler.hpp"
+#include "vulkandeletionqueue.hpp"
+#include "lightmanager.hpp"
+#include "rendergraph.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
@@ -33,6 +41,65 @@
 #define SSAO_KERNEL_SIZE 32
 #define SSAO_RADIUS 2.0f
 #define SSAO_NOISE_DIM 4
+// Texels sampled on each side of the center by each of the separable blur passes
+#define SSAO_BLUR_RADIUS 4
+// Work group size of the compute blur, pixels along the blur direction and number of lines (must match ssao_blur.comp)
+#define SSAO_BLUR_TILE_SIZE 64
+#define SSAO_BLUR_TILE_LINES 4
+// Samples per frame of the temporal SSAO, the kernel is cycled over SSAO_KERNEL_SIZE / SSAO_TEMPORAL_SAMPLES frames
+#define SSAO_TEMPORAL_SAMPLES 8
+// Weight of the current frame when blending with the accumulated history
+#define SSAO_TEMPORAL_BLEND 0.15f
+// Levels of the linear depth mip chain read by the horizon based AO
+#define SSAO_DEPTH_MIP_LEVELS 5
+// Horizon steps closer than 2^SSAO_DEPTH_MIP_OFFSET pixels read the first level of the depth mip chain
+#define SSAO_DEPTH_MIP_OFFSET 3
+// Work group size of the depth mip chain and horizon AO passes (must match ssao_depth_mips.comp and ssao_horizon.comp)
+#define SSAO_COMPUTE_GROUP_SIZE 8
+// Camera distance after which the G-Buffer draws are sorted again
+#define RENDERQUEUE_RESORT_DISTANCE 16.0f
+// Size of the texture array used by the bindless G-Buffer path
+#define BINDLESS_TEXTURE_COUNT 128
+// Capacity of the light storage buffer
+#define LIGHTS_MAX_COUNT 8192
+// Light attenuation is offset by this value, so lights have a finite range they can be culled by
+#define LIGHT_ATTENUATION_CUTOFF 0.01f
+// Work group size of the tiled lighting compute shader
+#define TILED_LIGHTING_TILE_SIZE 16
+// Clustered lighting: view space froxel grid (screen tiles and exponential depth slices), must match the shaders
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+// Lights exceeding this limit are ignored for the cluster
+#define CLUSTER_MAX_LIGHTS 256
+// Work group size of the cluster assignment compute shader
+#define CLUSTER_ASSIGNMENT_GROUP_SIZE 64
+// Dynamic resolution: GPU frame time in ms held by the controller, can be changed with "-targetframetime ms"
+#define DYNAMIC_RESOLUTION_TARGET_FRAME_TIME 8.0f
+// Render scale limits and step size, the scale is quantized so small changes in frame time don't re-record the command buffers
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+#define DYNAMIC_RESOLUTION_STEP 0.05f
+// Frames between two scale changes, gives the smoothed GPU times time to settle at the new resolution
+#define DYNAMIC_RESOLUTION_INTERVAL 30
+// Resolution is only raised again if the frame time falls below this part of the target
+#define DYNAMIC_RESOLUTION_HEADROOM 0.8f
+
+// Command buffers recorded for other render modes that are kept for switching back, the least recently used ones are freed
+#define COMMAND_BUFFER_VARIANTS_MAX 8
+
+// Number of the slowest pipelines of the initial creation listed in the overlay
+#define PIPELINE_TIMES_SHOWN 3
+
+// Material flags stored in the material storage buffer
+#define MATERIAL_FLAG_ALPHA 0x1
+#define MATERIAL_FLAG_BUMP 0x2
+
+// Material features selecting the G-Buffer pipeline variant
+#define MATERIAL_VARIANT_ALPHA 0x1
+#define MATERIAL_VARIANT_NORMALMAP 0x2
+#define MATERIAL_VARIANT_SPECULARMAP 0x4
+#define MATERIAL_VARIANT_COUNT 8
 
 //#define PER_MESH_BUFFERS
 
@@ -91,8 +158,13 @@ public:
 		}
 	}
 
+	// Adding an existing name returns the layout created first
 	VkPipelineLayout add(std::string name, VkPipelineLayoutCreateInfo &createInfo)
 	{
+		if (present(name))
+		{
+			return resources[name];
+		}
 		VkPipelineLayout pipelineLayout;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &createInfo, nullptr, &pipelineLayout));
 		resources[name] = pipelineLayout;
@@ -113,10 +185,8 @@ public:
 		}
 	}
 
-	VkPipeline addGraphicsPipeline(std::string name, VkGraphicsPipelineCreateInfo &pipelineCreateInfo, VkPipelineCache &pipelineCache)
+	VkPipeline add(std::string name, VkPipeline pipeline)
 	{
-		VkPipeline pipeline;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 		resources[name] = pipeline;
 		return pipeline;
 	}
@@ -177,8 +247,13 @@ public:
 		}
 	}
 
+	// Adding an existing name returns the layout created first
 	VkDescriptorSetLayout add(std::string name, VkDescriptorSetLayoutCreateInfo createInfo)
 	{
+		if (present(name))
+		{
+			return resources[name];
+		}
 		VkDescriptorSetLayout descriptorSetLayout;
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &descriptorSetLayout));
 		resources[name] = descriptorSetLayout;
@@ -201,8 +276,14 @@ public:
 		}
 	}
 
+	// Adding an existing name returns the set allocated first, so the descriptor setup can run again
+	// to write new descriptors into the existing sets (e.g. after the frame buffer attachments have been recreated)
 	VkDescriptorSet add(std::string name, VkDescriptorSetAllocateInfo allocInfo)
 	{
+		if (present(name))
+		{
+			return resources[name];
+		}
 		VkDescriptorSet descriptorSet;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 		resources[name] = descriptorSet;
@@ -229,7 +310,16 @@ struct SceneMaterial
 	bool hasAlpha = false;
 	bool hasBump = false;
 	bool hasSpecular = false;
-	VkPipeline pipeline;
+	// Combination of MATERIAL_VARIANT_* bits
+	uint32_t pipelineVariant = 0;
+	// Shared by all meshes using this material
+	VkDescriptorSet descriptorSet;
+	// Indices into the scene's texture array, used by the bindless path
+	struct {
+		uint32_t diffuse;
+		uint32_t specular;
+		uint32_t bump;
+	} textureIndices;
 };
 
 struct SceneMesh
@@ -243,8 +333,9 @@ struct SceneMesh
 	uint32_t indexCount;
 	uint32_t indexBase;
 
-	// Better move to material and share among meshes with same material
-	VkDescriptorSet descriptorSet;
+	// Bounding sphere
+	glm::vec3 center;
+	float radius;
 
 	SceneMaterial *material;
 };
@@ -275,8 +366,8 @@ private:
 	VkDevice device;
 	VkQueue queue;
 	
-	// todo: rename
-	vk::Buffer *defaultUBO;
+	// Layout of the per-material (texture) descriptor sets
+	VkDescriptorSetLayout materialSetLayout;
 	
 	VkDescriptorPool descriptorPool;
 
@@ -284,6 +375,22 @@ private:
 
 	const aiScene* aScene;
 
+	std::unordered_map<std::string, uint32_t> textureIndices;
+
+	// Returns the index of the texture in the scene's texture array, adding it if not yet present
+	uint32_t getTextureIndex(const std::string &name)
+	{
+		auto it = textureIndices.find(name);
+		if (it != textureIndices.end())
+		{
+			return it->second;
+		}
+		uint32_t index = static_cast<uint32_t>(textureDescriptors.size());
+		textureDescriptors.push_back(resources.textures->get(name).descriptor);
+		textureIndices[name] = index;
+		return index;
+	}
+
 	void loadMaterials()
 	{
 		// Add dummy textures for objects without texture
@@ -320,11 +427,13 @@ private:
 				} else {
 					materials[i].diffuse = resources.textures->get(fileName);
 				}
+				materials[i].textureIndices.diffuse = getTextureIndex(fileName);
 			}
 			else
 			{
 				std::cout << "  Material has no diffuse, using dummy texture!" << std::endl;
 				materials[i].diffuse = resources.textures->get("dummy.diffuse");
+				materials[i].textureIndices.diffuse = getTextureIndex("dummy.diffuse");
 			}
 			// Specular
 			if (aScene->mMaterials[i]->GetTextureCount(aiTextureType_SPECULAR) > 0)
@@ -333,17 +442,20 @@ private:
 				std::cout << "  Specular: \"" << texturefile.C_Str() << "\"" << std::endl;
 				std::string fileName = std::string(texturefile.C_Str());
 				std::replace(fileName.begin(), fileName.end(), '\\', '/');
+				materials[i].hasSpecular = true;
 				if (!resources.textures->present(fileName)) {
 					materials[i].specular = resources.textures->addTexture2D(fileName, assetPath + fileName, VK_FORMAT_BC2_UNORM_BLOCK);
 				}
 				else {
 					materials[i].specular = resources.textures->get(fileName);
 				}
+				materials[i].textureIndices.specular = getTextureIndex(fileName);
 			}
 			else
 			{
 				std::cout << "  Material has no specular, using dummy texture!" << std::endl;
 				materials[i].specular = resources.textures->get("dummy.specular");
+				materials[i].textureIndices.specular = getTextureIndex("dummy.specular");
 			}
 
 			// Bump (map_bump is mapped to height by assimp)
@@ -360,11 +472,13 @@ private:
 				else {
 					materials[i].bump = resources.textures->get(fileName);
 				}
+				materials[i].textureIndices.bump = getTextureIndex(fileName);
 			}
 			else
 			{
 				std::cout << "  Material has no bump, using dummy texture!" << std::endl;
 				materials[i].bump = resources.textures->get("dummy.bump");
+				materials[i].textureIndices.bump = getTextureIndex("dummy.bump");
 			}
 
 			// Mask
@@ -374,7 +488,19 @@ private:
 				materials[i].hasAlpha = true;
 			}
 
-			materials[i].pipeline = resources.pipelines->get("scene.solid");
+			// Alpha masked materials (foliage) are rendered without normal mapping
+			if (materials[i].hasAlpha)
+			{
+				materials[i].pipelineVariant |= MATERIAL_VARIANT_ALPHA;
+			}
+			else if (materials[i].hasBump)
+			{
+				materials[i].pipelineVariant |= MATERIAL_VARIANT_NORMALMAP;
+			}
+			if (materials[i].hasSpecular)
+			{
+				materials[i].pipelineVariant |= MATERIAL_VARIANT_SPECULARMAP;
+			}
 		}
 
 	}
@@ -406,6 +532,9 @@ private:
 
 			uint32_t vertexBase = gVertices.size();
 
+			glm::vec3 boundsMin(FLT_MAX);
+			glm::vec3 boundsMax(-FLT_MAX);
+
 			for (uint32_t i = 0; i < aMesh->mNumVertices; i++)
 			{
 				vertices[i].pos = glm::make_vec3(&aMesh->mVertices[i].x);// *0.5f;
@@ -417,8 +546,13 @@ private:
 				vertices[i].tangent = (hasTangent) ? glm::make_vec3(&aMesh->mTangents[i].x) : glm::vec3(0.0f, 1.0f, 0.0f);
 				vertices[i].bitangent = (hasTangent) ? glm::make_vec3(&aMesh->mBitangents[i].x) : glm::vec3(0.0f, 1.0f, 0.0f);				
 				gVertices.push_back(vertices[i]);
+				boundsMin = glm::min(boundsMin, vertices[i].pos);
+				boundsMax = glm::max(boundsMax, vertices[i].pos);
 			}
 
+			meshes[i].center = (boundsMin + boundsMax) * 0.5f;
+			meshes[i].radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
 			// Indices
 			std::vector<uint32_t> indices;
 			meshes[i].indexCount = aMesh->mNumFaces * 3;
@@ -551,6 +685,14 @@ private:
 		size_t vertexDataSize = gVertices.size() * sizeof(Vertex);
 		size_t indexDataSize = gIndices.size() * sizeof(uint32_t);
 
+		// Position only copy of the vertices for the depth pre-pass, uses the same indices
+		std::vector<glm::vec3> gPositions(gVertices.size());
+		for (size_t i = 0; i < gVertices.size(); i++)
+		{
+			gPositions[i] = gVertices[i].pos;
+		}
+		size_t positionDataSize = gPositions.size() * sizeof(glm::vec3);
+
 		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 
@@ -567,6 +709,10 @@ private:
 				VkDeviceMemory memory;
 				VkBuffer buffer;
 			} iBuffer;
+			struct {
+				VkDeviceMemory memory;
+				VkBuffer buffer;
+			} pBuffer;
 		} staging;
 
 		// Generate vertex buffer
@@ -593,6 +739,30 @@ private:
 		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &vertexBuffer.memory));
 		VK_CHECK_RESULT(vkBindBufferMemory(device, vertexBuffer.buffer, vertexBuffer.memory, 0));
 
+		// Generate position buffer
+		VkBufferCreateInfo pBufferInfo;
+
+		// Staging buffer
+		pBufferInfo = vkTools::initializers::bufferCreateInfo(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, positionDataSize);
+		VK_CHECK_RESULT(vkCreateBuffer(device, &pBufferInfo, nullptr, &staging.pBuffer.buffer));
+		vkGetBufferMemoryRequirements(device, staging.pBuffer.buffer, &memReqs);
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = getMemTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &staging.pBuffer.memory));
+		VK_CHECK_RESULT(vkMapMemory(device, staging.pBuffer.memory, 0, VK_WHOLE_SIZE, 0, &data));
+		memcpy(data, gPositions.data(), positionDataSize);
+		vkUnmapMemory(device, staging.pBuffer.memory);
+		VK_CHECK_RESULT(vkBindBufferMemory(device, staging.pBuffer.buffer, staging.pBuffer.memory, 0));
+
+		// Target
+		pBufferInfo = vkTools::initializers::bufferCreateInfo(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, positionDataSize);
+		VK_CHECK_RESULT(vkCreateBuffer(device, &pBufferInfo, nullptr, &positionBuffer.buffer));
+		vkGetBufferMemoryRequirements(device, positionBuffer.buffer, &memReqs);
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = getMemTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &positionBuffer.memory));
+		VK_CHECK_RESULT(vkBindBufferMemory(device, positionBuffer.buffer, positionBuffer.memory, 0));
+
 		// Generate index buffer
 		VkBufferCreateInfo iBufferInfo;
 
@@ -639,6 +809,14 @@ private:
 			1,
 			&copyRegion);
 
+		copyRegion.size = positionDataSize;
+		vkCmdCopyBuffer(
+			copyCmd,
+			staging.pBuffer.buffer,
+			positionBuffer.buffer,
+			1,
+			&copyRegion);
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(copyCmd));
 
 		VkSubmitInfo submitInfo = {};
@@ -653,100 +831,57 @@ private:
 		vkFreeMemory(device, staging.vBuffer.memory, nullptr);
 		vkDestroyBuffer(device, staging.iBuffer.buffer, nullptr);
 		vkFreeMemory(device, staging.iBuffer.memory, nullptr);
+		vkDestroyBuffer(device, staging.pBuffer.buffer, nullptr);
+		vkFreeMemory(device, staging.pBuffer.memory, nullptr);
 
-		// Generate descriptor sets for all meshes
-		// todo : think about a nicer solution, better suited per material?
+		// Generate descriptor sets for all materials, shared by all meshes using the same material
+		// These only contain the material's textures, per-frame and per-pass data is bound in separate sets
 
 		// Decriptor pool
 		std::vector<VkDescriptorPoolSize> poolSizes;
-		poolSizes.push_back(vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, meshes.size()));
-		poolSizes.push_back(vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, meshes.size() * 3));
+		poolSizes.push_back(vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, materials.size() * 3));
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vkTools::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				meshes.size());
+				materials.size());
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
-		// Shared descriptor set layout
-		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
-		// Binding 0: UBO
-		setLayoutBindings.push_back(vkTools::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			VK_SHADER_STAGE_VERTEX_BIT,
-			0));
-		// Binding 1: Diffuse map
-		setLayoutBindings.push_back(vkTools::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			VK_SHADER_STAGE_FRAGMENT_BIT,
-			1));
-		// Binding 2: Specular map
-		setLayoutBindings.push_back(vkTools::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			VK_SHADER_STAGE_FRAGMENT_BIT,
-			2));
-		// Binding 3: Bump map
-		setLayoutBindings.push_back(vkTools::initializers::descriptorSetLayoutBinding(
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			VK_SHADER_STAGE_FRAGMENT_BIT,
-			3));
-
-		VkDescriptorSetLayoutCreateInfo descriptorLayout =
-			vkTools::initializers::descriptorSetLayoutCreateInfo(
-				setLayoutBindings.data(),
-				setLayoutBindings.size());
-
-		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
-
-		VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-			vkTools::initializers::pipelineLayoutCreateInfo(
-				&descriptorSetLayout,
-				1);
-
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayout));
-
 		// Descriptor sets
-		for (uint32_t i = 0; i < meshes.size(); i++)
+		for (uint32_t i = 0; i < materials.size(); i++)
 		{
 			// Descriptor set
 			VkDescriptorSetAllocateInfo allocInfo =
 				vkTools::initializers::descriptorSetAllocateInfo(
 					descriptorPool,
-					&descriptorSetLayout,
+					&materialSetLayout,
 					1);
 
-			// Background
-			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &meshes[i].descriptorSet));
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &materials[i].descriptorSet));
 
 			std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 
-			// Binding 0 : Vertex shader uniform buffer
-			writeDescriptorSets.push_back(vkTools::initializers::writeDescriptorSet(
-				meshes[i].descriptorSet,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				0,
-				&defaultUBO->descriptor));
 			// Image bindings
 			// Binding 0: Color map
 			writeDescriptorSets.push_back(vkTools::initializers::writeDescriptorSet(
-				meshes[i].descriptorSet,
+				materials[i].descriptorSet,
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				1,
-				&meshes[i].material->diffuse.descriptor));
+				0,
+				&materials[i].diffuse.descriptor));
 			// Binding 1: Specular
 			writeDescriptorSets.push_back(vkTools::initializers::writeDescriptorSet(
-				meshes[i].descriptorSet,
+				materials[i].descriptorSet,
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				2,
-				&meshes[i].material->specular.descriptor));
+				1,
+				&materials[i].specular.descriptor));
 			// Binding 2: Normal
 			writeDescriptorSets.push_back(vkTools::initializers::writeDescriptorSet(
-				meshes[i].descriptorSet,
+				materials[i].descriptorSet,
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				3,
-				&meshes[i].material->bump.descriptor));
+				2,
+				&materials[i].bump.descriptor));
 
 			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 		}
@@ -762,19 +897,20 @@ public:
 	std::vector<SceneMaterial> materials;
 	std::vector<SceneMesh> meshes;
 
+	// Descriptors of all unique textures used by the scene's materials
+	std::vector<VkDescriptorImageInfo> textureDescriptors;
+
 	vk::Buffer vertexBuffer;
 	vk::Buffer indexBuffer;
+	// Vertex positions only, for the depth pre-pass
+	vk::Buffer positionBuffer;
 
-	// Same for all meshes in the scene
-	VkDescriptorSetLayout descriptorSetLayout;
-	VkPipelineLayout pipelineLayout;
-
-	Scene(VkDevice device, VkQueue queue, vkTools::VulkanTextureLoader *textureloader, vk::Buffer *defaultUBO)
+	Scene(VkDevice device, VkQueue queue, vkTools::VulkanTextureLoader *textureloader, VkDescriptorSetLayout materialSetLayout)
 	{
 		this->device = device;
 		this->queue = queue;
 		this->textureLoader = textureloader;
-		this->defaultUBO = defaultUBO;
+		this->materialSetLayout = materialSetLayout;
 	}
 
 	~Scene()
@@ -786,8 +922,11 @@ public:
 			vkDestroyBuffer(device, mesh.indexBuffer, nullptr);
 			vkFreeMemory(device, mesh.indexMemory, nullptr);
 		}
-		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		for (auto buffer : { &vertexBuffer, &indexBuffer, &positionBuffer })
+		{
+			vkDestroyBuffer(device, buffer->buffer, nullptr);
+			vkFreeMemory(device, buffer->memory, nullptr);
+		}
 		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 	}
 
@@ -833,6 +972,83 @@ public:
 	bool debugDisplay = false;
 	bool attachLight = false;
 	bool enableSSAO = true;
+	bool enablePVS = true;
+	// Bindless G-Buffer path: all scene textures in one descriptor array, materials select theirs via push constants
+	bool bindlessSupported = false;
+	bool enableBindless = false;
+	// Full screen: every pixel loops over all lights in the composition
+	// Tiled: lights are culled per screen tile and applied in a compute pass
+	// Clustered: lights are assigned to view space clusters in a compute pass, the composition only applies the lights of the pixel's cluster
+	// Light volumes: each light's bounding volume is rasterized, pixels inside of it are marked in the stencil buffer and shaded with additive blending
+	enum LightingMode { LIGHTING_FULLSCREEN = 0, LIGHTING_TILED = 1, LIGHTING_CLUSTERED = 2, LIGHTING_VOLUMES = 3, LIGHTING_MODE_COUNT = 4 };
+	// Tiled and clustered lighting require compute support
+	bool computeLightingSupported = false;
+	LightingMode lightingMode = LIGHTING_FULLSCREEN;
+	// High: ambient occlusion is generated and blurred at full resolution
+	// Low: generated at half resolution from a downsampled depth and normal buffer, the bilateral blur upsamples it to full resolution
+	enum SSAOQuality { SSAO_QUALITY_LOW = 0, SSAO_QUALITY_HIGH = 1, SSAO_QUALITY_COUNT = 2 };
+#if defined(__ANDROID__)
+	SSAOQuality ssaoQuality = SSAO_QUALITY_LOW;
+#else
+	SSAOQuality ssaoQuality = SSAO_QUALITY_HIGH;
+#endif
+	// Last measured GPU time of the SSAO passes per quality tier in ms, 0 if not measured yet
+	std::array<double, SSAO_QUALITY_COUNT> ssaoGpuTimes = {};
+	// Hemisphere: kernel samples in a hemisphere around the normal, each projected to screen space and compared against the depth there
+	// Horizon: compute pass searching the highest horizon along a few screen space directions (slices) in a linear depth mip chain
+	// The horizon presets trade the number of slices and steps per slice for speed
+	enum SSAOMethod { SSAO_METHOD_HEMISPHERE = 0, SSAO_METHOD_HORIZON_LOW = 1, SSAO_METHOD_HORIZON_MEDIUM = 2, SSAO_METHOD_HORIZON_HIGH = 3, SSAO_METHOD_COUNT = 4 };
+	SSAOMethod ssaoMethod = SSAO_METHOD_HEMISPHERE;
+	struct SSAOMethodDesc {
+		std::string name;
+		// Horizon methods only
+		std::string pipeline;
+		uint32_t sliceCount;
+		uint32_t stepCount;
+	};
+	const std::array<SSAOMethodDesc, SSAO_METHOD_COUNT> ssaoMethods = {{
+		{ "hemisphere", "", 0, 0 },
+		{ "horizon low", "ssao.horizon.low", 2, 3 },
+		{ "horizon medium", "ssao.horizon.medium", 3, 4 },
+		{ "horizon high", "ssao.horizon.high", 4, 6 },
+	}};
+	// Last measured GPU time of the occlusion generation (including the depth downsample and mip chain) per method and quality tier in ms
+	std::array<std::array<double, SSAO_QUALITY_COUNT>, SSAO_METHOD_COUNT> ssaoGenerateGpuTimes = {};
+	// SSAO blur and horizon based AO in compute passes, the blur shares the samples of a tile in shared memory instead of using full screen render passes
+	// Requires compute support and storage image support for the single channel SSAO format
+	bool ssaoComputeSupported = false;
+	bool ssaoComputeBlur = false;
+	// Temporal SSAO: fewer samples per frame, accumulated over frames by reprojecting the last frame's result
+	bool ssaoTemporal = false;
+	// Rotates the kernel subset and noise of the temporal SSAO
+	uint32_t ssaoFrameIndex = 0;
+	// History has been written with the current SSAO settings
+	bool ssaoHistoryValid = false;
+	// View projection of the last rendered frame, for reprojecting the SSAO history
+	glm::mat4 previousViewProjection;
+
+	// Dynamic resolution: the G-Buffer and all targets derived from it are allocated at full size, but only their
+	// upper left part scaled by the render scale is rendered, the composition upscales it to the screen
+	// The scale is adjusted based on the GPU timestamps to hold a target frame time
+	struct {
+		bool enabled = false;
+		float targetFrameTime = DYNAMIC_RESOLUTION_TARGET_FRAME_TIME;
+		float scale = 1.0f;
+		uint32_t framesSinceChange = 0;
+	} dynamicResolution;
+	// Rendered part of the G-Buffer, passed to the shaders
+	glm::vec2 renderScale = glm::vec2(1.0f);
+	// Merged G-Buffer pass: G-Buffer and composition are rendered as two subpasses of a single render pass, the composition
+	// reads the G-Buffer values of its own pixel from input attachments, so they can stay in tile memory and are never stored
+	// Only used with full screen and clustered lighting without SSAO and debug display, as these need to sample neighbouring pixels
+	bool enableMergedPass = false;
+	// Depth pre-pass: opaque geometry is first rendered depth only from a position only vertex stream, the G-Buffer pass
+	// then tests for equal depth without writing it, so every pixel's material is shaded only once
+	// Alpha masked geometry is not part of the pre-pass, it's depth tested and written as usual in the G-Buffer pass
+	// Not used with the merged G-Buffer pass
+	bool enableDepthPrepass = false;
+	// Top level GPU profiler scopes, their sum is the frame's GPU time
+	const std::array<const char*, 6> gpuFrameScopes = {{ "Clusters", "Depth prepass", "G-Buffer", "SSAO", "Lighting", "Composition" }};
 
 	// Vendor specific
 	bool enableNVDedicatedAllocation = false;
@@ -844,7 +1060,8 @@ public:
 
 	struct {
 		vkMeshLoader::MeshBuffer quad;
-		vkMeshLoader::MeshBuffer skysphere;
+		// Unit icosphere enclosing the unit sphere, positions only
+		vkMeshLoader::MeshBuffer lightVolume;
 	} meshes;
 
 	struct {
@@ -852,45 +1069,113 @@ public:
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
 	} vertices;
+	// Fullscreen passes generate their vertices in the shader
+	VkPipelineVertexInputStateCreateInfo emptyInputState;
+	// Light volumes only use positions
+	struct {
+		VkPipelineVertexInputStateCreateInfo inputState;
+		VkVertexInputBindingDescription bindingDescription;
+		VkVertexInputAttributeDescription attributeDescription;
+	} lightVolumeVertices;
+	// Depth pre-pass reads the scene's separate position stream, or the positions of the interleaved per-mesh vertices
+	struct {
+		VkPipelineVertexInputStateCreateInfo inputState;
+		VkVertexInputBindingDescription bindingDescription;
+		VkVertexInputAttributeDescription attributeDescription;
+	} positionVertices;
 
 	struct {
 		glm::mat4 projection;
 		glm::mat4 model;
 		glm::mat4 view;
 		glm::vec2 viewportDim;
+		glm::vec2 renderScale;
 	} uboVS, uboSceneMatrices;
 
 	struct UBOSSAOParams {
 		glm::mat4 projection;
+		// Positions are reconstructed from the G-Buffer depth
+		glm::mat4 invProjection;
+		glm::vec2 renderScale;
 		uint32_t ssao = true;
 		uint32_t ssaoOnly = false;
 		uint32_t ssaoBlur = true;
 	} uboSSAOParams;
 
-	struct Light {
-		glm::vec4 position;
-		glm::vec4 color;
-		float radius;
-		float quadraticFalloff;
-		float linearFalloff;
-		float _pad;
+	// Updated each frame for the temporal SSAO
+	struct UBOSSAOTemporal {
+		// Current view space to the last frame's clip space
+		glm::mat4 reprojection;
+		uint32_t frameIndex = 0;
+		uint32_t historyValid = false;
+	} uboSSAOTemporal;
+
+	// World space lights, the fixed scene lights are followed by random ones used for performance measurements
+	LightManager lightManager;
+	uint32_t sceneLightCount = 0;
+	// Number of random lights added to the scene lights
+	uint32_t extraLightCount = 0;
+
+	// Light storage buffer contents (std430), the header is followed by the LightData array written by the light manager
+	// Positions are transformed to view space once per frame on the CPU instead of per pixel
+	struct LightBufferHeader {
+		uint32_t count;
+		uint32_t _pad[3];
 	};
 
+	// Shared by the tiled and clustered lighting passes and the composition
 	struct {
-		Light lights[17];
-		glm::vec4 viewPos;
-		glm::mat4 view;
-		glm::mat4 model;
-	} uboFragmentLights;
+		glm::mat4 invProjection;
+		float zNear;
+		float zFar;
+		glm::vec2 renderScale;
+		// Rotates view space directions to world space for the sky lookup
+		glm::mat4 invView;
+	} uboLightCulling;
 
 	struct {
 		vk::Buffer fullScreen;
 		vk::Buffer sceneMatrices;
-		vk::Buffer sceneLights;
 		vk::Buffer ssaoKernel;
 		vk::Buffer ssaoParams;
+		vk::Buffer ssaoTemporal;
+		vk::Buffer lightCulling;
 	} uniformBuffers;
 
+	// Per-draw data passed as push constants, indexes into the per-pass storage buffers
+	struct DrawData {
+		uint32_t instance;
+		uint32_t material;
+	};
+
+	// Cluster storage buffer contents (std430), filled by the cluster assignment compute pass
+	struct ClusterData {
+		uint32_t lightCount;
+		uint32_t lightIndices[CLUSTER_MAX_LIGHTS];
+	};
+
+	// Storage buffer contents (std430)
+	struct MaterialData {
+		uint32_t diffuse;
+		uint32_t specular;
+		uint32_t bump;
+		uint32_t flags;
+	};
+
+	struct InstanceData {
+		glm::mat4 model;
+		glm::mat4 normal;
+	};
+
+	struct {
+		vk::Buffer materials;
+		vk::Buffer instances;
+		// Host visible, written every frame
+		vk::Buffer lights;
+		// Light lists per cluster, device local
+		vk::Buffer clusters;
+	} storageBuffers;
+
 	// Framebuffer for offscreen rendering
 	struct FrameBufferAttachment {
 		VkImage image;
@@ -908,7 +1193,8 @@ public:
 		int32_t width, height;
 		VkFramebuffer frameBuffer;
 		FrameBufferAttachment depth;
-		VkRenderPass renderPass;
+		// Doesn't depend on the size, kept when the frame buffer is recreated
+		VkRenderPass renderPass = VK_NULL_HANDLE;
 		void setSize(int32_t w, int32_t h)
 		{
 			this->width = w;
@@ -924,23 +1210,168 @@ public:
 
 	struct {
 		struct Offscreen : public FrameBuffer {
-			std::array<FrameBufferAttachment, 3> attachments;
+			std::array<FrameBufferAttachment, 2> attachments;
+			// Depth aspect of the depth attachment, sampled for reconstructing positions
+			VkImageView depthView;
+			// Compatible with the render pass, but loads the depth written by the depth pre-pass instead of clearing it
+			VkRenderPass depthLoadRenderPass = VK_NULL_HANDLE;
 		} offscreen;
 		struct SSAO : public FrameBuffer {
 			std::array<FrameBufferAttachment, 1 > attachments;
-		} ssao, ssaoBlur;
+		} ssao, ssaoBlur, ssaoBlurTemp, ssaoHalf, ssaoHalfBlurTemp, ssaoResolve, ssaoHalfResolve;
+		// Half resolution depth (attachment 0) and normals (attachment 1) for the low quality SSAO
+		struct SSAODownsample : public FrameBuffer {
+			std::array<FrameBufferAttachment, 2> attachments;
+		} ssaoDownsample;
+		// Renders into the lighting target, using the G-Buffer's depth and stencil
+		FrameBuffer lightVolumes;
+		// Depth only pre-pass into the G-Buffer's depth attachment
+		FrameBuffer depthPrepass;
 	} frameBuffers;
+
+	// Written by the tiled lighting compute pass or the light volumes, sampled by the composition
+	FrameBufferAttachment lightingTarget;
+	// Temporal SSAO result of the last frame, copied from the resolve targets
+	FrameBufferAttachment ssaoHistory, ssaoHalfHistory;
+	// The SSAO targets rewritten each frame are bound to slots of a single allocation, targets in the same slot are never needed at the same time
+	// Occlusion: raw occlusion of both quality tiers and the blurred result, the raw occlusion is consumed by the temporal resolve or the horizontal blur before the vertical blur writes the result
+	// Blur temp and resolve: only one quality tier is used per frame
+	enum SSAOMemorySlot { SSAO_MEMORY_OCCLUSION = 0, SSAO_MEMORY_BLUR_TEMP = 1, SSAO_MEMORY_RESOLVE = 2, SSAO_MEMORY_SLOT_COUNT = 3 };
+	VkDeviceMemory ssaoMemory = VK_NULL_HANDLE;
+	// Merged G-Buffer and composition pass, renders into the swap chain images
+	// G-Buffer attachments are transient, they are cleared on load and never stored
+	// The render pass always exists for the pipelines, the attachments and frame buffers only while the merged pass is enabled
+	struct {
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		// One per swap chain image
+		std::vector<VkFramebuffer> frameBuffers;
+		// Normals and albedo
+		std::array<FrameBufferAttachment, 2> attachments = {};
+		FrameBufferAttachment depth = {};
+		// Transient attachments are backed by lazily allocated memory, if the device offers it
+		bool lazilyAllocated = false;
+	} mergedPass;
+	// Linear depth of the G-Buffer with a mip chain, read by the horizon based AO
+	// Stays in the general layout, each level is written as a storage image and sampled by the next level
+	struct DepthMipChain {
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory mem;
+		// All levels
+		VkImageView view;
+		std::array<VkImageView, SSAO_DEPTH_MIP_LEVELS> levelViews;
+		uint32_t width, height;
+		void destroy(VkDevice device)
+		{
+			if (image == VK_NULL_HANDLE)
+			{
+				return;
+			}
+			for (auto& levelView : levelViews)
+			{
+				vkDestroyImageView(device, levelView, nullptr);
+			}
+			vkDestroyImageView(device, view, nullptr);
+			vkDestroyImage(device, image, nullptr);
+			vkFreeMemory(device, mem, nullptr);
+		}
+	} ssaoDepthMips;
 	
 	// One sampler for the frame buffer color attachments
-	VkSampler colorSampler;
+	VkSampler colorSampler = VK_NULL_HANDLE;
 	VkSampler particleSampler;
 
 	VkCommandBuffer offScreenCmdBuffer = VK_NULL_HANDLE;
 
-	// Semaphore used to synchronize between offscreen and final scene rendering
-	VkSemaphore offscreenSemaphore = VK_NULL_HANDLE;
+	// Offscreen and swap chain command buffers of previously used render modes, by render mode key
+	// Switching back to one of them doesn't record anything, they are freed once anything else changes the recorded commands
+	struct CommandBufferVariant {
+		VkCommandBuffer offscreen;
+		std::vector<VkCommandBuffer> draw;
+		// Frame the variant was replaced in
+		uint64_t lastUsed;
+	};
+	std::unordered_map<uint64_t, CommandBufferVariant> commandBufferVariants;
+	struct {
+		// CPU time of the last render mode switch in ms
+		double switchTime = 0.0;
+		bool cached = false;
+		// Longest frame of the last second in ms, a switch that records command buffers shows up here
+		float maxFrameTime = 0.0f;
+		float windowMaxFrameTime = 0.0f;
+		float windowTime = 0.0f;
+	} modeSwitchStats;
+
+	// Bytes per pixel of all G-Buffer attachments including depth
+	uint32_t gBufferPixelSize = 0;
+
+	// Sorted draws for the G-Buffer and composition passes
+	RenderQueue sceneQueue;
+	RenderQueue compositionQueue;
+	// Depth only draws of the opaque meshes for the depth pre-pass
+	RenderQueue depthPrepassQueue;
+	// Camera position the G-Buffer draws were last sorted for
+	glm::vec3 sortPosition;
+	// Back to front order of the particle systems the composition command buffers were recorded with
+	std::vector<uint32_t> particleDrawOrder;
+
+	// Baked potentially visible sets for the static scene meshes
+	PotentiallyVisibleSet pvs;
+	// Cell the camera is currently in (-1 = outside of baked volume)
+	int32_t pvsCell = -1;
+	uint32_t pvsVisibleMeshes = 0;
+
+	// Creates all pipelines at startup and compiles variants in the background afterwards
+	PipelineCompiler *pipelineCompiler = nullptr;
+	// Latest background compilation per pipeline name, older results are discarded
+	std::unordered_map<std::string, uint64_t> pipelineRequests;
+	bool pipelinesPending = false;
+	// Render modes selected by the user, applied once all pipelines they use have been compiled
+	struct {
+		bool debugDisplay = false;
+		bool enableSSAO = true;
+		SSAOQuality ssaoQuality = SSAO_QUALITY_HIGH;
+		SSAOMethod ssaoMethod = SSAO_METHOD_HEMISPHERE;
+		bool ssaoComputeBlur = false;
+		bool ssaoTemporal = false;
+		bool enableBindless = false;
+		LightingMode lightingMode = LIGHTING_FULLSCREEN;
+		bool enableMergedPass = false;
+		bool enableDepthPrepass = false;
+	} requestedModes;
+	// Baked into the composition pipelines, changing it recompiles them in the background
+	float ambientFactor = 0.15f;
+	// Time spent creating all pipelines of the example, depends on the state of the pipeline cache
+	double pipelineCreationTime = 0.0;
+	uint32_t pipelineThreadCount = 0;
+	// Names and creation times of the slowest pipelines, "-pipelinetimes" prints the time of each one
+	std::vector<std::pair<std::string, double>> slowestPipelines;
+	bool printPipelineTimes = false;
+
+	// GPU times of the passes
+	vk::GpuProfiler *gpuProfiler = nullptr;
+	// Resources replaced between frames, e.g. the frame buffer attachments on resize
+	// Frames don't overlap (submitFrame waits for the queue), so they are destroyed after the next frame
+	vk::DeletionQueue deletionQueue;
+	// Number of frames rendered so far, the base class' frameCounter is reset every second for the fps display
+	uint64_t frameIndex = 0;
+	// Passes of the offscreen command buffer for the current render modes
+	RenderGraph renderGraph;
+
+	// Device features requested by this example, unsupported ones are not enabled by the device
+	static VkPhysicalDeviceFeatures getEnabledFeatures()
+	{
+		VkPhysicalDeviceFeatures enabledFeatures = {};
+		enabledFeatures.samplerAnisotropy = VK_TRUE;
+		// Required for indexing the bindless texture array with push constant material indices
+		enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		// Required for writing the single channel SSAO targets as storage images
+		enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+		// Fragment shader invocations of the G-Buffer pass are counted to measure its overdraw
+		enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+		return enabledFeatures;
+	}
 
-	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
+	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION, getEnabledFeatures)
 	{
 #if !defined(__ANDROID__)
 		width = 1920;
@@ -964,10 +1395,82 @@ public:
 
 		enableNVDedicatedAllocation = vulkanDevice->extensionSupported(VK_NV_DEDICATED_ALLOCATION_EXTENSION_NAME);
 		enableAMDRasterizationOrder = vulkanDevice->extensionSupported(VK_AMD_RASTERIZATION_ORDER_EXTENSION_NAME);
+
+		// The bindless path uses a fixed size texture array that needs to fit into the per-stage limits
+		const VkPhysicalDeviceLimits &limits = vulkanDevice->properties.limits;
+		bindlessSupported =
+			vulkanDevice->enabledFeatures.shaderSampledImageArrayDynamicIndexing &&
+			(limits.maxPerStageDescriptorSamplers >= BINDLESS_TEXTURE_COUNT) &&
+			(limits.maxPerStageDescriptorSampledImages >= BINDLESS_TEXTURE_COUNT) &&
+			(limits.maxDescriptorSetSamplers >= BINDLESS_TEXTURE_COUNT) &&
+			(limits.maxDescriptorSetSampledImages >= BINDLESS_TEXTURE_COUNT);
+		for (auto arg : args)
+		{
+			if (arg == std::string("-bindless"))
+			{
+				enableBindless = true;
+			}
+			if (arg == std::string("-mergedpass"))
+			{
+				enableMergedPass = true;
+			}
+			if (arg == std::string("-depthprepass"))
+			{
+				enableDepthPrepass = true;
+			}
+			if (arg == std::string("-pipelinetimes"))
+			{
+				printPipelineTimes = true;
+			}
+		}
+		requestedModes.enableMergedPass = enableMergedPass;
+		requestedModes.enableDepthPrepass = enableDepthPrepass;
+		if (enableBindless && !bindlessSupported)
+		{
+			std::cout << "Bindless textures not supported by the device, using per-material descriptor sets" << std::endl;
+			enableBindless = false;
+		}
+		requestedModes.enableBindless = enableBindless;
+
+		// Light culling passes are dispatched on the graphics queue
+		const VkQueueFamilyProperties &queueFamily = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics];
+		computeLightingSupported = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+		lightingMode = computeLightingSupported ? LIGHTING_CLUSTERED : LIGHTING_FULLSCREEN;
+		requestedModes.lightingMode = lightingMode;
+
+		VkFormatProperties ssaoFormatProps;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8_UNORM, &ssaoFormatProps);
+		ssaoComputeSupported = computeLightingSupported && vulkanDevice->enabledFeatures.shaderStorageImageExtendedFormats && (ssaoFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+		ssaoComputeBlur = ssaoComputeSupported;
+		requestedModes.ssaoComputeBlur = ssaoComputeBlur;
+
+		// Stress test: "-lights N" adds N random lights to the scene lights
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if ((args[i] == std::string("-lights")) && (i + 1 < args.size()))
+			{
+				extraLightCount = static_cast<uint32_t>(std::max(atoi(args[i + 1]), 0));
+			}
+			// "-ssaoquality low" generates ambient occlusion at half resolution, "-ssaoquality high" at full resolution
+			if ((args[i] == std::string("-ssaoquality")) && (i + 1 < args.size()))
+			{
+				ssaoQuality = (args[i + 1] == std::string("low")) ? SSAO_QUALITY_LOW : SSAO_QUALITY_HIGH;
+			}
+			// "-targetframetime ms" enables dynamic resolution with the given GPU frame time
+			if ((args[i] == std::string("-targetframetime")) && (i + 1 < args.size()))
+			{
+				dynamicResolution.enabled = true;
+				dynamicResolution.targetFrameTime = std::max((float)atof(args[i + 1]), 0.1f);
+			}
+		}
+		requestedModes.ssaoQuality = ssaoQuality;
 	}
 
 	~VulkanExample()
 	{
+		// Waits for background compilations
+		delete pipelineCompiler;
+		delete gpuProfiler;
 		delete resources.pipelineLayouts;
 		delete resources.pipelines;
 		delete resources.descriptorSetLayouts;
@@ -978,35 +1481,40 @@ public:
 		vkDestroySampler(device, colorSampler, nullptr);
 		vkDestroySampler(device, particleSampler, nullptr);
 
-		// Frame buffer attachments
-		for (auto attachment : frameBuffers.offscreen.attachments)
+		// Frame buffers and their attachments, including the ones replaced on resize
+		retireOffscreenTargets();
+		deletionQueue.flush();
+
+		// Render passes
+		for (auto frameBuffer : { &frameBuffers.ssao, &frameBuffers.ssaoBlur, &frameBuffers.ssaoBlurTemp, &frameBuffers.ssaoHalf, &frameBuffers.ssaoHalfBlurTemp, &frameBuffers.ssaoResolve, &frameBuffers.ssaoHalfResolve })
 		{
-			vkDestroyImageView(device, attachment.view, nullptr);
-			vkDestroyImage(device, attachment.image, nullptr);
-			vkFreeMemory(device, attachment.mem, nullptr);
+			vkDestroyRenderPass(device, frameBuffer->renderPass, nullptr);
 		}
-
-		// Depth attachment
-		vkDestroyImageView(device, frameBuffers.offscreen.depth.view, nullptr);
-		vkDestroyImage(device, frameBuffers.offscreen.depth.image, nullptr);
-		vkFreeMemory(device, frameBuffers.offscreen.depth.mem, nullptr);
-
-		vkDestroyFramebuffer(device, frameBuffers.offscreen.frameBuffer, nullptr);
+		vkDestroyRenderPass(device, frameBuffers.ssaoDownsample.renderPass, nullptr);
+		vkDestroyRenderPass(device, frameBuffers.lightVolumes.renderPass, nullptr);
+		vkDestroyRenderPass(device, frameBuffers.depthPrepass.renderPass, nullptr);
+		vkDestroyRenderPass(device, mergedPass.renderPass, nullptr);
 
 		// Meshes
 		vkMeshLoader::freeMeshBufferResources(device, &meshes.quad);
-		vkMeshLoader::freeMeshBufferResources(device, &meshes.skysphere);
+		vkMeshLoader::freeMeshBufferResources(device, &meshes.lightVolume);
 
 		// Uniform buffers
 		uniformBuffers.fullScreen.destroy();
 		uniformBuffers.sceneMatrices.destroy();
-		uniformBuffers.sceneLights.destroy();
-
+		uniformBuffers.lightCulling.destroy();
+		uniformBuffers.ssaoTemporal.destroy();
+		storageBuffers.materials.destroy();
+		storageBuffers.instances.destroy();
+		storageBuffers.lights.destroy();
+		storageBuffers.clusters.destroy();
+
+		clearCommandBufferVariants();
 		vkFreeCommandBuffers(device, cmdPool, 1, &offScreenCmdBuffer);
 
 		vkDestroyRenderPass(device, frameBuffers.offscreen.renderPass, nullptr);
+		vkDestroyRenderPass(device, frameBuffers.offscreen.depthLoadRenderPass, nullptr);
 
-		vkDestroySemaphore(device, offscreenSemaphore, nullptr);
 
 		delete(scene);
 	}
@@ -1015,8 +1523,8 @@ public:
 	{
 		resources.textures->addTextureArray("particle.fire", getAssetPath() + "textures/particle_fire.ktx", VK_FORMAT_BC3_UNORM_BLOCK);
 		resources.textures->addTexture2D("particle.smoke", getAssetPath() + "textures/particle_smoke.ktx", VK_FORMAT_BC3_UNORM_BLOCK);
+		// The sky isn't rendered as geometry, the composition samples it along the view ray of the pixels without depth
 		resources.textures->addTexture2D("skysphere", getAssetPath() + "textures/skysphere_night.ktx", VK_FORMAT_R8G8B8A8_UNORM);
-		loadMesh(getAssetPath() + "skysphere.dae", &meshes.skysphere, vertexLayout, 1.0f);
 
 		// Create a custom sampler to be used with the particle textures
 		VkSamplerCreateInfo samplerCreateInfo = vkTools::initializers::samplerCreateInfo();
@@ -1036,14 +1544,37 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &samplerCreateInfo, nullptr, &particleSampler));
 	}
 
+	// Size of a texel of the formats used for the G-Buffer attachments
+	// Depth/stencil formats are counted without padding, implementations may store them with more bytes
+	uint32_t getFormatSize(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+			return 4;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+			return 3;
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return 5;
+		default:
+			assert(false);
+			return 0;
+		}
+	}
+
 	// Create a frame buffer attachment
-	void createAttachment(
+	// Transient attachments are not sampled and use lazily allocated memory if available, returns true if they do
+	// Aliased attachments are created without memory and view, see createAliasedAttachments
+	bool createAttachment(
 		VkFormat format,
-		VkImageUsageFlagBits usage,
+		VkImageUsageFlags usage,
 		FrameBufferAttachment *attachment,
 		VkCommandBuffer layoutCmd,
 		uint32_t width,
-		uint32_t height)
+		uint32_t height,
+		bool aliased = false)
 	{
 		VkImageAspectFlags aspectMask = 0;
 		VkImageLayout imageLayout;
@@ -1057,9 +1588,19 @@ public:
 		}
 		if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
 		{
-			aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+			aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+			// Formats with a stencil component
+			if (format >= VK_FORMAT_D16_UNORM_S8_UINT)
+			{
+				aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+			}
 			imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 		}
+		if (usage & VK_IMAGE_USAGE_STORAGE_BIT)
+		{
+			aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
 
 		assert(aspectMask > 0);
 
@@ -1073,21 +1614,40 @@ public:
 		image.arrayLayers = 1;
 		image.samples = VK_SAMPLE_COUNT_1_BIT;
 		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
+		const bool transient = (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+		// Only color, depth/stencil and input attachment usage may be combined with the transient usage
+		image.usage = transient ? usage : (usage | VK_IMAGE_USAGE_SAMPLED_BIT);
 
 		VkDedicatedAllocationImageCreateInfoNV dedicatedImageInfo{ VK_STRUCTURE_TYPE_DEDICATED_ALLOCATION_IMAGE_CREATE_INFO_NV };
-		if (enableNVDedicatedAllocation)
+		if (enableNVDedicatedAllocation && !aliased)
 		{
 			dedicatedImageInfo.dedicatedAllocation = VK_TRUE;
 			image.pNext = &dedicatedImageInfo;
 		}
 		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment->image));
 
+		if (aliased)
+		{
+			attachment->mem = VK_NULL_HANDLE;
+			attachment->view = VK_NULL_HANDLE;
+			return false;
+		}
+
 		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs;
 		vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
 		memAlloc.memoryTypeIndex = getMemTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VkBool32 lazilyAllocated = VK_FALSE;
+		if (transient)
+		{
+			// Tile based GPUs don't need to back attachments that never leave tile memory with physical memory
+			uint32_t memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazilyAllocated);
+			if (lazilyAllocated)
+			{
+				memAlloc.memoryTypeIndex = memoryTypeIndex;
+			}
+		}
 
 		VkDedicatedAllocationMemoryAllocateInfoNV dedicatedAllocationInfo{ VK_STRUCTURE_TYPE_DEDICATED_ALLOCATION_MEMORY_ALLOCATE_INFO_NV };
 		if (enableNVDedicatedAllocation)
@@ -1099,9 +1659,16 @@ public:
 		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
 		VK_CHECK_RESULT(vkBindImageMemory(device, attachment->image, attachment->mem, 0));
 
+		createAttachmentView(attachment, aspectMask);
+
+		return lazilyAllocated == VK_TRUE;
+	}
+
+	void createAttachmentView(FrameBufferAttachment *attachment, VkImageAspectFlags aspectMask)
+	{
 		VkImageViewCreateInfo imageView = vkTools::initializers::imageViewCreateInfo();
 		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageView.format = format;
+		imageView.format = attachment->format;
 		imageView.subresourceRange = {};
 		imageView.subresourceRange.aspectMask = aspectMask;
 		imageView.subresourceRange.baseMipLevel = 0;
@@ -1112,56 +1679,294 @@ public:
 		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
 	}
 
+	struct AliasedAttachment {
+		FrameBufferAttachment *attachment;
+		VkFormat format;
+		VkImageUsageFlags usage;
+		uint32_t width, height;
+		uint32_t slot;
+	};
+
+	// Create color attachments that are bound to memory slots of a single allocation, returns the allocation
+	// Each slot is as large as its largest image and starts at an offset aligned for all of its images
+	// Attachments sharing a slot must never be needed at the same time and their contents have to be discarded on each first write
+	VkDeviceMemory createAliasedAttachments(const std::vector<AliasedAttachment> &attachments, VkCommandBuffer layoutCmd)
+	{
+		uint32_t slotCount = 0;
+		for (auto& aliased : attachments)
+		{
+			slotCount = std::max(slotCount, aliased.slot + 1);
+		}
+		std::vector<VkDeviceSize> slotSizes(slotCount, 0);
+		std::vector<VkDeviceSize> slotAlignments(slotCount, 1);
+		uint32_t memoryTypeBits = ~0u;
+		for (auto& aliased : attachments)
+		{
+			createAttachment(aliased.format, aliased.usage, aliased.attachment, layoutCmd, aliased.width, aliased.height, true);
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device, aliased.attachment->image, &memReqs);
+			slotSizes[aliased.slot] = std::max(slotSizes[aliased.slot], memReqs.size);
+			slotAlignments[aliased.slot] = std::max(slotAlignments[aliased.slot], memReqs.alignment);
+			memoryTypeBits &= memReqs.memoryTypeBits;
+		}
+		assert(memoryTypeBits != 0);
+
+		// Alignments are powers of two
+		std::vector<VkDeviceSize> slotOffsets(slotCount);
+		VkDeviceSize size = 0;
+		for (uint32_t slot = 0; slot < slotCount; slot++)
+		{
+			slotOffsets[slot] = (size + slotAlignments[slot] - 1) & ~(slotAlignments[slot] - 1);
+			size = slotOffsets[slot] + slotSizes[slot];
+		}
+
+		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = size;
+		memAlloc.memoryTypeIndex = getMemTypeIndex(memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VkDeviceMemory memory;
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &memory));
+
+		for (auto& aliased : attachments)
+		{
+			VK_CHECK_RESULT(vkBindImageMemory(device, aliased.attachment->image, memory, slotOffsets[aliased.slot]));
+			createAttachmentView(aliased.attachment, VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+
+		return memory;
+	}
+
+	// Single channel float image with a full mip chain view and one view per level, left in the general layout
+	void createDepthMipChain(DepthMipChain &chain, VkCommandBuffer layoutCmd, uint32_t width, uint32_t height)
+	{
+		chain.width = width;
+		chain.height = height;
+
+		VkImageCreateInfo image = vkTools::initializers::imageCreateInfo();
+		image.imageType = VK_IMAGE_TYPE_2D;
+		image.format = VK_FORMAT_R32_SFLOAT;
+		image.extent = { width, height, 1 };
+		image.mipLevels = SSAO_DEPTH_MIP_LEVELS;
+		image.arrayLayers = 1;
+		image.samples = VK_SAMPLE_COUNT_1_BIT;
+		image.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &chain.image));
+
+		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, chain.image, &memReqs);
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = getMemTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &chain.mem));
+		VK_CHECK_RESULT(vkBindImageMemory(device, chain.image, chain.mem, 0));
+
+		VkImageViewCreateInfo imageView = vkTools::initializers::imageViewCreateInfo();
+		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageView.format = VK_FORMAT_R32_SFLOAT;
+		imageView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, SSAO_DEPTH_MIP_LEVELS, 0, 1 };
+		imageView.image = chain.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &chain.view));
+		for (uint32_t level = 0; level < SSAO_DEPTH_MIP_LEVELS; level++)
+		{
+			imageView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &chain.levelViews[level]));
+		}
+
+		vkTools::setImageLayout(layoutCmd, chain.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, SSAO_DEPTH_MIP_LEVELS, 0, 1 });
+	}
+
+	// Render pass and frame buffer for a full screen pass that writes all of the given color attachments
+	// The attachments are cleared and can be sampled after the pass
+	void prepareColorFramebuffer(FrameBuffer &frameBuffer, FrameBufferAttachment *attachments, uint32_t attachmentCount)
+	{
+		std::vector<VkAttachmentDescription> attachmentDescs(attachmentCount);
+		std::vector<VkAttachmentReference> colorReferences(attachmentCount);
+		std::vector<VkImageView> views(attachmentCount);
+		for (uint32_t i = 0; i < attachmentCount; i++)
+		{
+			attachmentDescs[i] = {};
+			attachmentDescs[i].format = attachments[i].format;
+			attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			colorReferences[i] = { i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+			views[i] = attachments[i].view;
+		}
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pColorAttachments = colorReferences.data();
+		subpass.colorAttachmentCount = attachmentCount;
+
+		std::array<VkSubpassDependency, 2> dependencies;
+
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.pAttachments = attachmentDescs.data();
+		renderPassInfo.attachmentCount = attachmentCount;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 2;
+		renderPassInfo.pDependencies = dependencies.data();
+		if (frameBuffer.renderPass == VK_NULL_HANDLE)
+		{
+			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffer.renderPass));
+		}
+
+		VkFramebufferCreateInfo fbufCreateInfo = vkTools::initializers::framebufferCreateInfo();
+		fbufCreateInfo.renderPass = frameBuffer.renderPass;
+		fbufCreateInfo.pAttachments = views.data();
+		fbufCreateInfo.attachmentCount = attachmentCount;
+		fbufCreateInfo.width = frameBuffer.width;
+		fbufCreateInfo.height = frameBuffer.height;
+		fbufCreateInfo.layers = 1;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffer.frameBuffer));
+	}
+
 	// Prepare a new framebuffer for offscreen rendering
 	// The contents of this framebuffer are then
 	// blitted to our render target
+	// Also called on resize, render passes and the sampler don't depend on the size and are only created once,
+	// so the pipelines created with them stay valid
 	void prepareOffscreenFramebuffers()
 	{
 		VkCommandBuffer layoutCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-#if defined(__ANDROID__)
-		const uint32_t ssaoWidth = width / 2;
-		const uint32_t ssaoHeight = height / 2;
-#else
-		const uint32_t ssaoWidth = width;
-		const uint32_t ssaoHeight = height;
-#endif
+		// Targets for both SSAO quality tiers are created, so switching between them does not recreate any resources
+		const uint32_t ssaoHalfWidth = (width + 1) / 2;
+		const uint32_t ssaoHalfHeight = (height + 1) / 2;
 
 		frameBuffers.offscreen.setSize(width, height);
-		frameBuffers.ssao.setSize(ssaoWidth, ssaoHeight);
+		frameBuffers.ssao.setSize(width, height);
 		frameBuffers.ssaoBlur.setSize(width, height);
+		frameBuffers.ssaoBlurTemp.setSize(width, height);
+		frameBuffers.ssaoDownsample.setSize(ssaoHalfWidth, ssaoHalfHeight);
+		frameBuffers.ssaoHalf.setSize(ssaoHalfWidth, ssaoHalfHeight);
+		frameBuffers.ssaoHalfBlurTemp.setSize(ssaoHalfWidth, ssaoHalfHeight);
+		frameBuffers.ssaoResolve.setSize(width, height);
+		frameBuffers.ssaoHalfResolve.setSize(ssaoHalfWidth, ssaoHalfHeight);
 
 		// Color attachments
-		// Attachment 0: World space positions
-		createAttachment(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.attachments[0], layoutCmd, width, height);
+		// View space positions are not stored, they are reconstructed from the depth attachment
+		// Attachment 0: View space normal, octahedral encoded (16 bit float is a required color attachment format, unlike 16 bit snorm)
+		createAttachment(VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.attachments[0], layoutCmd, width, height);
 
-		// Attachment 1: World space normal
+		// Attachment 1: Albedo, specular intensity in alpha
 		createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.attachments[1], layoutCmd, width, height);
 
-		// Attachment 1: Packed colors, specular
-		createAttachment(VK_FORMAT_R32G32B32A32_UINT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.attachments[2], layoutCmd, width, height);
-
 		// Depth attachment
 
-		// Find a suitable depth format
-		VkFormat attDepthFormat;
-		VkBool32 validDepthFormat = vkTools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
-		assert(validDepthFormat);
+		// Find a suitable depth format, light volumes need a stencil component
+		// Depth is also sampled by the lighting, SSAO and particle passes, which isn't a mandatory feature of these formats
+		VkFormat attDepthFormat = VK_FORMAT_UNDEFINED;
+		const VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		for (auto& format : { VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM_S8_UINT })
+		{
+			VkFormatProperties formatProps;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProps);
+			if ((formatProps.optimalTilingFeatures & depthFeatures) == depthFeatures)
+			{
+				attDepthFormat = format;
+				break;
+			}
+		}
+		assert(attDepthFormat != VK_FORMAT_UNDEFINED);
 
 		createAttachment(attDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, &frameBuffers.offscreen.depth, layoutCmd, width, height);
 
-		// SSAO
-		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssao.attachments[0], layoutCmd, ssaoWidth, ssaoHeight);				// Color																																				
-		// SSAO blur
-		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssaoBlur.attachments[0], layoutCmd, width, height);					// Color
+		// Only a single aspect may be sampled
+		VkImageViewCreateInfo depthView = vkTools::initializers::imageViewCreateInfo();
+		depthView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		depthView.format = attDepthFormat;
+		depthView.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		depthView.image = frameBuffers.offscreen.depth.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &depthView, nullptr, &frameBuffers.offscreen.depthView));
+
+		gBufferPixelSize = getFormatSize(frameBuffers.offscreen.attachments[0].format) + getFormatSize(frameBuffers.offscreen.attachments[1].format) + getFormatSize(attDepthFormat);
+
+		// The particles' descriptor samples the G-Buffer depth, which is not written while the merged G-Buffer pass is used
+		vkTools::setImageLayout(layoutCmd, frameBuffers.offscreen.depth.image, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+
+		// Merged G-Buffer pass, same color formats as the G-Buffer
+		// Only the formats are needed for its render pass, the attachments are created by prepareMergedPassTargets
+		// Depth is read as an input attachment, which requires a view with only the depth aspect, and the merged pass needs no stencil
+		mergedPass.attachments[0].format = frameBuffers.offscreen.attachments[0].format;
+		mergedPass.attachments[1].format = frameBuffers.offscreen.attachments[1].format;
+		mergedPass.depth.format = VK_FORMAT_UNDEFINED;
+		for (auto& format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM })
+		{
+			VkFormatProperties formatProps;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProps);
+			if (formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			{
+				mergedPass.depth.format = format;
+				break;
+			}
+		}
+		assert(mergedPass.depth.format != VK_FORMAT_UNDEFINED);
+
+		// SSAO, written as storage images by the horizon based AO and the compute blur
+		// Bound to the shared memory slots, all passes writing them clear or overwrite them from the undefined layout
+		const VkImageUsageFlags ssaoUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (ssaoComputeSupported ? VK_IMAGE_USAGE_STORAGE_BIT : 0);
+		const VkImageUsageFlags ssaoResolveUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		ssaoMemory = createAliasedAttachments({
+			// Occlusion and blurred result
+			{ &frameBuffers.ssao.attachments[0], VK_FORMAT_R8_UNORM, ssaoUsage, width, height, SSAO_MEMORY_OCCLUSION },
+			{ &frameBuffers.ssaoHalf.attachments[0], VK_FORMAT_R8_UNORM, ssaoUsage, ssaoHalfWidth, ssaoHalfHeight, SSAO_MEMORY_OCCLUSION },
+			{ &frameBuffers.ssaoBlur.attachments[0], VK_FORMAT_R8_UNORM, ssaoUsage, width, height, SSAO_MEMORY_OCCLUSION },
+			// Horizontal blur result
+			{ &frameBuffers.ssaoBlurTemp.attachments[0], VK_FORMAT_R8_UNORM, ssaoUsage, width, height, SSAO_MEMORY_BLUR_TEMP },
+			{ &frameBuffers.ssaoHalfBlurTemp.attachments[0], VK_FORMAT_R8_UNORM, ssaoUsage, ssaoHalfWidth, ssaoHalfHeight, SSAO_MEMORY_BLUR_TEMP },
+			// Temporal SSAO, accumulated occlusion and linear depth for rejecting the history
+			{ &frameBuffers.ssaoResolve.attachments[0], VK_FORMAT_R16G16_SFLOAT, ssaoResolveUsage, width, height, SSAO_MEMORY_RESOLVE },
+			{ &frameBuffers.ssaoHalfResolve.attachments[0], VK_FORMAT_R16G16_SFLOAT, ssaoResolveUsage, ssaoHalfWidth, ssaoHalfHeight, SSAO_MEMORY_RESOLVE },
+		}, layoutCmd);
+		// Half resolution SSAO, raw depth is stored as a float color attachment
+		createAttachment(VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssaoDownsample.attachments[0], layoutCmd, ssaoHalfWidth, ssaoHalfHeight);	// Depth
+		createAttachment(VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssaoDownsample.attachments[1], layoutCmd, ssaoHalfWidth, ssaoHalfHeight);	// Normals
+		// Temporal SSAO history, kept across frames
+		createAttachment(VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, &ssaoHistory, layoutCmd, width, height);
+		createAttachment(VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, &ssaoHalfHistory, layoutCmd, ssaoHalfWidth, ssaoHalfHeight);
+		// History is sampled before it's written for the first time, its contents are ignored until then
+		vkTools::setImageLayout(layoutCmd, ssaoHistory.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		vkTools::setImageLayout(layoutCmd, ssaoHalfHistory.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		// Horizon based AO, the mip chain starts at full resolution for both quality tiers
+		if (ssaoComputeSupported)
+		{
+			createDepthMipChain(ssaoDepthMips, layoutCmd, width, height);
+		}
+
+		// Lighting result of the tiled compute pass (transitioned to the general layout before each dispatch) or the light volumes
+		createAttachment(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &lightingTarget, layoutCmd, width, height);
 
 		VulkanExampleBase::flushCommandBuffer(layoutCmd, queue, true);
 
 		// G-Buffer creation
 		{
-			std::array<VkAttachmentDescription, 4> attachmentDescs = {};
+			std::array<VkAttachmentDescription, 3> attachmentDescs = {};
 
 			// Init attachment properties
+			// Depth is sampled by the following passes for reconstructing positions
 			for (uint32_t i = 0; i < static_cast<uint32_t>(attachmentDescs.size()); i++)
 			{
 				attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -1169,22 +1974,20 @@ public:
 				attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 				attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 				attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-				attachmentDescs[i].finalLayout = (i == 3) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				attachmentDescs[i].finalLayout = (i == 2) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 			}
 
 			// Formats
 			attachmentDescs[0].format = frameBuffers.offscreen.attachments[0].format;
 			attachmentDescs[1].format = frameBuffers.offscreen.attachments[1].format;
-			attachmentDescs[2].format = frameBuffers.offscreen.attachments[2].format;
-			attachmentDescs[3].format = frameBuffers.offscreen.depth.format;
+			attachmentDescs[2].format = frameBuffers.offscreen.depth.format;
 
 			std::vector<VkAttachmentReference> colorReferences;
 			colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
 			colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-			colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
 
 			VkAttachmentReference depthReference = {};
-			depthReference.attachment = 3;
+			depthReference.attachment = 2;
 			depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 			VkSubpassDescription subpass = {};
@@ -1206,9 +2009,9 @@ public:
 
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
@@ -1220,13 +2023,25 @@ public:
 			renderPassInfo.pSubpasses = &subpass;
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.offscreen.renderPass));
+			if (frameBuffers.offscreen.renderPass == VK_NULL_HANDLE)
+			{
+				VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.offscreen.renderPass));
+			}
+
+			// With the depth pre-pass the depth attachment is already written and only tested against
+			// Only load op and layout differ, so it stays compatible with the pipelines and the frame buffer
+			// The dependency on the pre-pass's depth writes is added by the render graph
+			attachmentDescs[2].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachmentDescs[2].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			if (frameBuffers.offscreen.depthLoadRenderPass == VK_NULL_HANDLE)
+			{
+				VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.offscreen.depthLoadRenderPass));
+			}
 
-			std::array<VkImageView, 4> attachments;
+			std::array<VkImageView, 3> attachments;
 			attachments[0] = frameBuffers.offscreen.attachments[0].view;
 			attachments[1] = frameBuffers.offscreen.attachments[1].view;
-			attachments[2] = frameBuffers.offscreen.attachments[2].view;
-			attachments[3] = frameBuffers.offscreen.depth.view;
+			attachments[2] = frameBuffers.offscreen.depth.view;
 
 			VkFramebufferCreateInfo fbufCreateInfo = vkTools::initializers::framebufferCreateInfo();
 			fbufCreateInfo.renderPass = frameBuffers.offscreen.renderPass;
@@ -1238,121 +2053,262 @@ public:
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.offscreen.frameBuffer));
 		}
 
-		// SSAO 
+		// Depth pre-pass
 		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssao.attachments[0].format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			frameBuffers.depthPrepass.setSize(width, height);
 
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+			VkAttachmentDescription attachmentDesc = {};
+			attachmentDesc.format = frameBuffers.offscreen.depth.format;
+			attachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachmentDesc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+			VkAttachmentReference depthReference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
 
 			VkSubpassDescription subpass = {};
 			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
+			subpass.pDepthStencilAttachment = &depthReference;
 
+			// Depth of the last frame may still be read by its passes, the G-Buffer pass waits for the depth writes
 			std::array<VkSubpassDependency, 2> dependencies;
 
 			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[0].dstSubpass = 0;
 			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 			VkRenderPassCreateInfo renderPassInfo = {};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
+			renderPassInfo.pAttachments = &attachmentDesc;
 			renderPassInfo.attachmentCount = 1;
 			renderPassInfo.subpassCount = 1;
 			renderPassInfo.pSubpasses = &subpass;
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssao.renderPass));
+			if (frameBuffers.depthPrepass.renderPass == VK_NULL_HANDLE)
+			{
+				VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.depthPrepass.renderPass));
+			}
 
 			VkFramebufferCreateInfo fbufCreateInfo = vkTools::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssao.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssao.attachments[0].view;
+			fbufCreateInfo.renderPass = frameBuffers.depthPrepass.renderPass;
+			fbufCreateInfo.pAttachments = &frameBuffers.offscreen.depth.view;
 			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssao.width;
-			fbufCreateInfo.height = frameBuffers.ssao.height;
+			fbufCreateInfo.width = frameBuffers.depthPrepass.width;
+			fbufCreateInfo.height = frameBuffers.depthPrepass.height;
 			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssao.frameBuffer));
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.depthPrepass.frameBuffer));
+		}
+
+		// SSAO
+		prepareColorFramebuffer(frameBuffers.ssaoDownsample, frameBuffers.ssaoDownsample.attachments.data(), static_cast<uint32_t>(frameBuffers.ssaoDownsample.attachments.size()));
+		for (auto frameBuffer : { &frameBuffers.ssao, &frameBuffers.ssaoBlur, &frameBuffers.ssaoBlurTemp, &frameBuffers.ssaoHalf, &frameBuffers.ssaoHalfBlurTemp, &frameBuffers.ssaoResolve, &frameBuffers.ssaoHalfResolve })
+		{
+			prepareColorFramebuffer(*frameBuffer, frameBuffer->attachments.data(), 1);
 		}
 
-		// SSAO Blur 
+		// Light volumes
 		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssao.attachments[0].format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			frameBuffers.lightVolumes.setSize(width, height);
+
+			std::array<VkAttachmentDescription, 2> attachmentDescs = {};
+			// Completely written by the ambient pass before the light volumes are added
+			attachmentDescs[0].format = lightingTarget.format;
+			attachmentDescs[0].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachmentDescs[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDescs[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachmentDescs[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachmentDescs[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachmentDescs[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachmentDescs[0].finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+			// Depth of the G-Buffer pass, stencil is cleared for marking the pixels inside the light volumes
+			// Depth is sampled at the same time for reconstructing positions, which requires the general layout
+			attachmentDescs[1].format = frameBuffers.offscreen.depth.format;
+			attachmentDescs[1].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachmentDescs[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachmentDescs[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachmentDescs[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachmentDescs[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachmentDescs[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			attachmentDescs[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+			VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_GENERAL };
 
 			VkSubpassDescription subpass = {};
 			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 			subpass.pColorAttachments = &colorReference;
 			subpass.colorAttachmentCount = 1;
+			subpass.pDepthStencilAttachment = &depthReference;
 
 			std::array<VkSubpassDependency, 2> dependencies;
 
+			// G-Buffer (color and depth) and SSAO have been written
 			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+			// Result is sampled by the composition
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			dependencies[1].dependencyFlags = 0;
 
 			VkRenderPassCreateInfo renderPassInfo = {};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
+			renderPassInfo.pAttachments = attachmentDescs.data();
+			renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
 			renderPassInfo.subpassCount = 1;
 			renderPassInfo.pSubpasses = &subpass;
 			renderPassInfo.dependencyCount = 2;
 			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssaoBlur.renderPass));
+			if (frameBuffers.lightVolumes.renderPass == VK_NULL_HANDLE)
+			{
+				VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.lightVolumes.renderPass));
+			}
+
+			std::array<VkImageView, 2> attachments = { lightingTarget.view, frameBuffers.offscreen.depth.view };
 
 			VkFramebufferCreateInfo fbufCreateInfo = vkTools::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssaoBlur.attachments[0].view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssaoBlur.width;
-			fbufCreateInfo.height = frameBuffers.ssaoBlur.height;
+			fbufCreateInfo.renderPass = frameBuffers.lightVolumes.renderPass;
+			fbufCreateInfo.pAttachments = attachments.data();
+			fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			fbufCreateInfo.width = frameBuffers.lightVolumes.width;
+			fbufCreateInfo.height = frameBuffers.lightVolumes.height;
 			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssaoBlur.frameBuffer));
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.lightVolumes.frameBuffer));
 		}
 
-		// Shared sampler for color attachments
+		// Merged G-Buffer and composition pass
+		// First subpass fills the G-Buffer, the second one reads it as input attachments and writes the lit result to the swap chain image
+		{
+			std::array<VkAttachmentDescription, 4> attachmentDescs = {};
+			for (uint32_t i = 0; i < static_cast<uint32_t>(attachmentDescs.size()); i++)
+			{
+				attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
+				attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+				// Only the swap chain image is stored, the G-Buffer never leaves the render pass
+				attachmentDescs[i].storeOp = (i == 0) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+				attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+			// Attachment 0: Swap chain image
+			attachmentDescs[0].format = colorformat;
+			attachmentDescs[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			// Attachments 1 and 2: Normals and albedo
+			attachmentDescs[1].format = mergedPass.attachments[0].format;
+			attachmentDescs[1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			attachmentDescs[2].format = mergedPass.attachments[1].format;
+			attachmentDescs[2].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			// Attachment 3: Depth
+			attachmentDescs[3].format = mergedPass.depth.format;
+			attachmentDescs[3].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+			std::array<VkSubpassDescription, 2> subpasses = {};
+
+			// Subpass 0: G-Buffer
+			std::array<VkAttachmentReference, 2> gBufferReferences = {{ { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } }};
+			VkAttachmentReference depthReference = { 3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+			subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpasses[0].colorAttachmentCount = static_cast<uint32_t>(gBufferReferences.size());
+			subpasses[0].pColorAttachments = gBufferReferences.data();
+			subpasses[0].pDepthStencilAttachment = &depthReference;
+
+			// Subpass 1: Composition and particles
+			// Depth is read as an input attachment and stays bound read-only for depth testing the particles
+			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+			std::array<VkAttachmentReference, 3> inputReferences = {{ { 3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL }, { 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }, { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } }};
+			VkAttachmentReference depthReadReference = { 3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+			subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpasses[1].colorAttachmentCount = 1;
+			subpasses[1].pColorAttachments = &colorReference;
+			subpasses[1].inputAttachmentCount = static_cast<uint32_t>(inputReferences.size());
+			subpasses[1].pInputAttachments = inputReferences.data();
+			subpasses[1].pDepthStencilAttachment = &depthReadReference;
+
+			std::array<VkSubpassDependency, 4> dependencies;
+
+			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[0].dstSubpass = 0;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+			// Swap chain image is first used by the composition
+			dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[1].dstSubpass = 1;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+			// G-Buffer is read by the composition at the same pixel, so the dependency is local to each region
+			dependencies[2].srcSubpass = 0;
+			dependencies[2].dstSubpass = 1;
+			dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+			dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+			dependencies[3].srcSubpass = 1;
+			dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[3].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+			VkRenderPassCreateInfo renderPassInfo = {};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			renderPassInfo.pAttachments = attachmentDescs.data();
+			renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
+			renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+			renderPassInfo.pSubpasses = subpasses.data();
+			renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+			renderPassInfo.pDependencies = dependencies.data();
+			if (mergedPass.renderPass == VK_NULL_HANDLE)
+			{
+				VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &mergedPass.renderPass));
+			}
+		}
+
+		if (enableMergedPass)
+		{
+			prepareMergedPassTargets();
+		}
+
+		// Shared sampler for color attachments
+		if (colorSampler != VK_NULL_HANDLE)
+		{
+			return;
+		}
 		VkSamplerCreateInfo sampler = vkTools::initializers::samplerCreateInfo();
 		sampler.magFilter = VK_FILTER_LINEAR;
 		sampler.minFilter = VK_FILTER_LINEAR;
@@ -1368,187 +2324,975 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
 	}
 
-	// Build command buffer for rendering the scene to the offscreen frame buffer 
-	// and blitting it to the different texture targets
-	void buildDeferredCommandBuffer(bool rebuild = false)
+	// Transient attachments of the merged G-Buffer pass and its frame buffers, one per swap chain image
+	// Nothing has to be transitioned, all attachments are cleared on load and the swap chain image's layout is undefined on load
+	void prepareMergedPassTargets()
 	{
+		const VkImageUsageFlags mergedUsage = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		mergedPass.lazilyAllocated = createAttachment(mergedPass.attachments[0].format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | mergedUsage, &mergedPass.attachments[0], VK_NULL_HANDLE, width, height);
+		mergedPass.lazilyAllocated &= createAttachment(mergedPass.attachments[1].format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | mergedUsage, &mergedPass.attachments[1], VK_NULL_HANDLE, width, height);
+		mergedPass.lazilyAllocated &= createAttachment(mergedPass.depth.format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | mergedUsage, &mergedPass.depth, VK_NULL_HANDLE, width, height);
+
+		std::array<VkImageView, 4> attachments = { VK_NULL_HANDLE, mergedPass.attachments[0].view, mergedPass.attachments[1].view, mergedPass.depth.view };
+
+		VkFramebufferCreateInfo fbufCreateInfo = vkTools::initializers::framebufferCreateInfo();
+		fbufCreateInfo.renderPass = mergedPass.renderPass;
+		fbufCreateInfo.pAttachments = attachments.data();
+		fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		fbufCreateInfo.width = width;
+		fbufCreateInfo.height = height;
+		fbufCreateInfo.layers = 1;
+		mergedPass.frameBuffers.resize(swapChain.imageCount);
+		for (uint32_t i = 0; i < swapChain.imageCount; i++)
+		{
+			attachments[0] = swapChain.buffers[i].view;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &mergedPass.frameBuffers[i]));
+		}
+	}
 
-		if ((offScreenCmdBuffer == VK_NULL_HANDLE) || (rebuild))
+	// Input attachments of the merged pass' composition subpass, written whenever its targets are created
+	void updateMergedPassDescriptors()
+	{
+		VkDescriptorSet targetDS = resources.descriptorSets->get("composition.merged");
+		// Input attachments are read without a sampler
+		std::vector<VkDescriptorImageInfo> imageDescriptors = {
+			vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, mergedPass.depth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, mergedPass.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, mergedPass.attachments[1].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0, &imageDescriptors[0]),					// Binding 0 : Depth input attachment
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, &imageDescriptors[1]),					// Binding 1 : Normals input attachment
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 2, &imageDescriptors[2]),					// Binding 2 : Albedo input attachment
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+	}
+
+	// Hands the merged pass targets over to the deletion queue, the formats are kept for recreating them
+	void retireMergedPassTargets()
+	{
+		if (mergedPass.depth.image == VK_NULL_HANDLE)
 		{
-			if (rebuild)
+			return;
+		}
+		std::vector<VkFramebuffer> mergedFrameBuffers = mergedPass.frameBuffers;
+		std::array<FrameBufferAttachment, 3> targets = {{ mergedPass.attachments[0], mergedPass.attachments[1], mergedPass.depth }};
+		VkDevice device = this->device;
+		deletionQueue.push(frameIndex, [=]() mutable
+		{
+			for (auto& frameBuffer : mergedFrameBuffers)
 			{
-				vkFreeCommandBuffers(device, cmdPool, 1, &offScreenCmdBuffer);
+				vkDestroyFramebuffer(device, frameBuffer, nullptr);
 			}
-			offScreenCmdBuffer = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+			for (auto& attachment : targets)
+			{
+				attachment.destroy(device);
+			}
+		});
+		mergedPass.frameBuffers.clear();
+		for (auto attachment : { &mergedPass.attachments[0], &mergedPass.attachments[1], &mergedPass.depth })
+		{
+			attachment->image = VK_NULL_HANDLE;
+			attachment->mem = VK_NULL_HANDLE;
+			attachment->view = VK_NULL_HANDLE;
 		}
+	}
 
-		// Create a semaphore used to synchronize offscreen rendering and usage
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vkTools::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+	// Hands the size dependent images and frame buffers created by prepareOffscreenFramebuffers over to the deletion queue
+	// The handles are copied, so the members can be recreated right away while the last frame may still use the old ones
+	void retireOffscreenTargets()
+	{
+		auto targets = frameBuffers;
+		FrameBufferAttachment lighting = lightingTarget;
+		std::array<FrameBufferAttachment, 2> history = {{ ssaoHistory, ssaoHalfHistory }};
+		VkDeviceMemory sharedMemory = ssaoMemory;
+		DepthMipChain depthMips = ssaoDepthMips;
+		VkDevice device = this->device;
+		deletionQueue.push(frameIndex, [=]() mutable
+		{
+			// G-Buffer
+			for (auto& attachment : targets.offscreen.attachments)
+			{
+				attachment.destroy(device);
+			}
+			vkDestroyImageView(device, targets.offscreen.depthView, nullptr);
+			targets.offscreen.depth.destroy(device);
+			vkDestroyFramebuffer(device, targets.offscreen.frameBuffer, nullptr);
+			vkDestroyFramebuffer(device, targets.depthPrepass.frameBuffer, nullptr);
 
-		VkCommandBufferBeginInfo cmdBufInfo = vkTools::initializers::commandBufferBeginInfo();
+			// Lighting
+			lighting.destroy(device);
+			vkDestroyFramebuffer(device, targets.lightVolumes.frameBuffer, nullptr);
 
-		// Clear values for all attachments written in the fragment sahder
-		std::array<VkClearValue, 4> clearValues = {};
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[3].depthStencil = { 1.0f, 0 };
+			// SSAO, the attachments in the shared memory slots don't own their memory
+			for (auto frameBuffer : { &targets.ssao, &targets.ssaoBlur, &targets.ssaoBlurTemp, &targets.ssaoHalf, &targets.ssaoHalfBlurTemp, &targets.ssaoResolve, &targets.ssaoHalfResolve })
+			{
+				frameBuffer->attachments[0].destroy(device);
+				vkDestroyFramebuffer(device, frameBuffer->frameBuffer, nullptr);
+			}
+			vkFreeMemory(device, sharedMemory, nullptr);
+			for (auto& attachment : targets.ssaoDownsample.attachments)
+			{
+				attachment.destroy(device);
+			}
+			vkDestroyFramebuffer(device, targets.ssaoDownsample.frameBuffer, nullptr);
+			for (auto& attachment : history)
+			{
+				attachment.destroy(device);
+			}
+			depthMips.destroy(device);
+		});
+		retireMergedPassTargets();
+	}
+
+	// Returns true if the mesh may be visible from the camera's current PVS cell
+	bool meshVisible(uint32_t meshIndex)
+	{
+		return !enablePVS || pvs.isVisible(pvsCell, meshIndex);
+	}
+
+	// Look up the camera's PVS cell, returns true if it changed
+	bool updatePVSCell()
+	{
+		if (!pvs.valid())
+		{
+			return false;
+		}
+		// Camera position is stored negated
+		int32_t cell = enablePVS ? pvs.getCellIndex(-camera.position) : -1;
+		if (cell != pvsCell)
+		{
+			pvsCell = cell;
+			pvsVisibleMeshes = pvs.visibleCount(pvsCell);
+			return true;
+		}
+		return false;
+	}
+
+	// Re-record the G-Buffer pass if the visible set changed or the camera moved far enough to change the draw order
+	void updateSceneDraws()
+	{
+		bool rebuild = updatePVSCell();
+		rebuild |= glm::distance(-camera.position, sortPosition) > RENDERQUEUE_RESORT_DISTANCE;
+		if (offScreenCmdBuffer == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		if (rebuild)
+		{
+			buildDeferredCommandBuffer();
+		}
+		// Particle systems are blended back to front, the composition is recorded again once their order changes
+		if (getParticleDrawOrder() != particleDrawOrder)
+		{
+			// Cached variants were recorded with the previous order
+			clearCommandBufferVariants();
+			buildCommandBuffers();
+		}
+	}
+
+	// Indices of the particle systems sorted back to front for the current camera position
+	std::vector<uint32_t> getParticleDrawOrder()
+	{
+		const std::vector<ParticleSystem*> &particleSystems = resources.particleSystems->particleSystems;
+		std::vector<uint32_t> order(particleSystems.size());
+		for (uint32_t i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			return glm::distance(particleSystems[a]->position, -camera.position) > glm::distance(particleSystems[b]->position, -camera.position);
+		});
+		return order;
+	}
+
+	// Build command buffer for rendering the scene to the offscreen frame buffer 
+	// and blitting it to the different texture targets
+	// Single full screen triangle into all color attachments of the frame buffer
+	void recordFullscreenPass(VkCommandBuffer cmdBuffer, FrameBuffer &frameBuffer, uint32_t attachmentCount, const std::string &pipelineLayout, const std::string &descriptorSet, const std::string &pipeline)
+	{
+		std::vector<VkClearValue> clearValues(attachmentCount);
+		for (auto& clearValue : clearValues)
+		{
+			clearValue.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		}
 
 		VkRenderPassBeginInfo renderPassBeginInfo = vkTools::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass = frameBuffers.offscreen.renderPass;
-		renderPassBeginInfo.framebuffer = frameBuffers.offscreen.frameBuffer;
-		renderPassBeginInfo.renderArea.extent.width = frameBuffers.offscreen.width;
-		renderPassBeginInfo.renderArea.extent.height = frameBuffers.offscreen.height;
-		renderPassBeginInfo.clearValueCount = clearValues.size();
+		renderPassBeginInfo.framebuffer = frameBuffer.frameBuffer;
+		renderPassBeginInfo.renderPass = frameBuffer.renderPass;
+		// Only the part covered by the current render scale is written
+		const VkExtent2D extent = getRenderExtent(frameBuffer.width, frameBuffer.height);
+		renderPassBeginInfo.renderArea.extent = extent;
+		renderPassBeginInfo.clearValueCount = attachmentCount;
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
+		vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		// First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
-		// -------------------------------------------------------------------------------------------------------
+		VkViewport viewport = vkTools::initializers::viewport((float)extent.width, (float)extent.height, 0.0f, 1.0f);
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+		VkRect2D scissor = vkTools::initializers::rect2D(extent.width, extent.height, 0, 0);
+		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
-		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get(pipelineLayout), 0, 1, resources.descriptorSets->getPtr(descriptorSet), 0, NULL);
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get(pipeline));
+		vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
 
-		VkViewport viewport = vkTools::initializers::viewport(
-			(float)frameBuffers.offscreen.width,
-			(float)frameBuffers.offscreen.height,
-			0.0f,
-			1.0f);
-		vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
+		vkCmdEndRenderPass(cmdBuffer);
+	}
+
+	// Rendered part of a target at the current render scale, rounded up so the scaled image is covered completely
+	// The shaders only get the scale and round the same way
+	VkExtent2D getRenderExtent(uint32_t targetWidth, uint32_t targetHeight)
+	{
+		VkExtent2D extent;
+		extent.width = std::max(static_cast<uint32_t>(std::ceil((float)targetWidth * renderScale.x)), 1u);
+		extent.height = std::max(static_cast<uint32_t>(std::ceil((float)targetHeight * renderScale.y)), 1u);
+		return extent;
+	}
 
-		VkRect2D scissor = vkTools::initializers::rect2D(
-			frameBuffers.offscreen.width,
-			frameBuffers.offscreen.height,
+	// Compute pass writing a single channel SSAO target as a storage image instead of using its render pass
+	// The result is left in the same layout as the fragment versions' render passes leave it
+	void recordSSAOComputePass(VkCommandBuffer cmdBuffer, VkImage target, const std::string &pipeline, const std::string &pipelineLayout, const std::string &descriptorSet, uint32_t groupCountX, uint32_t groupCountY)
+	{
+		// Inputs have been written by a previous render pass (SSAO, G-Buffer depth) or compute pass
+		VkMemoryBarrier memoryBarrier = vkTools::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		// Target is completely overwritten
+		VkImageMemoryBarrier imageBarrier = vkTools::initializers::imageMemoryBarrier();
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.image = target;
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(
+			cmdBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &memoryBarrier,
+			0, nullptr,
+			1, &imageBarrier);
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelines->get(pipeline));
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelineLayouts->get(pipelineLayout), 0, 1, resources.descriptorSets->getPtr(descriptorSet), 0, NULL);
+		vkCmdDispatch(cmdBuffer, groupCountX, groupCountY, 1);
+
+		// Sampled by the next SSAO pass or the lighting passes
+		imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(
+			cmdBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			0,
-			0);
-		vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
+			0, nullptr,
+			0, nullptr,
+			1, &imageBarrier);
+	}
 
-		VkDeviceSize offsets[1] = { 0 };
+	// One direction of the SSAO compute blur
+	void recordComputeBlurPass(VkCommandBuffer cmdBuffer, FrameBuffer &frameBuffer, VkImage target, const std::string &descriptorSet, bool vertical)
+	{
+		// Work groups are laid out along the blur direction
+		const VkExtent2D extent = getRenderExtent(frameBuffer.width, frameBuffer.height);
+		const uint32_t length = vertical ? extent.height : extent.width;
+		const uint32_t lines = vertical ? extent.width : extent.height;
+		recordSSAOComputePass(cmdBuffer, target, vertical ? "ssao.blur.compute.vertical" : "ssao.blur.compute.horizontal", "ssao.blur.compute", descriptorSet, (length + SSAO_BLUR_TILE_SIZE - 1) / SSAO_BLUR_TILE_SIZE, (lines + SSAO_BLUR_TILE_LINES - 1) / SSAO_BLUR_TILE_LINES);
+	}
+
+	// Builds the linear depth mip chain of the horizon based AO from the G-Buffer depth, one level after another
+	// Barriers between the levels make each level's writes visible to the next one, the image stays in the general layout
+	void recordSSAODepthMips(VkCommandBuffer cmdBuffer)
+	{
+		// First level reads the G-Buffer depth
+		VkMemoryBarrier memoryBarrier = vkTools::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		for (uint32_t level = 0; level < SSAO_DEPTH_MIP_LEVELS; level++)
+		{
+			vkCmdPipelineBarrier(cmdBuffer, srcStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelines->get((level == 0) ? "ssao.depthmips.linearize" : "ssao.depthmips.downsample"));
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelineLayouts->get("ssao.depthmips"), 0, 1, resources.descriptorSets->getPtr("ssao.depthmips." + std::to_string(level)), 0, NULL);
+			const VkExtent2D levelExtent = getRenderExtent(std::max(ssaoDepthMips.width >> level, 1u), std::max(ssaoDepthMips.height >> level, 1u));
+			vkCmdDispatch(cmdBuffer, (levelExtent.width + SSAO_COMPUTE_GROUP_SIZE - 1) / SSAO_COMPUTE_GROUP_SIZE, (levelExtent.height + SSAO_COMPUTE_GROUP_SIZE - 1) / SSAO_COMPUTE_GROUP_SIZE, 1);
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
+	}
+
+	// Copies the temporal SSAO result to the history sampled by the next frame
+	// Both images are left in the shader read layout
+	void recordSSAOHistoryCopy(VkCommandBuffer cmdBuffer, FrameBufferAttachment &resolve, FrameBufferAttachment &history, uint32_t width, uint32_t height)
+	{
+		std::array<VkImageMemoryBarrier, 2> imageBarriers;
+		// Resolve pass has written the result
+		imageBarriers[0] = vkTools::initializers::imageMemoryBarrier();
+		imageBarriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		imageBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarriers[0].image = resolve.image;
+		imageBarriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		// Resolve pass has read the old history, which is completely overwritten
+		imageBarriers[1] = vkTools::initializers::imageMemoryBarrier();
+		imageBarriers[1].srcAccessMask = 0;
+		imageBarriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarriers[1].image = history.image;
+		imageBarriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(
+			cmdBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+		VkImageCopy copyRegion = {};
+		copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.extent = { width, height, 1 };
+		vkCmdCopyImage(cmdBuffer, resolve.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, history.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+		// Result is blurred next, the history is read by the next frame's resolve pass
+		imageBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(
+			cmdBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
 
-		// skysphere
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("skysphere"));
-		vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get("skysphere"), 0, 1, resources.descriptorSets->getPtr("skysphere"), 0, NULL);
-		vkCmdBindVertexBuffers(offScreenCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &meshes.skysphere.vertices.buf, offsets);
-		vkCmdBindIndexBuffer(offScreenCmdBuffer, meshes.skysphere.indices.buf, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(offScreenCmdBuffer, meshes.skysphere.indexCount, 1, 0, 0, 0);
+	// Collect all G-Buffer draws into the scene render queue, for the G-Buffer pass or the first subpass of the merged G-Buffer pass
+	// Keys are built from pass (opaque, alpha masked), pipeline, material and distance to the camera (front to back)
+	// The sky isn't part of the G-Buffer, it's shaded by the composition where no depth has been written
+	void buildSceneQueue(bool merged)
+	{
+		sceneQueue.clear();
+		sortPosition = -camera.position;
 
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("scene.solid"));
+		const bool depthPrepass = useDepthPrepass() && !merged;
 
-#ifdef PER_MESH_BUFFERS
-		// Render using separate buffers
-		for (auto mesh : scene->meshes)
+		for (uint32_t i = 0; i < scene->meshes.size(); i++)
 		{
-			if (mesh.material->hasAlpha)
+			SceneMesh &mesh = scene->meshes[i];
+			if (!meshVisible(i))
 			{
 				continue;
 			}
-			vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene->pipelineLayout, 0, 1, &mesh.descriptorSet, 0, NULL);
-			vkCmdBindVertexBuffers(offScreenCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &mesh.vertexBuffer, offsets);
-			vkCmdBindIndexBuffer(offScreenCmdBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(offScreenCmdBuffer, mesh.indexCount, 1, 0, 0, 0);
+			SceneMaterial *material = mesh.material;
+			DrawData drawData;
+			drawData.instance = i;
+			drawData.material = static_cast<uint32_t>(material - scene->materials.data());
+			// Opaque meshes only pass the depth test for the surface stored by the pre-pass
+			VkPipeline pipeline = resources.pipelines->get(getMaterialPipelineName(material->pipelineVariant, enableBindless, merged, depthPrepass && !material->hasAlpha));
+			VkPipelineLayout pipelineLayout = resources.pipelineLayouts->get("offscreen");
+			// Per-frame and per-pass sets are shared by all draws, the per-material set changes with the material
+			std::array<VkDescriptorSet, 3> descriptorSets = {
+				resources.descriptorSets->get("scene.frame"),
+				resources.descriptorSets->get("scene.pass"),
+				material->descriptorSet,
+			};
+			if (enableBindless)
+			{
+				// Texture array is shared by all draws, textures are selected by the material's indices
+				pipelineLayout = resources.pipelineLayouts->get("offscreen.bindless");
+				descriptorSets[2] = resources.descriptorSets->get("scene.textures");
+			}
+			uint64_t key = RenderQueue::makeKey(
+				material->hasAlpha ? 2 : 1,
+				sceneQueue.getPipelineId(pipeline),
+				drawData.material,
+				glm::distance(mesh.center, sortPosition) - mesh.radius);
+#ifdef PER_MESH_BUFFERS
+			// Render using separate buffers
+			sceneQueue.addIndexed(key, pipeline, pipelineLayout, descriptorSets[0], mesh.vertexBuffer, mesh.indexBuffer, mesh.indexCount, 0);
+#else
+			// Render from global buffer using index offsets
+			sceneQueue.addIndexed(key, pipeline, pipelineLayout, descriptorSets[0], scene->vertexBuffer.buffer, scene->indexBuffer.buffer, mesh.indexCount, mesh.indexBase);
+#endif
+			sceneQueue.setDescriptorSets(static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+			sceneQueue.setPushConstants(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(DrawData), &drawData);
 		}
 
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("scene.blend"));
+		sceneQueue.sort();
+	}
 
-		for (auto mesh : scene->meshes)
+	// Depth only draws of the visible opaque meshes, sorted front to back as they all share one pipeline
+	// Alpha tested meshes would need their textures and are left to the G-Buffer pass
+	void buildDepthPrepassQueue()
+	{
+		depthPrepassQueue.clear();
+
+		VkPipeline pipeline = resources.pipelines->get("depthprepass");
+		VkPipelineLayout pipelineLayout = resources.pipelineLayouts->get("offscreen");
+		std::array<VkDescriptorSet, 2> descriptorSets = {
+			resources.descriptorSets->get("scene.frame"),
+			resources.descriptorSets->get("scene.pass"),
+		};
+
+		for (uint32_t i = 0; i < scene->meshes.size(); i++)
 		{
-			if (mesh.material->hasAlpha)
+			SceneMesh &mesh = scene->meshes[i];
+			if ((!meshVisible(i)) || (mesh.material->hasAlpha))
 			{
-				vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene->pipelineLayout, 0, 1, &mesh.descriptorSet, 0, NULL);
-				vkCmdBindVertexBuffers(offScreenCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &mesh.vertexBuffer, offsets);
-				vkCmdBindIndexBuffer(offScreenCmdBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(offScreenCmdBuffer, mesh.indexCount, 1, 0, 0, 0);
+				continue;
 			}
+			DrawData drawData;
+			drawData.instance = i;
+			drawData.material = static_cast<uint32_t>(mesh.material - scene->materials.data());
+			uint64_t key = RenderQueue::makeKey(0, depthPrepassQueue.getPipelineId(pipeline), 0, glm::distance(mesh.center, sortPosition) - mesh.radius);
+#ifdef PER_MESH_BUFFERS
+			depthPrepassQueue.addIndexed(key, pipeline, pipelineLayout, descriptorSets[0], mesh.vertexBuffer, mesh.indexBuffer, mesh.indexCount, 0);
+#else
+			// Positions only, so more vertices fit into the post transform cache
+			depthPrepassQueue.addIndexed(key, pipeline, pipelineLayout, descriptorSets[0], scene->positionBuffer.buffer, scene->indexBuffer.buffer, mesh.indexCount, mesh.indexBase);
+#endif
+			depthPrepassQueue.setDescriptorSets(static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+			depthPrepassQueue.setPushConstants(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(DrawData), &drawData);
 		}
 
-#else
-		// Render from global buffer using index offsets
-		vkCmdBindVertexBuffers(offScreenCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &scene->vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(offScreenCmdBuffer, scene->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		depthPrepassQueue.sort();
+	}
+
+	// Command buffers cached for other render modes share the scene draws, viewports and targets recorded here,
+	// so they are outdated by any re-recording that isn't a switch to new render modes
+	void buildDeferredCommandBuffer(bool renderModeSwitch = false)
+	{
+		if (!renderModeSwitch)
+		{
+			clearCommandBufferVariants();
+		}
+
+		if (offScreenCmdBuffer == VK_NULL_HANDLE)
+		{
+			offScreenCmdBuffer = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+		}
+
+		VkCommandBufferBeginInfo cmdBufInfo = vkTools::initializers::commandBufferBeginInfo();
+
+		buildRenderGraph();
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
+
+		// First command buffer submitted each frame, so all timestamp queries of the frame are reset here
+		gpuProfiler->reset(offScreenCmdBuffer);
+
+		// Passes not contributing to the composition are culled, the dependencies between the remaining ones are inserted by the graph
+		renderGraph.execute(offScreenCmdBuffer);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
+
+		if (useMergedPass())
+		{
+			// G-Buffer and composition are recorded into the swap chain command buffers as a single render pass
+			// None of the passes between them are used with the merged pass, so only the light assignment is left in the offscreen command buffer
+			buildCommandBuffers();
+		}
+	}
+
+	// Declares the passes of the offscreen command buffer and the resources they read and write
+	// The composition (or the merged pass) is recorded into the swap chain command buffers and is the output of the graph
+	void buildRenderGraph()
+	{
+		renderGraph.clear();
+
+		const bool halfResolution = (ssaoQuality == SSAO_QUALITY_LOW);
+		auto &ssaoTarget = halfResolution ? frameBuffers.ssaoHalf : frameBuffers.ssao;
+		auto &ssaoResolveTarget = halfResolution ? frameBuffers.ssaoHalfResolve : frameBuffers.ssaoResolve;
+
+		// Images in the shared SSAO memory slots are validated against their lifetimes when the graph is compiled
+		auto addImage = [this](const std::string &name, const FrameBufferAttachment &attachment, uint32_t width, uint32_t height, int32_t slot)
+		{
+			renderGraph.addImage(name, attachment.format, width, height, (VkDeviceSize)width * height * getFormatSize(attachment.format), slot);
+		};
+		const uint32_t width = frameBuffers.offscreen.width;
+		const uint32_t height = frameBuffers.offscreen.height;
+		addImage("gbuffer.normals", frameBuffers.offscreen.attachments[0], width, height, -1);
+		addImage("gbuffer.albedo", frameBuffers.offscreen.attachments[1], width, height, -1);
+		addImage("gbuffer.depth", frameBuffers.offscreen.depth, width, height, -1);
+		addImage("ssao", ssaoTarget.attachments[0], ssaoTarget.width, ssaoTarget.height, SSAO_MEMORY_OCCLUSION);
+		addImage("ssao.resolve", ssaoResolveTarget.attachments[0], ssaoResolveTarget.width, ssaoResolveTarget.height, SSAO_MEMORY_RESOLVE);
+		addImage("ssao.history", halfResolution ? ssaoHalfHistory : ssaoHistory, ssaoResolveTarget.width, ssaoResolveTarget.height, -1);
+		addImage("ssao.blurtemp", halfResolution ? frameBuffers.ssaoHalfBlurTemp.attachments[0] : frameBuffers.ssaoBlurTemp.attachments[0], ssaoTarget.width, ssaoTarget.height, SSAO_MEMORY_BLUR_TEMP);
+		addImage("ssao.blurred", frameBuffers.ssaoBlur.attachments[0], frameBuffers.ssaoBlur.width, frameBuffers.ssaoBlur.height, SSAO_MEMORY_OCCLUSION);
+		addImage("lighting", lightingTarget, width, height, -1);
+		renderGraph.addBuffer("clusters", storageBuffers.clusters.size);
+
+		// Light assignment: Build the light list of each view space cluster
+		// Only depends on the lights and the projection, so it's done before the G-Buffer pass
+		// -------------------------------------------------------------------------------------------------------
 
-		for (auto mesh : scene->meshes)
+		renderGraph.addPass("Clusters", [this](VkCommandBuffer cmdBuffer)
 		{
-			if (mesh.material->hasAlpha)
+			gpuProfiler->begin(cmdBuffer, "Clusters");
+
+			// Cluster lists of the last frame may still be read by its composition
+			VkBufferMemoryBarrier bufferBarrier = vkTools::initializers::bufferMemoryBarrier();
+			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = storageBuffers.clusters.buffer;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(
+				cmdBuffer,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				0, nullptr,
+				1, &bufferBarrier,
+				0, nullptr);
+
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelines->get("lighting.clusters"));
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelineLayouts->get("lighting.clusters"), 0, 1, resources.descriptorSets->getPtr("lighting.clusters"), 0, NULL);
+			vkCmdDispatch(cmdBuffer, (CLUSTER_COUNT + CLUSTER_ASSIGNMENT_GROUP_SIZE - 1) / CLUSTER_ASSIGNMENT_GROUP_SIZE, 1, 1);
+
+			gpuProfiler->end(cmdBuffer, "Clusters");
+		})
+			.write("clusters", RenderGraph::ACCESS_STORAGE_COMPUTE);
+
+		// Optional depth pre-pass: Lay down the depth of all opaque meshes, so the G-Buffer pass
+		// only shades the visible surface of each pixel
+		// -------------------------------------------------------------------------------------------------------
+
+		const bool depthPrepass = useDepthPrepass();
+		if (depthPrepass)
+		{
+			renderGraph.addPass("Depth prepass", [this](VkCommandBuffer cmdBuffer)
 			{
-				continue;
-			}
-			vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene->pipelineLayout, 0, 1, &mesh.descriptorSet, 0, NULL);
-			vkCmdDrawIndexed(offScreenCmdBuffer, mesh.indexCount, 1, 0, mesh.indexBase, 0);
+				VkClearValue clearValue = {};
+				clearValue.depthStencil = { 1.0f, 0 };
+
+				VkRenderPassBeginInfo renderPassBeginInfo = vkTools::initializers::renderPassBeginInfo();
+				renderPassBeginInfo.renderPass = frameBuffers.depthPrepass.renderPass;
+				renderPassBeginInfo.framebuffer = frameBuffers.depthPrepass.frameBuffer;
+				const VkExtent2D renderExtent = getRenderExtent(frameBuffers.offscreen.width, frameBuffers.offscreen.height);
+				renderPassBeginInfo.renderArea.extent = renderExtent;
+				renderPassBeginInfo.clearValueCount = 1;
+				renderPassBeginInfo.pClearValues = &clearValue;
+
+				gpuProfiler->begin(cmdBuffer, "Depth prepass");
+				vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				VkViewport viewport = vkTools::initializers::viewport((float)renderExtent.width, (float)renderExtent.height, 0.0f, 1.0f);
+				vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+				VkRect2D scissor = vkTools::initializers::rect2D(renderExtent.width, renderExtent.height, 0, 0);
+				vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+				buildDepthPrepassQueue();
+				depthPrepassQueue.submit(cmdBuffer);
+
+				vkCmdEndRenderPass(cmdBuffer);
+				gpuProfiler->end(cmdBuffer, "Depth prepass");
+			})
+				.write("gbuffer.depth", RenderGraph::ACCESS_DEPTH_ATTACHMENT);
+		}
+
+		// First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
+		// With the depth pre-pass the depth attachment is loaded instead of cleared
+		// -------------------------------------------------------------------------------------------------------
+
+		RenderGraph::Pass &gbufferPass = renderGraph.addPass("G-Buffer", [this, depthPrepass](VkCommandBuffer cmdBuffer)
+		{
+			// Clear values for all attachments written in the fragment sahder
+			std::array<VkClearValue, 3> clearValues = {};
+			clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			clearValues[2].depthStencil = { 1.0f, 0 };
+
+			VkRenderPassBeginInfo renderPassBeginInfo = vkTools::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = depthPrepass ? frameBuffers.offscreen.depthLoadRenderPass : frameBuffers.offscreen.renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers.offscreen.frameBuffer;
+			// Dynamic resolution: only the scaled part of the G-Buffer is rendered
+			const VkExtent2D renderExtent = getRenderExtent(frameBuffers.offscreen.width, frameBuffers.offscreen.height);
+			renderPassBeginInfo.renderArea.extent = renderExtent;
+			renderPassBeginInfo.clearValueCount = clearValues.size();
+			renderPassBeginInfo.pClearValues = clearValues.data();
+
+			gpuProfiler->begin(cmdBuffer, "G-Buffer");
+			// Fragment shader invocations are counted to measure the overdraw
+			gpuProfiler->beginStatistics(cmdBuffer, "G-Buffer");
+			vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			VkViewport viewport = vkTools::initializers::viewport(
+				(float)renderExtent.width,
+				(float)renderExtent.height,
+				0.0f,
+				1.0f);
+			vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+			VkRect2D scissor = vkTools::initializers::rect2D(
+				renderExtent.width,
+				renderExtent.height,
+				0,
+				0);
+			vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+			buildSceneQueue(false);
+			sceneQueue.submit(cmdBuffer);
+
+			vkCmdEndRenderPass(cmdBuffer);
+			gpuProfiler->endStatistics(cmdBuffer, "G-Buffer");
+			gpuProfiler->end(cmdBuffer, "G-Buffer");
+		});
+		if (depthPrepass)
+		{
+			gbufferPass.read("gbuffer.depth", RenderGraph::ACCESS_DEPTH_ATTACHMENT);
 		}
+		gbufferPass
+			.write("gbuffer.normals", RenderGraph::ACCESS_COLOR_ATTACHMENT)
+			.write("gbuffer.albedo", RenderGraph::ACCESS_COLOR_ATTACHMENT)
+			.write("gbuffer.depth", RenderGraph::ACCESS_DEPTH_ATTACHMENT);
+
+		// SSAO passes are always declared and culled if the occlusion isn't read
+		// Half resolution: depth and normals are downsampled, occlusion is generated and blurred horizontally at half resolution
+		// The vertical blur pass upsamples to full resolution, weighting the half resolution samples by their depth difference to the full resolution pixel
+		// Full resolution: occlusion generation followed by a separable bilateral blur
+		// -------------------------------------------------------------------------------------------------------
 
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("scene.blend"));
+		const std::string tier = halfResolution ? ".half" : "";
+		const RenderGraph::Access ssaoWrite = (ssaoMethod == SSAO_METHOD_HEMISPHERE) ? RenderGraph::ACCESS_COLOR_ATTACHMENT : RenderGraph::ACCESS_STORAGE_COMPUTE;
+		const RenderGraph::Access blurRead = ssaoComputeBlur ? RenderGraph::ACCESS_SAMPLED_COMPUTE : RenderGraph::ACCESS_SAMPLED_FRAGMENT;
+		const RenderGraph::Access blurWrite = ssaoComputeBlur ? RenderGraph::ACCESS_STORAGE_COMPUTE : RenderGraph::ACCESS_COLOR_ATTACHMENT;
 
-		for (auto mesh : scene->meshes)
+		RenderGraph::Pass &ssaoPass = renderGraph.addPass("SSAO generation", [this, halfResolution, tier](VkCommandBuffer cmdBuffer)
 		{
-			if (mesh.material->hasAlpha)
+			auto &ssaoTarget = halfResolution ? frameBuffers.ssaoHalf : frameBuffers.ssao;
+
+			gpuProfiler->begin(cmdBuffer, "SSAO");
+			// Generation is timed separately to compare the methods
+			gpuProfiler->begin(cmdBuffer, "SSAO generation");
+			if (halfResolution)
+			{
+				recordFullscreenPass(cmdBuffer, frameBuffers.ssaoDownsample, 2, "ssao.downsample", "ssao.downsample", "ssao.downsample");
+			}
+			if (ssaoMethod == SSAO_METHOD_HEMISPHERE)
 			{
-				vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene->pipelineLayout, 0, 1, &mesh.descriptorSet, 0, NULL);
-				vkCmdDrawIndexed(offScreenCmdBuffer, mesh.indexCount, 1, 0, mesh.indexBase, 0);
+				recordFullscreenPass(cmdBuffer, ssaoTarget, 1, "ssao.generate", "ssao.generate" + tier, ssaoTemporal ? "ssao.generate.temporal" : "ssao.generate");
 			}
+			else
+			{
+				// Horizon samples are read from the mip chain, depth and normals of the pixel itself at the target's resolution
+				recordSSAODepthMips(cmdBuffer);
+				const VkExtent2D targetExtent = getRenderExtent(ssaoTarget.width, ssaoTarget.height);
+				recordSSAOComputePass(cmdBuffer, ssaoTarget.attachments[0].image, ssaoMethods[ssaoMethod].pipeline, "ssao.horizon", "ssao.horizon" + tier,
+					(targetExtent.width + SSAO_COMPUTE_GROUP_SIZE - 1) / SSAO_COMPUTE_GROUP_SIZE, (targetExtent.height + SSAO_COMPUTE_GROUP_SIZE - 1) / SSAO_COMPUTE_GROUP_SIZE);
+			}
+			gpuProfiler->end(cmdBuffer, "SSAO generation");
+		});
+		if (halfResolution || (ssaoMethod == SSAO_METHOD_HEMISPHERE))
+		{
+			ssaoPass.read("gbuffer.depth", RenderGraph::ACCESS_SAMPLED_FRAGMENT).read("gbuffer.normals", RenderGraph::ACCESS_SAMPLED_FRAGMENT);
+		}
+		if (ssaoMethod != SSAO_METHOD_HEMISPHERE)
+		{
+			ssaoPass.read("gbuffer.depth", RenderGraph::ACCESS_SAMPLED_COMPUTE).read("gbuffer.normals", RenderGraph::ACCESS_SAMPLED_COMPUTE);
 		}
+		ssaoPass.write("ssao", ssaoWrite);
 
-#endif
+		// Temporal: the occlusion is blended with the reprojected history, the result is blurred and becomes the next frame's history
+		renderGraph.addPass("SSAO temporal", [this, halfResolution, tier](VkCommandBuffer cmdBuffer)
+		{
+			auto &resolveTarget = halfResolution ? frameBuffers.ssaoHalfResolve : frameBuffers.ssaoResolve;
+			recordFullscreenPass(cmdBuffer, resolveTarget, 1, "ssao.temporal", "ssao.temporal" + tier, "ssao.temporal");
+			const VkExtent2D resolveExtent = getRenderExtent(resolveTarget.width, resolveTarget.height);
+			recordSSAOHistoryCopy(cmdBuffer, resolveTarget.attachments[0], halfResolution ? ssaoHalfHistory : ssaoHistory, resolveExtent.width, resolveExtent.height);
+		})
+			.read("ssao", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+			.read("ssao.history", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+			.read("gbuffer.depth", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+			.write("ssao.resolve", RenderGraph::ACCESS_COLOR_ATTACHMENT)
+			.read("ssao.resolve", RenderGraph::ACCESS_TRANSFER)
+			.write("ssao.history", RenderGraph::ACCESS_TRANSFER);
+
+		renderGraph.addPass("SSAO blur horizontal", [this, halfResolution, tier](VkCommandBuffer cmdBuffer)
+		{
+			auto &blurTarget = halfResolution ? frameBuffers.ssaoHalfBlurTemp : frameBuffers.ssaoBlurTemp;
+			const std::string blurSource = tier + (ssaoTemporal ? ".temporal" : "");
+			if (ssaoComputeBlur)
+			{
+				recordComputeBlurPass(cmdBuffer, blurTarget, blurTarget.attachments[0].image, "ssao.blur.compute.horizontal" + blurSource, false);
+			}
+			else
+			{
+				recordFullscreenPass(cmdBuffer, blurTarget, 1, "ssao.blur", "ssao.blur.horizontal" + blurSource, "ssao.blur.horizontal");
+			}
+		})
+			.read(ssaoTemporal ? "ssao.resolve" : "ssao", blurRead)
+			.read("gbuffer.depth", blurRead)
+			.write("ssao.blurtemp", blurWrite);
 
-		vkCmdEndRenderPass(offScreenCmdBuffer);
+		renderGraph.addPass("SSAO blur vertical", [this, tier](VkCommandBuffer cmdBuffer)
+		{
+			if (ssaoComputeBlur)
+			{
+				recordComputeBlurPass(cmdBuffer, frameBuffers.ssaoBlur, frameBuffers.ssaoBlur.attachments[0].image, "ssao.blur.compute.vertical" + tier, true);
+			}
+			else
+			{
+				recordFullscreenPass(cmdBuffer, frameBuffers.ssaoBlur, 1, "ssao.blur", "ssao.blur.vertical" + tier, "ssao.blur.vertical");
+			}
+			gpuProfiler->end(cmdBuffer, "SSAO");
+		})
+			.read("ssao.blurtemp", blurRead)
+			.read("gbuffer.depth", blurRead)
+			.write("ssao.blurred", blurWrite);
 
-		if (enableSSAO)
+		if (lightingMode == LIGHTING_TILED)
 		{
+			// Fourth pass: Tiled lighting
+			// Lights are culled against each 16x16 screen tile, the remaining ones are applied to the tile's pixels
+			// -------------------------------------------------------------------------------------------------------
+
+			RenderGraph::Pass &lightingPass = renderGraph.addPass("Lighting", [this](VkCommandBuffer cmdBuffer)
+			{
+				gpuProfiler->begin(cmdBuffer, "Lighting");
+
+				// Target is completely overwritten, so the contents of the last frame are discarded
+				// Reading the G-Buffer and SSAO attachments is synchronized by the graph
+				VkImageMemoryBarrier imageBarrier = vkTools::initializers::imageMemoryBarrier();
+				imageBarrier.srcAccessMask = 0;
+				imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+				imageBarrier.image = lightingTarget.image;
+				imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+				vkCmdPipelineBarrier(
+					cmdBuffer,
+					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0,
+					0, nullptr,
+					0, nullptr,
+					1, &imageBarrier);
+
+				const VkExtent2D renderExtent = getRenderExtent(frameBuffers.offscreen.width, frameBuffers.offscreen.height);
+				vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelines->get(enableSSAO ? "lighting.tiled.ssao.enabled" : "lighting.tiled.ssao.disabled"));
+				vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources.pipelineLayouts->get("lighting.tiled"), 0, 1, resources.descriptorSets->getPtr("lighting.tiled"), 0, NULL);
+				vkCmdDispatch(cmdBuffer, (renderExtent.width + TILED_LIGHTING_TILE_SIZE - 1) / TILED_LIGHTING_TILE_SIZE, (renderExtent.height + TILED_LIGHTING_TILE_SIZE - 1) / TILED_LIGHTING_TILE_SIZE, 1);
+
+				gpuProfiler->end(cmdBuffer, "Lighting");
+			})
+				.read("gbuffer.normals", RenderGraph::ACCESS_SAMPLED_COMPUTE)
+				.read("gbuffer.albedo", RenderGraph::ACCESS_SAMPLED_COMPUTE)
+				.read("gbuffer.depth", RenderGraph::ACCESS_SAMPLED_COMPUTE)
+				.write("lighting", RenderGraph::ACCESS_STORAGE_COMPUTE);
+			if (enableSSAO)
+			{
+				lightingPass.read("ssao.blurred", RenderGraph::ACCESS_SAMPLED_COMPUTE);
+			}
+		}
 
-			// Second pass: SSAO generation
+		if (lightingMode == LIGHTING_VOLUMES)
+		{
+			// Fourth pass: Light volumes
+			// Ambient term is written first, then each light's volume is stencil marked against the
+			// G-Buffer depth and only the marked pixels are shaded
+			// Draw count depends on the number of lights, so the command buffer is rebuilt when it changes
 			// -------------------------------------------------------------------------------------------------------
 
-			clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-			clearValues[1].depthStencil = { 1.0f, 0 };
+			RenderGraph::Pass &lightingPass = renderGraph.addPass("Lighting", [this](VkCommandBuffer cmdBuffer)
+			{
+				gpuProfiler->begin(cmdBuffer, "Lighting");
+
+				std::array<VkClearValue, 2> clearValues = {};
+				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+				clearValues[1].depthStencil = { 1.0f, 0 };
+
+				VkRenderPassBeginInfo renderPassBeginInfo = vkTools::initializers::renderPassBeginInfo();
+				renderPassBeginInfo.framebuffer = frameBuffers.lightVolumes.frameBuffer;
+				renderPassBeginInfo.renderPass = frameBuffers.lightVolumes.renderPass;
+				const VkExtent2D lightVolumesExtent = getRenderExtent(frameBuffers.lightVolumes.width, frameBuffers.lightVolumes.height);
+				renderPassBeginInfo.renderArea.extent = lightVolumesExtent;
+				renderPassBeginInfo.clearValueCount = clearValues.size();
+				renderPassBeginInfo.pClearValues = clearValues.data();
+
+				vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				VkViewport viewport = vkTools::initializers::viewport((float)lightVolumesExtent.width, (float)lightVolumesExtent.height, 0.0f, 1.0f);
+				vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+				VkRect2D scissor = vkTools::initializers::rect2D(lightVolumesExtent.width, lightVolumesExtent.height, 0, 0);
+				vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+				vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get("lighting.volumes"), 0, 1, resources.descriptorSets->getPtr("lighting.volumes"), 0, NULL);
+				vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get(enableSSAO ? "lighting.volumes.ambient.ssao.enabled" : "lighting.volumes.ambient.ssao.disabled"));
+				vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+
+				VkDeviceSize offsets[1] = { 0 };
+				vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &meshes.lightVolume.vertices.buf, offsets);
+				vkCmdBindIndexBuffer(cmdBuffer, meshes.lightVolume.indices.buf, 0, VK_INDEX_TYPE_UINT32);
+				VkPipeline stencilPipeline = resources.pipelines->get("lighting.volumes.stencil");
+				VkPipeline shadingPipeline = resources.pipelines->get(enableSSAO ? "lighting.volumes.ssao.enabled" : "lighting.volumes.ssao.disabled");
+				// The instance index selects the light
+				for (uint32_t i = 0; i < getLightCount(); i++)
+				{
+					vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, stencilPipeline);
+					vkCmdDrawIndexed(cmdBuffer, meshes.lightVolume.indexCount, 1, 0, 0, i);
+					vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadingPipeline);
+					vkCmdDrawIndexed(cmdBuffer, meshes.lightVolume.indexCount, 1, 0, 0, i);
+				}
 
-			renderPassBeginInfo.framebuffer = frameBuffers.ssao.frameBuffer;
-			renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
-			renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
-			renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
-			renderPassBeginInfo.clearValueCount = 2;
-			renderPassBeginInfo.pClearValues = clearValues.data();
+				vkCmdEndRenderPass(cmdBuffer);
+				gpuProfiler->end(cmdBuffer, "Lighting");
+			})
+				.read("gbuffer.normals", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+				.read("gbuffer.albedo", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+				.read("gbuffer.depth", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+				.write("gbuffer.depth", RenderGraph::ACCESS_DEPTH_ATTACHMENT)
+				.write("lighting", RenderGraph::ACCESS_COLOR_ATTACHMENT);
+			if (enableSSAO)
+			{
+				lightingPass.read("ssao.blurred", RenderGraph::ACCESS_SAMPLED_FRAGMENT);
+			}
+		}
 
-			vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// Recorded into the swap chain command buffers, the dependencies on the passes above are added at the end of the offscreen command buffer
+		if (useMergedPass())
+		{
+			RenderGraph::Pass &outputPass = renderGraph.addOutputPass("Merged pass");
+			if (lightingMode == LIGHTING_CLUSTERED)
+			{
+				outputPass.read("clusters", RenderGraph::ACCESS_STORAGE_FRAGMENT);
+			}
+		}
+		else
+		{
+			RenderGraph::Pass &outputPass = renderGraph.addOutputPass("Composition")
+				.read("gbuffer.normals", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+				.read("gbuffer.albedo", RenderGraph::ACCESS_SAMPLED_FRAGMENT)
+				.read("gbuffer.depth", RenderGraph::ACCESS_SAMPLED_FRAGMENT);
+			if (enableSSAO)
+			{
+				outputPass.read("ssao.blurred", RenderGraph::ACCESS_SAMPLED_FRAGMENT);
+			}
+			if ((lightingMode == LIGHTING_TILED) || (lightingMode == LIGHTING_VOLUMES))
+			{
+				outputPass.read("lighting", RenderGraph::ACCESS_SAMPLED_FRAGMENT);
+			}
+			if (lightingMode == LIGHTING_CLUSTERED)
+			{
+				outputPass.read("clusters", RenderGraph::ACCESS_STORAGE_FRAGMENT);
+			}
+		}
 
-			viewport = vkTools::initializers::viewport((float)frameBuffers.ssao.width, (float)frameBuffers.ssao.height, 0.0f, 1.0f);
-			vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
-			scissor = vkTools::initializers::rect2D(frameBuffers.ssao.width, frameBuffers.ssao.height, 0, 0);
-			vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
+		renderGraph.compile();
+	}
 
-			vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get("ssao.generate"), 0, 1, resources.descriptorSets->getPtr("ssao.generate"), 0, NULL);
-			vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("ssao.generate"));
-			vkCmdDraw(offScreenCmdBuffer, 3, 1, 0, 0);
+	// Writes the current render graph to the working directory, the .dot file can be rendered with Graphviz
+	void dumpRenderGraph()
+	{
+		for (auto& file : { std::make_pair(std::string("rendergraph.json"), renderGraph.toJSON()), std::make_pair(std::string("rendergraph.dot"), renderGraph.toDOT()) })
+		{
+			std::ofstream stream(file.first);
+			if (!stream.is_open())
+			{
+				std::cerr << "Could not write render graph to \"" << file.first << "\"" << std::endl;
+				continue;
+			}
+			stream << file.second;
+			std::cout << "Render graph written to \"" << file.first << "\"" << std::endl;
+		}
+	}
 
-			vkCmdEndRenderPass(offScreenCmdBuffer);
+	// Render modes that change the recorded commands, 4 bits each
+	uint64_t getRenderModeKey()
+	{
+		uint64_t key = 0;
+		for (uint32_t mode : { (uint32_t)debugDisplay, (uint32_t)enableSSAO, (uint32_t)ssaoQuality, (uint32_t)ssaoMethod, (uint32_t)ssaoComputeBlur, (uint32_t)ssaoTemporal, (uint32_t)enableBindless, (uint32_t)lightingMode, (uint32_t)enableMergedPass, (uint32_t)enableDepthPrepass })
+		{
+			assert(mode < 16);
+			key = (key << 4) | mode;
+		}
+		return key;
+	}
 
-			// Third pass: SSAO blur
-			// -------------------------------------------------------------------------------------------------------
+	void freeCommandBufferVariant(CommandBufferVariant &variant)
+	{
+		vkFreeCommandBuffers(device, cmdPool, 1, &variant.offscreen);
+		vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(variant.draw.size()), variant.draw.data());
+	}
 
-			renderPassBeginInfo.framebuffer = frameBuffers.ssaoBlur.frameBuffer;
-			renderPassBeginInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-			renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoBlur.width;
-			renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoBlur.height;
+	void clearCommandBufferVariants()
+	{
+		for (auto& variant : commandBufferVariants)
+		{
+			freeCommandBufferVariant(variant.second);
+		}
+		commandBufferVariants.clear();
+	}
 
-			vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Swaps in the command buffers of the current render modes, they are only recorded if no cached variant exists
+	// The command buffers of the previous modes are cached for switching back
+	// Only called between frames, the queue is idle after submitFrame
+	void switchCommandBuffers(uint64_t previousModes)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
 
-			viewport = vkTools::initializers::viewport((float)frameBuffers.ssaoBlur.width, (float)frameBuffers.ssaoBlur.height, 0.0f, 1.0f);
-			vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
-			scissor = vkTools::initializers::rect2D(frameBuffers.ssaoBlur.width, frameBuffers.ssaoBlur.height, 0, 0);
-			vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
+		CommandBufferVariant previous;
+		previous.offscreen = offScreenCmdBuffer;
+		previous.draw = drawCmdBuffers;
+		previous.lastUsed = frameIndex;
 
-			vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get("ssao.blur"), 0, 1, resources.descriptorSets->getPtr("ssao.blur"), 0, NULL);
-			vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("ssao.blur"));
-			vkCmdDraw(offScreenCmdBuffer, 3, 1, 0, 0);
+		auto variant = commandBufferVariants.find(getRenderModeKey());
+		modeSwitchStats.cached = (variant != commandBufferVariants.end());
+		if (modeSwitchStats.cached)
+		{
+			offScreenCmdBuffer = variant->second.offscreen;
+			drawCmdBuffers = variant->second.draw;
+			commandBufferVariants.erase(variant);
+			// Only declared again for the overlay and dumps, the cached commands were recorded from an identical graph
+			buildRenderGraph();
+		}
+		else
+		{
+			offScreenCmdBuffer = VK_NULL_HANDLE;
+			createCommandBuffers();
+			buildCommandBuffers();
+			buildDeferredCommandBuffer(true);
+		}
 
-			vkCmdEndRenderPass(offScreenCmdBuffer);
+		commandBufferVariants[previousModes] = previous;
+		while (commandBufferVariants.size() > COMMAND_BUFFER_VARIANTS_MAX)
+		{
+			auto oldest = commandBufferVariants.begin();
+			for (auto it = commandBufferVariants.begin(); it != commandBufferVariants.end(); it++)
+			{
+				if (it->second.lastUsed < oldest->second.lastUsed)
+				{
+					oldest = it;
+				}
+			}
+			freeCommandBufferVariant(oldest->second);
+			commandBufferVariants.erase(oldest);
 		}
 
-		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		modeSwitchStats.switchTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 	}
 
+	// Only called between frames, the queue is idle after submitFrame
 	void reBuildCommandBuffers()
 	{
-		vkDeviceWaitIdle(device);
 		if (!checkCommandBuffers())
 		{
 			destroyCommandBuffers();
@@ -1559,6 +3303,12 @@ public:
 
 	void buildCommandBuffers()
 	{
+		if (useMergedPass())
+		{
+			buildMergedCommandBuffers();
+			return;
+		}
+
 		VkCommandBufferBeginInfo cmdBufInfo = vkTools::initializers::commandBufferBeginInfo();
 
 		VkClearValue clearValues[2];
@@ -1574,7 +3324,64 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		VkResult err;
+		// Collect composition draws, same for all command buffers
+		// Keys are built from pass (debug display, composition, particles) and pipeline, particles are sorted back to front
+		compositionQueue.clear();
+
+		VkPipeline pipeline;
+		if (debugDisplay)
+		{
+			pipeline = resources.pipelines->get("debugdisplay");
+			compositionQueue.addIndexed(
+				RenderQueue::makeKey(0, compositionQueue.getPipelineId(pipeline), 0, 0.0f),
+				pipeline,
+				resources.pipelineLayouts->get("composition"),
+				resources.descriptorSets->get("composition"),
+				meshes.quad.vertices.buf,
+				meshes.quad.indices.buf,
+				meshes.quad.indexCount,
+				0,
+				1);
+		}
+
+		// Final composition as full screen quad
+		pipeline = resources.pipelines->get(getCompositionPipelineName(enableSSAO, lightingMode));
+		compositionQueue.addIndexed(
+			RenderQueue::makeKey(1, compositionQueue.getPipelineId(pipeline), 0, 0.0f),
+			pipeline,
+			resources.pipelineLayouts->get("composition"),
+			resources.descriptorSets->get("composition"),
+			meshes.quad.vertices.buf,
+			meshes.quad.indices.buf,
+			6,
+			0,
+			1);
+		if (debugDisplay)
+		{
+			// Move viewport to display final composition in lower right corner
+			VkViewport viewport = vkTools::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			viewport.x = viewport.width * 0.5f;
+			viewport.y = viewport.height * 0.5f;
+			compositionQueue.setViewport(viewport);
+		}
+
+		// Alpha blended objects in separate pass using depht info from deferred pass (particles, etc.)
+
+		// Particle systems
+		pipeline = resources.pipelines->get("particlesystem");
+		particleDrawOrder = getParticleDrawOrder();
+		for (auto& particleSystem : resources.particleSystems->particleSystems)
+		{
+			compositionQueue.add(
+				RenderQueue::makeKey(2, compositionQueue.getPipelineId(pipeline), 0, glm::distance(particleSystem->position, -camera.position), true),
+				pipeline,
+				resources.pipelineLayouts->get("particlesystem"),
+				resources.descriptorSets->get("particlesystem"),
+				particleSystem->buffer.buffer,
+				particleSystem->particleCount);
+		}
+
+		compositionQueue.sort();
 
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
@@ -1583,6 +3390,7 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			gpuProfiler->begin(drawCmdBuffers[i], "Composition");
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vkTools::initializers::viewport(
@@ -1599,39 +3407,87 @@ public:
 				0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get("composition"), 0, 1, resources.descriptorSets->getPtr("composition"), 0, NULL);
+			compositionQueue.submit(drawCmdBuffers[i]);
 
-			if (debugDisplay)
-			{
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("debugdisplay"));
-				vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &meshes.quad.vertices.buf, offsets);
-				vkCmdBindIndexBuffer(drawCmdBuffers[i], meshes.quad.indices.buf, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(drawCmdBuffers[i], meshes.quad.indexCount, 1, 0, 0, 1);
-				// Move viewport to display final composition in lower right corner
-				viewport.x = viewport.width * 0.5f;
-				viewport.y = viewport.height * 0.5f;
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			}
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			gpuProfiler->end(drawCmdBuffers[i], "Composition");
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		}
+	}
+
+	// Merged G-Buffer pass: the G-Buffer draws and the composition are recorded as two subpasses of a single render pass
+	// Rendered at full resolution, as the input attachments can only be read at the pixel's own position
+	void buildMergedCommandBuffers()
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vkTools::initializers::commandBufferBeginInfo();
 
-			// Final composition as full screen quad
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get(enableSSAO ? "composition.ssao.enabled" : "composition.ssao.disabled"));
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &meshes.quad.vertices.buf, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], meshes.quad.indices.buf, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], 6, 1, 0, 0, 1);
+		// Swap chain image, normals, albedo and depth
+		std::array<VkClearValue, 4> clearValues = {};
+		clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
+		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		clearValues[3].depthStencil = { 1.0f, 0 };
 
-			// Alpha blended objects in separate pass using depht info from deferred pass (particles, etc.)
+		VkRenderPassBeginInfo renderPassBeginInfo = vkTools::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = mergedPass.renderPass;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues = clearValues.data();
 
-			// Particle systems
-			for (auto& particleSystem : resources.particleSystems->particleSystems)
-			{
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelineLayouts->get("particlesystem"), 0, 1, resources.descriptorSets->getPtr("particlesystem"), 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, resources.pipelines->get("particlesystem"));
-				vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &particleSystem->buffer.buffer, offsets);
-				vkCmdDraw(drawCmdBuffers[i], particleSystem->particleCount, 1, 0, 0);
-			}
+		buildSceneQueue(true);
 
+		// Composition as a single full screen triangle, followed by the particles
+		compositionQueue.clear();
+
+		VkPipeline pipeline = resources.pipelines->get(getMergedCompositionPipelineName(lightingMode));
+		compositionQueue.add(
+			RenderQueue::makeKey(1, compositionQueue.getPipelineId(pipeline), 0, 0.0f),
+			pipeline,
+			resources.pipelineLayouts->get("composition.merged"),
+			resources.descriptorSets->get("composition.merged"),
+			VK_NULL_HANDLE,
+			3);
+
+		pipeline = resources.pipelines->get("particlesystem.merged");
+		particleDrawOrder = getParticleDrawOrder();
+		for (auto& particleSystem : resources.particleSystems->particleSystems)
+		{
+			compositionQueue.add(
+				RenderQueue::makeKey(2, compositionQueue.getPipelineId(pipeline), 0, glm::distance(particleSystem->position, -camera.position), true),
+				pipeline,
+				resources.pipelineLayouts->get("particlesystem"),
+				resources.descriptorSets->get("particlesystem"),
+				particleSystem->buffer.buffer,
+				particleSystem->particleCount);
+		}
+
+		compositionQueue.sort();
+
+		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+		{
+			renderPassBeginInfo.framebuffer = mergedPass.frameBuffers[i];
+
+			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+
+			gpuProfiler->begin(drawCmdBuffers[i], "G-Buffer");
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			VkViewport viewport = vkTools::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			VkRect2D scissor = vkTools::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+
+			sceneQueue.submit(drawCmdBuffers[i]);
+			// Tile based GPUs may interleave both subpasses, so the split between the two scopes is only approximate there
+			gpuProfiler->end(drawCmdBuffers[i], "G-Buffer");
+
+			gpuProfiler->begin(drawCmdBuffers[i], "Composition");
+			vkCmdNextSubpass(drawCmdBuffers[i], VK_SUBPASS_CONTENTS_INLINE);
+			compositionQueue.submit(drawCmdBuffers[i]);
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			gpuProfiler->end(drawCmdBuffers[i], "Composition");
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
@@ -1696,6 +3552,87 @@ public:
 			&meshes.quad.indices.mem);
 	}
 
+	// Once subdivided icosahedron used as the bounding volume of the point lights
+	// Scaled so its faces enclose the unit sphere, wound counter clockwise seen from the outside like the scene's meshes
+	void generateLightVolume()
+	{
+		const float t = (1.0f + sqrt(5.0f)) / 2.0f;
+		std::vector<glm::vec3> positions = {
+			{ -1.0f, t, 0.0f }, { 1.0f, t, 0.0f }, { -1.0f, -t, 0.0f }, { 1.0f, -t, 0.0f },
+			{ 0.0f, -1.0f, t }, { 0.0f, 1.0f, t }, { 0.0f, -1.0f, -t }, { 0.0f, 1.0f, -t },
+			{ t, 0.0f, -1.0f }, { t, 0.0f, 1.0f }, { -t, 0.0f, -1.0f }, { -t, 0.0f, 1.0f },
+		};
+		std::vector<uint32_t> indexBuffer = {
+			0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+			1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+			3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+			4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1,
+		};
+		for (auto& position : positions)
+		{
+			position = glm::normalize(position);
+		}
+
+		// Split each triangle into four, new vertices are shared by adjacent triangles
+		std::unordered_map<uint64_t, uint32_t> midpoints;
+		auto getMidpoint = [&](uint32_t a, uint32_t b) -> uint32_t
+		{
+			uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+			auto it = midpoints.find(key);
+			if (it != midpoints.end())
+			{
+				return it->second;
+			}
+			positions.push_back(glm::normalize(positions[a] + positions[b]));
+			midpoints[key] = static_cast<uint32_t>(positions.size() - 1);
+			return midpoints[key];
+		};
+		std::vector<uint32_t> subdivided;
+		for (size_t i = 0; i < indexBuffer.size(); i += 3)
+		{
+			uint32_t a = indexBuffer[i], b = indexBuffer[i + 1], c = indexBuffer[i + 2];
+			uint32_t ab = getMidpoint(a, b), bc = getMidpoint(b, c), ca = getMidpoint(c, a);
+			subdivided.insert(subdivided.end(), { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca });
+		}
+		indexBuffer = subdivided;
+
+		// Faces lie inside of the unit sphere, scale by the closest face's distance to enclose it
+		float minDistance = 1.0f;
+		for (size_t i = 0; i < indexBuffer.size(); i += 3)
+		{
+			glm::vec3 &a = positions[indexBuffer[i]];
+			glm::vec3 &b = positions[indexBuffer[i + 1]];
+			glm::vec3 &c = positions[indexBuffer[i + 2]];
+			glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+			if (glm::dot(normal, a) < 0.0f)
+			{
+				std::swap(indexBuffer[i + 1], indexBuffer[i + 2]);
+				normal = -normal;
+			}
+			minDistance = std::min(minDistance, glm::dot(normal, a));
+		}
+		for (auto& position : positions)
+		{
+			position /= minDistance;
+		}
+
+		createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			positions.size() * sizeof(glm::vec3),
+			positions.data(),
+			&meshes.lightVolume.vertices.buf,
+			&meshes.lightVolume.vertices.mem);
+
+		meshes.lightVolume.indexCount = static_cast<uint32_t>(indexBuffer.size());
+
+		createBuffer(
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			indexBuffer.size() * sizeof(uint32_t),
+			indexBuffer.data(),
+			&meshes.lightVolume.indices.buf,
+			&meshes.lightVolume.indices.mem);
+	}
+
 	void setupVertexDescriptions()
 	{
 		// Binding description
@@ -1718,21 +3655,49 @@ public:
 		vertices.inputState.pVertexBindingDescriptions = vertices.bindingDescriptions.data();
 		vertices.inputState.vertexAttributeDescriptionCount = vertices.attributeDescriptions.size();
 		vertices.inputState.pVertexAttributeDescriptions = vertices.attributeDescriptions.data();
+
+		emptyInputState = vkTools::initializers::pipelineVertexInputStateCreateInfo();
+
+		lightVolumeVertices.bindingDescription = vkTools::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX);
+		lightVolumeVertices.attributeDescription = vkTools::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		lightVolumeVertices.inputState = vkTools::initializers::pipelineVertexInputStateCreateInfo();
+		lightVolumeVertices.inputState.vertexBindingDescriptionCount = 1;
+		lightVolumeVertices.inputState.pVertexBindingDescriptions = &lightVolumeVertices.bindingDescription;
+		lightVolumeVertices.inputState.vertexAttributeDescriptionCount = 1;
+		lightVolumeVertices.inputState.pVertexAttributeDescriptions = &lightVolumeVertices.attributeDescription;
+
+#ifdef PER_MESH_BUFFERS
+		positionVertices.bindingDescription = vkTools::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+#else
+		positionVertices.bindingDescription = vkTools::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX);
+#endif
+		positionVertices.attributeDescription = vkTools::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		positionVertices.inputState = vkTools::initializers::pipelineVertexInputStateCreateInfo();
+		positionVertices.inputState.vertexBindingDescriptionCount = 1;
+		positionVertices.inputState.pVertexBindingDescriptions = &positionVertices.bindingDescription;
+		positionVertices.inputState.vertexAttributeDescriptionCount = 1;
+		positionVertices.inputState.pVertexAttributeDescriptions = &positionVertices.attributeDescription;
 	}
 
 	void setupDescriptorPool()
 	{
+		// Bindless path needs one additional set for the texture array
+		const uint32_t bindlessSets = bindlessSupported ? 1 : 0;
+
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10),
-			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16)
+			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 43),
+			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10),
+			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 83 + bindlessSets * BINDLESS_TEXTURE_COUNT),
+			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 14),
+			vkTools::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 3)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vkTools::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				6);
+				32 + bindlessSets);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -1750,11 +3715,15 @@ public:
 		// Composition
 		setLayoutBindings = {
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),				// Vertex shader uniform buffer
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),		// Position texture target / Scene colormap
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),		// Depth texture target
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),		// Normals texture target
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),		// Albedo texture target
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),		// FS SSAO blurred
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),				// Fragment shader uniform buffer
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),				// Lights
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),		// Tiled lighting result
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 7),				// Cluster light lists
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 8),				// Inverse projection, cluster parameters
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 9),		// Sky texture
 		};
 		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		resources.descriptorSetLayouts->add("composition", setLayoutCreateInfo);
@@ -1763,27 +3732,151 @@ public:
 		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("composition");
 		targetDS = resources.descriptorSets->add("composition", descriptorAllocInfo);
 		imageDescriptors = {
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
 			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL),
 			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[1].view, VK_IMAGE_LAYOUT_GENERAL),
-			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[2].view, VK_IMAGE_LAYOUT_GENERAL),
 			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlur.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, lightingTarget.view, VK_IMAGE_LAYOUT_GENERAL),
+			resources.textures->get("skysphere").descriptor,
 		};	
 		writeDescriptorSets = {
 			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.fullScreen.descriptor),		// Binding 0 : Vertex shader uniform buffer			
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),				// Binding 1 : Position texture target			
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),				// Binding 1 : Depth texture target			
 			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),				// Binding 2 : Normals texture target			
 			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[2]),				// Binding 3 : Albedo texture target			
 			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &imageDescriptors[3]),				// FS Sampler SSAO blurred
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &uniformBuffers.sceneLights.descriptor),		// Binding 4 : Fragment shader uniform buffer
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &storageBuffers.lights.descriptor),			// Binding 5 : Lights
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &imageDescriptors[4]),				// Binding 6 : Tiled lighting result
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &storageBuffers.clusters.descriptor),		// Binding 7 : Cluster light lists
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8, &uniformBuffers.lightCulling.descriptor),	// Binding 8 : Inverse projection, cluster parameters
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &imageDescriptors[5]),				// Binding 9 : Sky texture
 		};
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
+		// Composition subpass of the merged G-Buffer pass
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT, 0),			// Depth input attachment
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT, 1),			// Normals input attachment
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT, 2),			// Albedo input attachment
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),				// Lights
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),				// Cluster light lists
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),				// Inverse projection, cluster parameters
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),		// Sky texture
+		};
+		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		resources.descriptorSetLayouts->add("composition.merged", setLayoutCreateInfo);
+		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("composition.merged");
+		resources.pipelineLayouts->add("composition.merged", pipelineLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("composition.merged");
+		targetDS = resources.descriptorSets->add("composition.merged", descriptorAllocInfo);
+		imageDescriptors = {
+			resources.textures->get("skysphere").descriptor,
+		};
+		writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &storageBuffers.lights.descriptor),			// Binding 3 : Lights
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &storageBuffers.clusters.descriptor),		// Binding 4 : Cluster light lists
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &uniformBuffers.lightCulling.descriptor),	// Binding 5 : Inverse projection, cluster parameters
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &imageDescriptors[0]),				// Binding 6 : Sky texture
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		if (mergedPass.depth.view != VK_NULL_HANDLE)
+		{
+			updateMergedPassDescriptors();
+		}
+
+		// Tiled lighting
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),		// Depth texture target
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),		// Normals texture target
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 2),		// Albedo texture target
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 3),		// SSAO blurred
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),				// Lights
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 5),				// Lighting result
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),				// Inverse projection
+		};
+		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		resources.descriptorSetLayouts->add("lighting.tiled", setLayoutCreateInfo);
+		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("lighting.tiled");
+		resources.pipelineLayouts->add("lighting.tiled", pipelineLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("lighting.tiled");
+		targetDS = resources.descriptorSets->add("lighting.tiled", descriptorAllocInfo);
+		imageDescriptors = {
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[1].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlur.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, lightingTarget.view, VK_IMAGE_LAYOUT_GENERAL),
+		};
+		writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),				// Binding 0 : Depth texture target
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),				// Binding 1 : Normals texture target
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[2]),				// Binding 2 : Albedo texture target
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[3]),				// Binding 3 : SSAO blurred
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &storageBuffers.lights.descriptor),			// Binding 4 : Lights
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5, &imageDescriptors[4]),						// Binding 5 : Lighting result
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 6, &uniformBuffers.lightCulling.descriptor),	// Binding 6 : Inverse projection
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+		// Clustered light assignment
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),				// Lights
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),				// Cluster light lists
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),				// Cluster parameters
+		};
+		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		resources.descriptorSetLayouts->add("lighting.clusters", setLayoutCreateInfo);
+		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("lighting.clusters");
+		resources.pipelineLayouts->add("lighting.clusters", pipelineLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("lighting.clusters");
+		targetDS = resources.descriptorSets->add("lighting.clusters", descriptorAllocInfo);
+		writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffers.lights.descriptor),			// Binding 0 : Lights
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &storageBuffers.clusters.descriptor),		// Binding 1 : Cluster light lists
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.lightCulling.descriptor),	// Binding 2 : Cluster parameters
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+		// Light volumes
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),										// Scene matrices
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),								// Depth texture target
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),								// Normals texture target
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),								// Albedo texture target
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),								// SSAO blurred
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 5),		// Lights
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),										// Inverse projection
+		};
+		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		resources.descriptorSetLayouts->add("lighting.volumes", setLayoutCreateInfo);
+		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("lighting.volumes");
+		resources.pipelineLayouts->add("lighting.volumes", pipelineLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("lighting.volumes");
+		targetDS = resources.descriptorSets->add("lighting.volumes", descriptorAllocInfo);
+		// Depth is used as the attachment of the light volume pass at the same time
+		imageDescriptors = {
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_GENERAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[1].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlur.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.sceneMatrices.descriptor),	// Binding 0 : Scene matrices
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),				// Binding 1 : Depth texture target
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),				// Binding 2 : Normals texture target
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[2]),				// Binding 3 : Albedo texture target
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &imageDescriptors[3]),				// Binding 4 : SSAO blurred
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &storageBuffers.lights.descriptor),			// Binding 5 : Lights
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 6, &uniformBuffers.lightCulling.descriptor),	// Binding 6 : Inverse projection
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
 		// Particle systems
 		setLayoutBindings = {
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),			// FS Position+Depth
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),			// FS Depth
 		};
 		setLayoutCreateInfo.pBindings = setLayoutBindings.data();
 		setLayoutCreateInfo.bindingCount = setLayoutBindings.size();
@@ -1795,7 +3888,7 @@ public:
 		imageDescriptors = {
 			vkTools::initializers::descriptorImageInfo(particleSampler, resources.textures->get("particle.smoke").view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
 			vkTools::initializers::descriptorImageInfo(particleSampler, resources.textures->get("particle.fire").view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
 		};
 		writeDescriptorSets = {
 			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.sceneMatrices.descriptor),
@@ -1805,208 +3898,727 @@ public:
 		};
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
+		// SSAO downsample
+		// Depth and normals for the half resolution SSAO
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Depth
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Normals
+		};
+		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		resources.descriptorSetLayouts->add("ssao.downsample", setLayoutCreateInfo);
+		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.downsample");
+		resources.pipelineLayouts->add("ssao.downsample", pipelineLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.downsample");
+		targetDS = resources.descriptorSets->add("ssao.downsample", descriptorAllocInfo);
+		imageDescriptors = {
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+		};
+		writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),				// FS Depth
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),				// FS Normals
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
 		// SSAO Generation
+		// One set for the full resolution G-Buffer and one for the downsampled depth and normals
 		setLayoutBindings = {
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Position+Depth
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Depth
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Normals
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),						// FS SSAO Noise
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),								// FS SSAO Kernel UBO
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),								// FS Params UBO 
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),								// FS Temporal params UBO
 		};
 		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		resources.descriptorSetLayouts->add("ssao.generate", setLayoutCreateInfo);
 		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.generate");
 		resources.pipelineLayouts->add("ssao.generate", pipelineLayoutCreateInfo);
 		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.generate");
-		targetDS = resources.descriptorSets->add("ssao.generate", descriptorAllocInfo);
-		imageDescriptors = {
-			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL),
-			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[1].view, VK_IMAGE_LAYOUT_GENERAL),
+		struct {
+			std::string name;
+			VkDescriptorImageInfo depth;
+			VkDescriptorImageInfo normals;
+		} ssaoGenerateSets[] = {
+			{
+				"ssao.generate",
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
+			{
+				"ssao.generate.half",
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoDownsample.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoDownsample.attachments[1].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			},
 		};
-		writeDescriptorSets = {
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),				// FS Position+Depth
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),				// FS Normals
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.ssaoNoise.descriptor),		// FS SSAO Noise
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),		// FS SSAO Kernel UBO
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
+		for (auto& set : ssaoGenerateSets)
+		{
+			targetDS = resources.descriptorSets->add(set.name, descriptorAllocInfo);
+			writeDescriptorSets = {
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &set.depth),							// FS Depth
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &set.normals),						// FS Normals
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.ssaoNoise.descriptor),		// FS SSAO Noise
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),		// FS SSAO Kernel UBO
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &uniformBuffers.ssaoTemporal.descriptor),	// FS SSAO Temporal params UBO
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
+
+		// Temporal SSAO resolve
+		// Blends the current occlusion with the reprojected history, for both quality tiers
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Sampler SSAO
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Depth at SSAO resolution
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),						// FS History
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),								// FS Params UBO
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),								// FS Temporal params UBO
 		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		resources.descriptorSetLayouts->add("ssao.temporal", setLayoutCreateInfo);
+		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.temporal");
+		resources.pipelineLayouts->add("ssao.temporal", pipelineLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.temporal");
+		struct {
+			std::string name;
+			VkDescriptorImageInfo ssao;
+			VkDescriptorImageInfo depth;
+			VkDescriptorImageInfo history;
+		} ssaoTemporalSets[] = {
+			{
+				"ssao.temporal",
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+				vkTools::initializers::descriptorImageInfo(colorSampler, ssaoHistory.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			},
+			{
+				"ssao.temporal.half",
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoHalf.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+				vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoDownsample.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+				vkTools::initializers::descriptorImageInfo(colorSampler, ssaoHalfHistory.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			},
+		};
+		for (auto& set : ssaoTemporalSets)
+		{
+			targetDS = resources.descriptorSets->add(set.name, descriptorAllocInfo);
+			writeDescriptorSets = {
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &set.ssao),							// FS Sampler SSAO
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &set.depth),							// FS Depth at SSAO resolution
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &set.history),						// FS History
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoTemporal.descriptor),	// FS SSAO Temporal params UBO
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
 
 		// SSAO Blur
+		// Separable bilateral blur, samples are weighted by their depth difference to the depth of the target pixel
+		// The vertical pass of the half resolution chain has a full resolution target, which upsamples the occlusion
 		setLayoutBindings = {
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),						// FS Sampler SSAO
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),						// FS Depth at SSAO resolution
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),						// FS Depth at target resolution
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),								// FS Params UBO
 		};
 		setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		resources.descriptorSetLayouts->add("ssao.blur", setLayoutCreateInfo);
 		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.blur");
 		resources.pipelineLayouts->add("ssao.blur", pipelineLayoutCreateInfo);
 		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.blur");
-		targetDS = resources.descriptorSets->add("ssao.blur", descriptorAllocInfo);
-		imageDescriptors = {
-			vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL),
-		};
-		writeDescriptorSets = {
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
+		const VkDescriptorImageInfo fullDepth = vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		const VkDescriptorImageInfo halfDepth = vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoDownsample.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		struct {
+			std::string name;
+			VkDescriptorImageInfo ssao;
+			VkDescriptorImageInfo sourceDepth;
+			VkDescriptorImageInfo targetDepth;
+			// Compute blur only
+			std::string computeName;
+			VkDescriptorImageInfo target;
+		} ssaoBlurSets[] = {
+			{
+				"ssao.blur.horizontal", vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), fullDepth, fullDepth,
+				"ssao.blur.compute.horizontal", vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoBlurTemp.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
+			{
+				"ssao.blur.vertical", vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlurTemp.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), fullDepth, fullDepth,
+				"ssao.blur.compute.vertical", vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoBlur.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
+			{
+				"ssao.blur.horizontal.half", vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoHalf.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), halfDepth, halfDepth,
+				"ssao.blur.compute.horizontal.half", vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoHalfBlurTemp.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
+			{
+				"ssao.blur.vertical.half", vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoHalfBlurTemp.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), halfDepth, fullDepth,
+				"ssao.blur.compute.vertical.half", vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoBlur.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
+			// Temporal SSAO, the horizontal pass reads the accumulated occlusion
+			{
+				"ssao.blur.horizontal.temporal", vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoResolve.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), fullDepth, fullDepth,
+				"ssao.blur.compute.horizontal.temporal", vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoBlurTemp.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
+			{
+				"ssao.blur.horizontal.half.temporal", vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoHalfResolve.attachments[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), halfDepth, halfDepth,
+				"ssao.blur.compute.horizontal.half.temporal", vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoHalfBlurTemp.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL)
+			},
 		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		for (auto& set : ssaoBlurSets)
+		{
+			targetDS = resources.descriptorSets->add(set.name, descriptorAllocInfo);
+			writeDescriptorSets = {
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &set.ssao),							// FS Sampler SSAO
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &set.sourceDepth),					// FS Depth at SSAO resolution
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &set.targetDepth),					// FS Depth at target resolution
+				vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		}
+
+		// SSAO compute blur
+		// Same inputs as the fragment version, the result is written to a storage image
+		if (ssaoComputeSupported)
+		{
+			setLayoutBindings = {
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),					// SSAO
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),					// Depth at SSAO resolution
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 2),					// Depth at target resolution
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),							// Params UBO
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 4),							// Blur target
+			};
+			setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+			resources.descriptorSetLayouts->add("ssao.blur.compute", setLayoutCreateInfo);
+			pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.blur.compute");
+			resources.pipelineLayouts->add("ssao.blur.compute", pipelineLayoutCreateInfo);
+			descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.blur.compute");
+			for (auto& set : ssaoBlurSets)
+			{
+				targetDS = resources.descriptorSets->add(set.computeName, descriptorAllocInfo);
+				writeDescriptorSets = {
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &set.ssao),							// Binding 0 : SSAO
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &set.sourceDepth),					// Binding 1 : Depth at SSAO resolution
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &set.targetDepth),					// Binding 2 : Depth at target resolution
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoParams.descriptor),		// Binding 3 : SSAO Params UBO
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4, &set.target),								// Binding 4 : Blur target
+				};
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+			}
+		}
+
+		// Horizon based AO
+		if (ssaoComputeSupported)
+		{
+			// Depth mip chain, one set per level reading the level above (or the G-Buffer depth)
+			setLayoutBindings = {
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),					// Source level
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),							// Target level
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),							// Params UBO
+			};
+			setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+			resources.descriptorSetLayouts->add("ssao.depthmips", setLayoutCreateInfo);
+			pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.depthmips");
+			resources.pipelineLayouts->add("ssao.depthmips", pipelineLayoutCreateInfo);
+			descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.depthmips");
+			for (uint32_t level = 0; level < SSAO_DEPTH_MIP_LEVELS; level++)
+			{
+				targetDS = resources.descriptorSets->add("ssao.depthmips." + std::to_string(level), descriptorAllocInfo);
+				imageDescriptors = {
+					(level == 0) ?
+						vkTools::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL) :
+						vkTools::initializers::descriptorImageInfo(colorSampler, ssaoDepthMips.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL),
+					vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, ssaoDepthMips.levelViews[level], VK_IMAGE_LAYOUT_GENERAL),
+				};
+				writeDescriptorSets = {
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),				// Binding 0 : Source level
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &imageDescriptors[1]),						// Binding 1 : Target level
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.ssaoParams.descriptor),		// Binding 2 : SSAO Params UBO
+				};
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+			}
+
+			// Occlusion, one set per quality tier
+			setLayoutBindings = {
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),					// Depth at SSAO resolution
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),					// Normals at SSAO resolution
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 2),					// Linear depth mip chain
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),							// Params UBO
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),							// Temporal params UBO
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 5),							// SSAO target
+			};
+			setLayoutCreateInfo = vkTools::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+			resources.descriptorSetLayouts->add("ssao.horizon", setLayoutCreateInfo);
+			pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.horizon");
+			resources.pipelineLayouts->add("ssao.horizon", pipelineLayoutCreateInfo);
+			descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("ssao.horizon");
+			VkDescriptorImageInfo depthMips = vkTools::initializers::descriptorImageInfo(colorSampler, ssaoDepthMips.view, VK_IMAGE_LAYOUT_GENERAL);
+			struct {
+				std::string name;
+				VkDescriptorImageInfo depth;
+				VkDescriptorImageInfo normals;
+				VkDescriptorImageInfo target;
+			} ssaoHorizonSets[] = {
+				{ "ssao.horizon", ssaoGenerateSets[0].depth, ssaoGenerateSets[0].normals, vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssao.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL) },
+				{ "ssao.horizon.half", ssaoGenerateSets[1].depth, ssaoGenerateSets[1].normals, vkTools::initializers::descriptorImageInfo(VK_NULL_HANDLE, frameBuffers.ssaoHalf.attachments[0].view, VK_IMAGE_LAYOUT_GENERAL) },
+			};
+			for (auto& set : ssaoHorizonSets)
+			{
+				targetDS = resources.descriptorSets->add(set.name, descriptorAllocInfo);
+				writeDescriptorSets = {
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &set.depth),							// Binding 0 : Depth at SSAO resolution
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &set.normals),						// Binding 1 : Normals at SSAO resolution
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &depthMips),							// Binding 2 : Linear depth mip chain
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoParams.descriptor),		// Binding 3 : SSAO Params UBO
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoTemporal.descriptor),	// Binding 4 : SSAO Temporal params UBO
+					vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5, &set.target),								// Binding 5 : SSAO target
+				};
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+			}
+		}
 
 		// G-Buffer creation (offscreen scene rendering)
+		// Descriptor sets are split by update frequency:
+		// Set 0 : Per frame (scene matrices)
+		// Set 1 : Per pass (material and instance storage buffers, written once the scene has been loaded)
+		// Set 2 : Per material (textures), or the scene texture array for the bindless path
+		// Instance and material indices are passed per draw as push constants
 		setLayoutBindings = {
 			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),				// Vertex shader uniform buffer
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),		// Diffuse
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),		// Specular
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),		// Bump
 		};
 		setLayoutCreateInfo.pBindings = setLayoutBindings.data();
 		setLayoutCreateInfo.bindingCount = setLayoutBindings.size();
-		resources.descriptorSetLayouts->add("offscreen", setLayoutCreateInfo);
-		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("offscreen");
-		resources.pipelineLayouts->add("offscreen", pipelineLayoutCreateInfo);
-		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("offscreen");
-		targetDS = resources.descriptorSets->add("offscreen", descriptorAllocInfo);
+		resources.descriptorSetLayouts->add("scene.frame", setLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("scene.frame");
+		targetDS = resources.descriptorSets->add("scene.frame", descriptorAllocInfo);
 		writeDescriptorSets = {
 			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.sceneMatrices.descriptor),// Binding 0 : Vertex shader uniform buffer			
 		};
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
-		// Skysphere
 		setLayoutBindings = {
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),				// Material parameters
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1),				// Instance transforms
 		};
 		setLayoutCreateInfo.pBindings = setLayoutBindings.data();
 		setLayoutCreateInfo.bindingCount = setLayoutBindings.size();
-		resources.descriptorSetLayouts->add("skysphere", setLayoutCreateInfo);
-		pipelineLayoutCreateInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("skysphere");
-		resources.pipelineLayouts->add("skysphere", pipelineLayoutCreateInfo);
-		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("skysphere");
-		targetDS = resources.descriptorSets->add("skysphere", descriptorAllocInfo);
-		VkDescriptorImageInfo imgDesc;
-		imgDesc = resources.textures->get("skysphere").descriptor;
-		writeDescriptorSets = {
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.sceneMatrices.descriptor),
-			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imgDesc),
+		resources.descriptorSetLayouts->add("scene.pass", setLayoutCreateInfo);
+		descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("scene.pass");
+		resources.descriptorSets->add("scene.pass", descriptorAllocInfo);
+
+		setLayoutBindings = {
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),		// Diffuse
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),		// Specular
+			vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),		// Bump
+		};
+		setLayoutCreateInfo.pBindings = setLayoutBindings.data();
+		setLayoutCreateInfo.bindingCount = setLayoutBindings.size();
+		resources.descriptorSetLayouts->add("scene.material", setLayoutCreateInfo);
+
+		VkPushConstantRange pushConstantRange = vkTools::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(DrawData), 0);
+		std::array<VkDescriptorSetLayout, 3> sceneSetLayouts = {
+			resources.descriptorSetLayouts->get("scene.frame"),
+			resources.descriptorSetLayouts->get("scene.pass"),
+			resources.descriptorSetLayouts->get("scene.material"),
+		};
+		VkPipelineLayoutCreateInfo scenePipelineLayoutCreateInfo = vkTools::initializers::pipelineLayoutCreateInfo(sceneSetLayouts.data(), static_cast<uint32_t>(sceneSetLayouts.size()));
+		scenePipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		scenePipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		resources.pipelineLayouts->add("offscreen", scenePipelineLayoutCreateInfo);
+
+		// Bindless path replaces the per-material sets with one set containing all scene textures
+		// Texture array is written once the scene has been loaded (see updateBindlessDescriptorSet)
+		if (bindlessSupported)
+		{
+			setLayoutBindings = {
+				vkTools::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),		// Scene texture array
+			};
+			setLayoutBindings[0].descriptorCount = BINDLESS_TEXTURE_COUNT;
+			setLayoutCreateInfo.pBindings = setLayoutBindings.data();
+			setLayoutCreateInfo.bindingCount = setLayoutBindings.size();
+			resources.descriptorSetLayouts->add("scene.textures", setLayoutCreateInfo);
+			sceneSetLayouts[2] = resources.descriptorSetLayouts->get("scene.textures");
+			resources.pipelineLayouts->add("offscreen.bindless", scenePipelineLayoutCreateInfo);
+			descriptorAllocInfo.pSetLayouts = resources.descriptorSetLayouts->getPtr("scene.textures");
+			resources.descriptorSets->add("scene.textures", descriptorAllocInfo);
+		}
+	}
+
+	// Pipeline description with the state shared by most of the passes
+	GraphicsPipelineDesc getPipelineDesc(std::string name, std::string layout, VkRenderPass renderPass, std::string vertexShader, std::string fragmentShader)
+	{
+		GraphicsPipelineDesc pipeline(name, resources.pipelineLayouts->get(layout), renderPass);
+		pipeline.addShader(getAssetPath() + "shaders/" + vertexShader, VK_SHADER_STAGE_VERTEX_BIT);
+		pipeline.addShader(getAssetPath() + "shaders/" + fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT);
+		pipeline.vertexInputState = &vertices.inputState;
+		pipeline.blendAttachmentStates = { vkTools::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE) };
+		pipeline.relaxedRasterizationOrder = enableAMDRasterizationOrder;
+		return pipeline;
+	}
+
+	// Final composition pipeline, SSAO usage, the ambient factor and the lighting mode are baked in via specialization constants
+	GraphicsPipelineDesc getCompositionPipelineDesc(bool ssao, LightingMode mode)
+	{
+		struct SpecializationData {
+			int32_t enableSSAO;
+			float ambientFactor;
+			int32_t resolveLighting;
+			int32_t clusteredLighting;
+		} specializationData;
+		specializationData.enableSSAO = ssao ? 1 : 0;
+		specializationData.ambientFactor = ambientFactor;
+		specializationData.resolveLighting = ((mode == LIGHTING_TILED) || (mode == LIGHTING_VOLUMES)) ? 1 : 0;
+		specializationData.clusteredLighting = (mode == LIGHTING_CLUSTERED) ? 1 : 0;
+
+		std::vector<VkSpecializationMapEntry> specializationMapEntries;
+		specializationMapEntries = {
+			vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, enableSSAO), sizeof(int32_t)),
+			vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, ambientFactor), sizeof(float)),
+			vkTools::initializers::specializationMapEntry(2, offsetof(SpecializationData, resolveLighting), sizeof(int32_t)),
+			vkTools::initializers::specializationMapEntry(3, offsetof(SpecializationData, clusteredLighting), sizeof(int32_t)),
+		};
+
+		GraphicsPipelineDesc pipeline = getPipelineDesc(getCompositionPipelineName(ssao, mode), "composition", renderPass, "composition.vert.spv", "composition.frag.spv");
+		pipeline.setSpecialization(specializationMapEntries, specializationData);
+		return pipeline;
+	}
+
+	// Tiled lighting compute pipeline, takes the same specialization constants as the composition
+	GraphicsPipelineDesc getTiledLightingPipelineDesc(bool ssao)
+	{
+		struct SpecializationData {
+			int32_t enableSSAO;
+			float ambientFactor;
+		} specializationData;
+		specializationData.enableSSAO = ssao ? 1 : 0;
+		specializationData.ambientFactor = ambientFactor;
+
+		std::vector<VkSpecializationMapEntry> specializationMapEntries;
+		specializationMapEntries = {
+			vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, enableSSAO), sizeof(int32_t)),
+			vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, ambientFactor), sizeof(float)),
 		};
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+
+		GraphicsPipelineDesc pipeline(ssao ? "lighting.tiled.ssao.enabled" : "lighting.tiled.ssao.disabled", resources.pipelineLayouts->get("lighting.tiled"), VK_NULL_HANDLE);
+		pipeline.addShader(getAssetPath() + "shaders/tiled_lighting.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		pipeline.setSpecialization(specializationMapEntries, specializationData);
+		return pipeline;
 	}
 
-	void preparePipelines()
+	// Light assignment for clustered lighting, independent of the composition's specialization constants
+	GraphicsPipelineDesc getClusterAssignmentPipelineDesc()
 	{
-		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
-			vkTools::initializers::pipelineInputAssemblyStateCreateInfo(
-				VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-				0,
-				VK_FALSE);
+		GraphicsPipelineDesc pipeline("lighting.clusters", resources.pipelineLayouts->get("lighting.clusters"), VK_NULL_HANDLE);
+		pipeline.addShader(getAssetPath() + "shaders/cluster_lights.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		return pipeline;
+	}
 
-		VkPipelineRasterizationStateCreateInfo rasterizationState =
-			vkTools::initializers::pipelineRasterizationStateCreateInfo(
-				VK_POLYGON_MODE_FILL,
-				VK_CULL_MODE_BACK_BIT,
-				VK_FRONT_FACE_CLOCKWISE,
-				0);
+	// Ambient term of the light volume path, written before the volumes are accumulated on top
+	GraphicsPipelineDesc getLightVolumeAmbientPipelineDesc(bool ssao)
+	{
+		struct SpecializationData {
+			int32_t enableSSAO;
+			float ambientFactor;
+		} specializationData;
+		specializationData.enableSSAO = ssao ? 1 : 0;
+		specializationData.ambientFactor = ambientFactor;
+
+		std::vector<VkSpecializationMapEntry> specializationMapEntries;
+		specializationMapEntries = {
+			vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, enableSSAO), sizeof(int32_t)),
+			vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, ambientFactor), sizeof(float)),
+		};
 
-		VkPipelineColorBlendAttachmentState blendAttachmentState =
-			vkTools::initializers::pipelineColorBlendAttachmentState(
-				0xf,
-				VK_FALSE);
+		GraphicsPipelineDesc pipeline = getPipelineDesc(ssao ? "lighting.volumes.ambient.ssao.enabled" : "lighting.volumes.ambient.ssao.disabled", "lighting.volumes", frameBuffers.lightVolumes.renderPass, "fullscreen.vert.spv", "light_ambient.frag.spv");
+		pipeline.setSpecialization(specializationMapEntries, specializationData);
+		pipeline.vertexInputState = &emptyInputState;
+		pipeline.depthTest = false;
+		pipeline.depthWrite = false;
+		pipeline.cullMode = VK_CULL_MODE_NONE;
+		return pipeline;
+	}
 
-		VkPipelineColorBlendStateCreateInfo colorBlendState =
-			vkTools::initializers::pipelineColorBlendStateCreateInfo(
-				1,
-				&blendAttachmentState);
+	// Composition subpass of the merged G-Buffer pass, supports full screen and clustered lighting
+	GraphicsPipelineDesc getMergedCompositionPipelineDesc(LightingMode mode)
+	{
+		struct SpecializationData {
+			float ambientFactor;
+			int32_t clusteredLighting;
+		} specializationData;
+		specializationData.ambientFactor = ambientFactor;
+		specializationData.clusteredLighting = (mode == LIGHTING_CLUSTERED) ? 1 : 0;
+
+		std::vector<VkSpecializationMapEntry> specializationMapEntries;
+		specializationMapEntries = {
+			vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, ambientFactor), sizeof(float)),
+			vkTools::initializers::specializationMapEntry(3, offsetof(SpecializationData, clusteredLighting), sizeof(int32_t)),
+		};
 
-		VkPipelineDepthStencilStateCreateInfo depthStencilState =
-			vkTools::initializers::pipelineDepthStencilStateCreateInfo(
-				VK_TRUE,
-				VK_TRUE,
-				VK_COMPARE_OP_LESS_OR_EQUAL);
+		GraphicsPipelineDesc pipeline = getPipelineDesc(getMergedCompositionPipelineName(mode), "composition.merged", mergedPass.renderPass, "fullscreen.vert.spv", "composition_subpass.frag.spv");
+		pipeline.setSpecialization(specializationMapEntries, specializationData);
+		pipeline.subpass = 1;
+		pipeline.vertexInputState = &emptyInputState;
+		pipeline.depthTest = false;
+		pipeline.depthWrite = false;
+		pipeline.cullMode = VK_CULL_MODE_NONE;
+		return pipeline;
+	}
 
-		VkPipelineViewportStateCreateInfo viewportState =
-			vkTools::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
+	std::string getMergedCompositionPipelineName(LightingMode mode)
+	{
+		return (mode == LIGHTING_CLUSTERED) ? "composition.merged.clustered" : "composition.merged";
+	}
 
-		VkPipelineMultisampleStateCreateInfo multisampleState =
-			vkTools::initializers::pipelineMultisampleStateCreateInfo(
-				VK_SAMPLE_COUNT_1_BIT,
-				0);
+	// With tiled lighting and light volumes the composition only outputs the result of the lighting pass
+	std::string getCompositionPipelineName(bool ssao, LightingMode mode)
+	{
+		switch (mode)
+		{
+		case LIGHTING_TILED:
+		case LIGHTING_VOLUMES:
+			return "composition.resolve";
+		case LIGHTING_CLUSTERED:
+			return ssao ? "composition.clustered.ssao.enabled" : "composition.clustered.ssao.disabled";
+		default:
+			return ssao ? "composition.ssao.enabled" : "composition.ssao.disabled";
+		}
+	}
 
-		std::vector<VkDynamicState> dynamicStateEnables = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_SCISSOR
+	// Pipelines depending on the ambient factor, recompiled when it changes
+	std::vector<GraphicsPipelineDesc> getLightingPipelineDescs()
+	{
+		std::vector<GraphicsPipelineDesc> pipelines = {
+			getCompositionPipelineDesc(true, LIGHTING_FULLSCREEN),
+			getCompositionPipelineDesc(false, LIGHTING_FULLSCREEN),
+			getLightVolumeAmbientPipelineDesc(true),
+			getLightVolumeAmbientPipelineDesc(false),
+			getMergedCompositionPipelineDesc(LIGHTING_FULLSCREEN),
 		};
-		VkPipelineDynamicStateCreateInfo dynamicState =
-			vkTools::initializers::pipelineDynamicStateCreateInfo(
-				dynamicStateEnables.data(),
-				dynamicStateEnables.size(),
-				0);
+		if (computeLightingSupported)
+		{
+			pipelines.push_back(getMergedCompositionPipelineDesc(LIGHTING_CLUSTERED));
+			pipelines.push_back(getTiledLightingPipelineDesc(true));
+			pipelines.push_back(getTiledLightingPipelineDesc(false));
+			pipelines.push_back(getCompositionPipelineDesc(true, LIGHTING_CLUSTERED));
+			pipelines.push_back(getCompositionPipelineDesc(false, LIGHTING_CLUSTERED));
+		}
+		return pipelines;
+	}
+
+	// The composition subpass can only read the G-Buffer values of its own pixel
+	// SSAO and the debug display sample neighbouring pixels, tiled lighting and light volumes have their own passes between G-Buffer and composition
+	bool mergedPassApplicable(bool debug, bool ssao, LightingMode lighting)
+	{
+		return !debug && !ssao && ((lighting == LIGHTING_FULLSCREEN) || (lighting == LIGHTING_CLUSTERED));
+	}
 
-		// Final composition pipeline
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+	// True if the merged G-Buffer pass is used with the current render modes
+	bool useMergedPass()
+	{
+		return enableMergedPass && mergedPassApplicable(debugDisplay, enableSSAO, lightingMode);
+	}
 
-		VkGraphicsPipelineCreateInfo pipelineCreateInfo(vkTools::initializers::pipelineCreateInfo());
+	bool useDepthPrepass()
+	{
+		return enableDepthPrepass && !useMergedPass();
+	}
 
-		pipelineCreateInfo.pVertexInputState = &vertices.inputState;
-		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-		pipelineCreateInfo.pRasterizationState = &rasterizationState;
-		pipelineCreateInfo.pColorBlendState = &colorBlendState;
-		pipelineCreateInfo.pMultisampleState = &multisampleState;
-		pipelineCreateInfo.pViewportState = &viewportState;
-		pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-		pipelineCreateInfo.pDynamicState = &dynamicState;
-		pipelineCreateInfo.stageCount = shaderStages.size();
-		pipelineCreateInfo.pStages = shaderStages.data();
-		pipelineCreateInfo.flags = VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
+	// Pipelines used for rendering with the given modes
+	std::vector<std::string> getRequiredPipelines(bool debug, bool ssao, SSAOQuality ssaoQuality, SSAOMethod ssaoMethod, bool ssaoComputeBlur, bool ssaoTemporal, bool bindless, LightingMode lighting, bool merged, bool depthPrepass)
+	{
+		std::vector<std::string> names = { getCompositionPipelineName(ssao, lighting), "particlesystem" };
+		if (lighting == LIGHTING_TILED)
+		{
+			names.push_back(ssao ? "lighting.tiled.ssao.enabled" : "lighting.tiled.ssao.disabled");
+		}
+		if (lighting == LIGHTING_CLUSTERED)
+		{
+			names.push_back("lighting.clusters");
+		}
+		if (lighting == LIGHTING_VOLUMES)
+		{
+			names.push_back(ssao ? "lighting.volumes.ambient.ssao.enabled" : "lighting.volumes.ambient.ssao.disabled");
+			names.push_back("lighting.volumes.stencil");
+			names.push_back(ssao ? "lighting.volumes.ssao.enabled" : "lighting.volumes.ssao.disabled");
+		}
+		if (debug)
+		{
+			names.push_back("debugdisplay");
+		}
+		if (ssao)
+		{
+			if (ssaoMethod == SSAO_METHOD_HEMISPHERE)
+			{
+				names.push_back(ssaoTemporal ? "ssao.generate.temporal" : "ssao.generate");
+			}
+			else
+			{
+				names.push_back(ssaoMethods[ssaoMethod].pipeline);
+				names.push_back("ssao.depthmips.linearize");
+				names.push_back("ssao.depthmips.downsample");
+			}
+			if (ssaoTemporal)
+			{
+				names.push_back("ssao.temporal");
+			}
+			names.push_back(ssaoComputeBlur ? "ssao.blur.compute.horizontal" : "ssao.blur.horizontal");
+			names.push_back(ssaoComputeBlur ? "ssao.blur.compute.vertical" : "ssao.blur.vertical");
+			if (ssaoQuality == SSAO_QUALITY_LOW)
+			{
+				names.push_back("ssao.downsample");
+			}
+		}
+		// Per-material path is always required, as bindless may still be disabled after loading the scene
+		for (uint32_t variant : getMaterialVariants())
+		{
+			names.push_back(getMaterialPipelineName(variant, false));
+			if (bindless)
+			{
+				names.push_back(getMaterialPipelineName(variant, true));
+			}
+		}
+		if (depthPrepass)
+		{
+			names.push_back("depthprepass");
+			for (uint32_t variant : getMaterialVariants())
+			{
+				if (!(variant & MATERIAL_VARIANT_ALPHA))
+				{
+					names.push_back(getMaterialPipelineName(variant, bindless, false, true));
+				}
+			}
+		}
+		if (merged && mergedPassApplicable(debug, ssao, lighting))
+		{
+			names.push_back(getMergedCompositionPipelineName(lighting));
+			names.push_back("particlesystem.merged");
+			for (uint32_t variant : getMaterialVariants())
+			{
+				names.push_back(getMaterialPipelineName(variant, false, true));
+				if (bindless)
+				{
+					names.push_back(getMaterialPipelineName(variant, true, true));
+				}
+			}
+		}
+		return names;
+	}
 
-		VkPipelineRasterizationStateRasterizationOrderAMD rasterAMD{};
-		if (enableAMDRasterizationOrder)
+	// All material variants that may be used by the scene, alpha masked materials never use normal maps
+	std::vector<uint32_t> getMaterialVariants()
+	{
+		std::vector<uint32_t> variants;
+		for (uint32_t variant = 0; variant < MATERIAL_VARIANT_COUNT; variant++)
 		{
-			rasterAMD.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_RASTERIZATION_ORDER_AMD;
-			rasterAMD.rasterizationOrder = VK_RASTERIZATION_ORDER_RELAXED_AMD;
-			rasterizationState.pNext = &rasterAMD;
+			if ((variant & MATERIAL_VARIANT_ALPHA) && (variant & MATERIAL_VARIANT_NORMALMAP))
+			{
+				continue;
+			}
+			variants.push_back(variant);
 		}
+		return variants;
+	}
 
-		// Final composition pipeline
+	// Merged variants render into the first subpass of the merged G-Buffer pass
+	// Depth equal variants of opaque materials test against the depth of the pre-pass without writing it
+	std::string getMaterialPipelineName(uint32_t variant, bool bindless, bool merged = false, bool depthEqual = false)
+	{
+		std::string name = (variant & MATERIAL_VARIANT_ALPHA) ? "scene.alpha" : "scene.opaque";
+		if (variant & MATERIAL_VARIANT_NORMALMAP)
+		{
+			name += ".normalmap";
+		}
+		if (variant & MATERIAL_VARIANT_SPECULARMAP)
+		{
+			name += ".specularmap";
+		}
+		if (bindless)
+		{
+			name += ".bindless";
+		}
+		if (depthEqual)
 		{
-			pipelineCreateInfo.layout = resources.pipelineLayouts->get("composition");
-			pipelineCreateInfo.renderPass = renderPass;
+			name += ".depthequal";
+		}
+		return merged ? name + ".merged" : name;
+	}
 
-			shaderStages[0] = loadShader(getAssetPath() + "shaders/composition.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader(getAssetPath() + "shaders/composition.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Pipelines are described up front and created in parallel on worker threads
+	// Creation of the pipelines required for the initial render modes continues while the scene is loaded, see finishPipelines()
+	// All other variants are compiled in the background and picked up by updatePipelines()
+	void preparePipelines()
+	{
+		pipelineCompiler = new PipelineCompiler(device, pipelineCache, shaderPack);
+		const VkPipelineColorBlendAttachmentState opaqueBlendAttachmentState = vkTools::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
 
-			struct SpecializationData {
-				int32_t enableSSAO = 1;
-				float ambientFactor = 0.15f;
-			} specializationData;
+		std::vector<GraphicsPipelineDesc> pipelines;
 
-			std::vector<VkSpecializationMapEntry> specializationMapEntries;
-			specializationMapEntries = {
-				vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, enableSSAO), sizeof(int32_t)),
-				vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, ambientFactor), sizeof(float)),
-			};
-			VkSpecializationInfo specializationInfo = vkTools::initializers::specializationInfo(specializationMapEntries.size(), specializationMapEntries.data(), sizeof(specializationData), &specializationData);
-			shaderStages[1].pSpecializationInfo = &specializationInfo;
+		// The returned reference is only valid until the next call
+		auto addPipeline = [&](std::string name, std::string layout, VkRenderPass renderPass, std::string vertexShader, std::string fragmentShader) -> GraphicsPipelineDesc&
+		{
+			pipelines.push_back(getPipelineDesc(name, layout, renderPass, vertexShader, fragmentShader));
+			return pipelines.back();
+		};
 
-			// SSAO enabled
-			resources.pipelines->addGraphicsPipeline("composition.ssao.enabled", pipelineCreateInfo, pipelineCache);
-			// SSAO disabled
-			specializationData.enableSSAO = 0;
-			resources.pipelines->addGraphicsPipeline("composition.ssao.disabled", pipelineCreateInfo, pipelineCache);
+		// Final composition and light culling pipelines
+		pipelines = getLightingPipelineDescs();
+		pipelines.push_back(getCompositionPipelineDesc(true, LIGHTING_TILED));
+		if (computeLightingSupported)
+		{
+			pipelines.push_back(getClusterAssignmentPipelineDesc());
 		}
 
-		// Derivate info for other pipelines
-		pipelineCreateInfo.flags = VK_PIPELINE_CREATE_DERIVATIVE_BIT;
-		pipelineCreateInfo.basePipelineIndex = -1;
-		pipelineCreateInfo.basePipelineHandle = resources.pipelines->get("composition.ssao.enabled");
+		// Light volumes
+		// Z-fail stencil pass marks the pixels inside of a light's volume, the shading pass
+		// then only lights those and clears their stencil value for the next light
+		{
+			GraphicsPipelineDesc pipeline("lighting.volumes.stencil", resources.pipelineLayouts->get("lighting.volumes"), frameBuffers.lightVolumes.renderPass);
+			pipeline.addShader(getAssetPath() + "shaders/light_volume.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			pipeline.vertexInputState = &lightVolumeVertices.inputState;
+			pipeline.cullMode = VK_CULL_MODE_NONE;
+			pipeline.depthWrite = false;
+			pipeline.depthCompareOp = VK_COMPARE_OP_LESS;
+			pipeline.stencilTest = true;
+			pipeline.stencilFront = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_KEEP, VK_STENCIL_OP_DECREMENT_AND_WRAP, VK_COMPARE_OP_ALWAYS, 0xff, 0xff, 0 };
+			pipeline.stencilBack = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_KEEP, VK_STENCIL_OP_INCREMENT_AND_WRAP, VK_COMPARE_OP_ALWAYS, 0xff, 0xff, 0 };
+			pipeline.blendAttachmentStates = { vkTools::initializers::pipelineColorBlendAttachmentState(0, VK_FALSE) };
+			pipeline.relaxedRasterizationOrder = enableAMDRasterizationOrder;
+			pipelines.push_back(pipeline);
+		}
+		for (uint32_t ssao = 0; ssao < 2; ssao++)
+		{
+			int32_t enableSSAO = ssao;
+			std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+				vkTools::initializers::specializationMapEntry(0, 0, sizeof(int32_t)),
+			};
+			// Back faces are rasterized so the volume is shaded when the camera is inside of it
+			GraphicsPipelineDesc &pipeline = addPipeline((ssao == 1) ? "lighting.volumes.ssao.enabled" : "lighting.volumes.ssao.disabled", "lighting.volumes", frameBuffers.lightVolumes.renderPass, "light_volume.vert.spv", "light_volume.frag.spv");
+			pipeline.setSpecialization(specializationMapEntries, enableSSAO);
+			pipeline.vertexInputState = &lightVolumeVertices.inputState;
+			pipeline.cullMode = VK_CULL_MODE_FRONT_BIT;
+			pipeline.depthTest = false;
+			pipeline.depthWrite = false;
+			pipeline.stencilTest = true;
+			pipeline.stencilFront = { VK_STENCIL_OP_KEEP, VK_STENCIL_OP_ZERO, VK_STENCIL_OP_KEEP, VK_COMPARE_OP_NOT_EQUAL, 0xff, 0xff, 0 };
+			pipeline.stencilBack = pipeline.stencilFront;
+			VkPipelineColorBlendAttachmentState &blendAttachmentState = pipeline.blendAttachmentStates[0];
+			blendAttachmentState.blendEnable = VK_TRUE;
+			blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+			blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+			blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+			blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+		}
 
 		// Debug display pipeline
-		shaderStages[0] = loadShader(getAssetPath() + "shaders/debug.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getAssetPath() + "shaders/debug.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		resources.pipelines->addGraphicsPipeline("debugdisplay", pipelineCreateInfo, pipelineCache);
+		addPipeline("debugdisplay", "composition", renderPass, "debug.vert.spv", "debug.frag.spv");
 
 		// Particle systems
 		{
-			inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
-			depthStencilState.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+			GraphicsPipelineDesc &pipeline = addPipeline("particlesystem", "particlesystem", renderPass, "particle.vert.spv", "particle.frag.spv");
+			pipeline.vertexInputState = &resources.particleSystems->inputState;
+			pipeline.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+			pipeline.depthCompareOp = VK_COMPARE_OP_ALWAYS;
 			// Premulitplied alpha
+			VkPipelineColorBlendAttachmentState &blendAttachmentState = pipeline.blendAttachmentStates[0];
 			blendAttachmentState.blendEnable = VK_TRUE;
 			blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
 			blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
@@ -2015,110 +4627,392 @@ public:
 			blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 			blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 			blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-			pipelineCreateInfo.pVertexInputState = &resources.particleSystems->inputState;
-			shaderStages[0] = loadShader(getAssetPath() + "shaders/particle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader(getAssetPath() + "shaders/particle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-			pipelineCreateInfo.layout = resources.pipelineLayouts->get("particlesystem");
-			resources.pipelines->addGraphicsPipeline("particlesystem", pipelineCreateInfo, pipelineCache);
-		}
 
-		pipelineCreateInfo.pVertexInputState = &vertices.inputState;
-		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		blendAttachmentState.blendEnable = VK_FALSE;
-		depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			// Merged G-Buffer pass: depth tested against the read-only depth attachment of the composition subpass
+			int32_t depthAttachmentTest = 1;
+			std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+				vkTools::initializers::specializationMapEntry(0, 0, sizeof(int32_t)),
+			};
+			GraphicsPipelineDesc mergedPipeline = pipeline;
+			mergedPipeline.name = "particlesystem.merged";
+			mergedPipeline.renderPass = mergedPass.renderPass;
+			mergedPipeline.subpass = 1;
+			mergedPipeline.setSpecialization(specializationMapEntries, depthAttachmentTest);
+			mergedPipeline.depthWrite = false;
+			mergedPipeline.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			pipelines.push_back(mergedPipeline);
+		}
 
 		// Fill G-Buffer
+		// One pipeline per material variant, features are baked in via specialization constants so
+		// materials without normal or specular maps skip those texture fetches (and the TBN setup)
+		{
+			struct SpecializationData {
+				int32_t discard;
+				// Only used by the bindless shader
+				int32_t textureCount = BINDLESS_TEXTURE_COUNT;
+				int32_t hasNormalMap;
+				int32_t hasSpecularMap;
+			} specializationData;
 
-		// Set constant parameters via specialization constants
-		struct SpecializationData {
-			float znear;
-			float zfar;
-			int32_t discard = 0;
-		} specializationData;
-
-		specializationData.znear = camera.znear;
-		specializationData.zfar = camera.zfar;
-
-		std::vector<VkSpecializationMapEntry> specializationMapEntries;
-		specializationMapEntries = {
-			vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, znear), sizeof(float)),
-			vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, zfar), sizeof(float)),
-			vkTools::initializers::specializationMapEntry(2, offsetof(SpecializationData, discard), sizeof(int32_t)),
-
-		};
-		VkSpecializationInfo specializationInfo = vkTools::initializers::specializationInfo(specializationMapEntries.size(), specializationMapEntries.data(), sizeof(specializationData), &specializationData);
-
-		shaderStages[0] = loadShader(getAssetPath() + "shaders/mrt.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getAssetPath() + "shaders/mrt.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		shaderStages[1].pSpecializationInfo = &specializationInfo;
-
-		pipelineCreateInfo.renderPass = frameBuffers.offscreen.renderPass;
-		pipelineCreateInfo.layout = resources.pipelineLayouts->get("offscreen");
-
-		std::array<VkPipelineColorBlendAttachmentState, 3> blendAttachmentStates = {
-			vkTools::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vkTools::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vkTools::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
-		};
-
-		colorBlendState.attachmentCount = blendAttachmentStates.size();
-		colorBlendState.pAttachments = blendAttachmentStates.data();
-		resources.pipelines->addGraphicsPipeline("scene.solid", pipelineCreateInfo, pipelineCache);
-
-		// Transparent objects (discard by alpha)
-		depthStencilState.depthWriteEnable = VK_FALSE;
-		rasterizationState.cullMode = VK_CULL_MODE_NONE;
-		specializationData.discard = 1;
-		resources.pipelines->addGraphicsPipeline("scene.blend", pipelineCreateInfo, pipelineCache);
-
-		// Skysphere
-		shaderStages[0] = loadShader(getAssetPath() + "shaders/skysphere.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getAssetPath() + "shaders/skysphere.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		pipelineCreateInfo.layout = resources.pipelineLayouts->get("skysphere");
-		resources.pipelines->addGraphicsPipeline("skysphere", pipelineCreateInfo, pipelineCache);
+			std::vector<VkSpecializationMapEntry> specializationMapEntries;
+			specializationMapEntries = {
+				vkTools::initializers::specializationMapEntry(2, offsetof(SpecializationData, discard), sizeof(int32_t)),
+				vkTools::initializers::specializationMapEntry(3, offsetof(SpecializationData, textureCount), sizeof(int32_t)),
+				vkTools::initializers::specializationMapEntry(4, offsetof(SpecializationData, hasNormalMap), sizeof(int32_t)),
+				vkTools::initializers::specializationMapEntry(5, offsetof(SpecializationData, hasSpecularMap), sizeof(int32_t)),
+			};
 
-		// SSAO
-		colorBlendState.attachmentCount = 1;
+			for (uint32_t variant : getMaterialVariants())
+			{
+				// Transparent objects (discard by alpha)
+				specializationData.discard = (variant & MATERIAL_VARIANT_ALPHA) ? 1 : 0;
+				specializationData.hasNormalMap = (variant & MATERIAL_VARIANT_NORMALMAP) ? 1 : 0;
+				specializationData.hasSpecularMap = (variant & MATERIAL_VARIANT_SPECULARMAP) ? 1 : 0;
+
+				// Bindless variants sample from the scene texture array
+				// Merged variants are used in the first subpass of the merged G-Buffer pass
+				for (uint32_t bindless = 0; bindless < (bindlessSupported ? 2u : 1u); bindless++)
+				{
+					for (uint32_t merged = 0; merged < 2; merged++)
+					{
+						GraphicsPipelineDesc &pipeline = addPipeline(
+							getMaterialPipelineName(variant, bindless == 1, merged == 1),
+							(bindless == 1) ? "offscreen.bindless" : "offscreen",
+							(merged == 1) ? mergedPass.renderPass : frameBuffers.offscreen.renderPass,
+							"mrt.vert.spv",
+							(bindless == 1) ? "mrt_bindless.frag.spv" : "mrt.frag.spv");
+						pipeline.setSpecialization(specializationMapEntries, specializationData);
+						pipeline.blendAttachmentStates = { opaqueBlendAttachmentState, opaqueBlendAttachmentState };
+						// Alpha masked objects also write depth, as positions are reconstructed from it
+						if (variant & MATERIAL_VARIANT_ALPHA)
+						{
+							pipeline.cullMode = VK_CULL_MODE_NONE;
+						}
+					}
+
+					// Opaque materials after the depth pre-pass only shade the fragments that passed it
+					// Alpha masked ones would need to sample their textures in the pre-pass, they are rendered as usual instead
+					if (!(variant & MATERIAL_VARIANT_ALPHA))
+					{
+						GraphicsPipelineDesc &pipeline = addPipeline(
+							getMaterialPipelineName(variant, bindless == 1, false, true),
+							(bindless == 1) ? "offscreen.bindless" : "offscreen",
+							frameBuffers.offscreen.renderPass,
+							"mrt.vert.spv",
+							(bindless == 1) ? "mrt_bindless.frag.spv" : "mrt.frag.spv");
+						pipeline.setSpecialization(specializationMapEntries, specializationData);
+						pipeline.blendAttachmentStates = { opaqueBlendAttachmentState, opaqueBlendAttachmentState };
+						pipeline.depthWrite = false;
+						pipeline.depthCompareOp = VK_COMPARE_OP_EQUAL;
+					}
+				}
+			}
+		}
 
-		VkPipelineVertexInputStateCreateInfo emptyInputState{};
-		emptyInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		emptyInputState.vertexAttributeDescriptionCount = 0;
-		emptyInputState.pVertexAttributeDescriptions = nullptr;
-		emptyInputState.vertexBindingDescriptionCount = 0;
-		emptyInputState.pVertexBindingDescriptions = nullptr;
-		pipelineCreateInfo.pVertexInputState = &emptyInputState;
+		// Depth pre-pass
+		// Vertex shader only, positions are read from the scene's position only vertex stream
+		{
+			GraphicsPipelineDesc pipeline("depthprepass", resources.pipelineLayouts->get("offscreen"), frameBuffers.depthPrepass.renderPass);
+			pipeline.addShader(getAssetPath() + "shaders/depth_prepass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			pipeline.vertexInputState = &positionVertices.inputState;
+			pipeline.relaxedRasterizationOrder = enableAMDRasterizationOrder;
+			pipelines.push_back(pipeline);
+		}
 
 		// SSAO Pass
-		shaderStages[0] = loadShader(getAssetPath() + "shaders/fullscreen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getAssetPath() + "shaders/ssao.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		// The temporal variant only takes a subset of the kernel's samples per frame
+		for (uint32_t temporal = 0; temporal < 2; temporal++)
 		{
 			// Set constant parameters via specialization constants
 			struct SpecializationData {
 				uint32_t kernelSize = SSAO_KERNEL_SIZE;
 				float radius = SSAO_RADIUS;
 				float power = 1.5f;
+				uint32_t sampleCount;
 			} specializationData;
+			specializationData.sampleCount = (temporal == 1) ? SSAO_TEMPORAL_SAMPLES : SSAO_KERNEL_SIZE;
 
 			std::vector<VkSpecializationMapEntry> specializationMapEntries;
 			specializationMapEntries = {
 				vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, kernelSize), sizeof(uint32_t)),	// SSAO Kernel size
 				vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, radius), sizeof(float)),			// SSAO radius
 				vkTools::initializers::specializationMapEntry(2, offsetof(SpecializationData, power), sizeof(float)),			// SSAO power
+				vkTools::initializers::specializationMapEntry(3, offsetof(SpecializationData, sampleCount), sizeof(uint32_t)),	// SSAO samples per frame
+			};
+
+			GraphicsPipelineDesc &pipeline = addPipeline((temporal == 1) ? "ssao.generate.temporal" : "ssao.generate", "ssao.generate", frameBuffers.ssao.renderPass, "fullscreen.vert.spv", "ssao.frag.spv");
+			pipeline.setSpecialization(specializationMapEntries, specializationData);
+			pipeline.vertexInputState = &emptyInputState;
+			pipeline.depthWrite = false;
+			pipeline.cullMode = VK_CULL_MODE_NONE;
+		}
+
+		// Temporal SSAO resolve
+		{
+			struct SpecializationData {
+				float blend = SSAO_TEMPORAL_BLEND;
+				float depthThreshold = 0.05f;
+			} specializationData;
+
+			std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+				vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, blend), sizeof(float)),			// Weight of the current frame
+				vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, depthThreshold), sizeof(float)),	// Relative depth difference for rejecting the history
+			};
+
+			GraphicsPipelineDesc &pipeline = addPipeline("ssao.temporal", "ssao.temporal", frameBuffers.ssaoResolve.renderPass, "fullscreen.vert.spv", "ssao_temporal.frag.spv");
+			pipeline.setSpecialization(specializationMapEntries, specializationData);
+			pipeline.vertexInputState = &emptyInputState;
+			pipeline.depthWrite = false;
+			pipeline.cullMode = VK_CULL_MODE_NONE;
+		}
+
+		// SSAO depth and normal downsample for the half resolution tier
+		{
+			GraphicsPipelineDesc &pipeline = addPipeline("ssao.downsample", "ssao.downsample", frameBuffers.ssaoDownsample.renderPass, "fullscreen.vert.spv", "ssao_downsample.frag.spv");
+			pipeline.blendAttachmentStates = { opaqueBlendAttachmentState, opaqueBlendAttachmentState };
+			pipeline.vertexInputState = &emptyInputState;
+			pipeline.depthWrite = false;
+			pipeline.cullMode = VK_CULL_MODE_NONE;
+		}
+
+		// SSAO blur passes
+		// Render passes of all single channel SSAO targets are compatible, so both tiers use the same pipelines
+		for (uint32_t vertical = 0; vertical < 2; vertical++)
+		{
+			struct SpecializationData {
+				int32_t radius = SSAO_BLUR_RADIUS;
+				int32_t vertical;
+			} specializationData;
+			specializationData.vertical = vertical;
+
+			std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+				vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, radius), sizeof(int32_t)),		// Blur radius in texels
+				vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, vertical), sizeof(int32_t)),		// Blur direction
 			};
 
-			VkSpecializationInfo specializationInfo = vkTools::initializers::specializationInfo(specializationMapEntries.size(), specializationMapEntries.data(), sizeof(specializationData), &specializationData);
-			shaderStages[1].pSpecializationInfo = &specializationInfo;
-			pipelineCreateInfo.renderPass = frameBuffers.ssao.renderPass;
-			pipelineCreateInfo.layout = resources.pipelineLayouts->get("ssao.generate");
-			resources.pipelines->addGraphicsPipeline("ssao.generate", pipelineCreateInfo, pipelineCache);
+			GraphicsPipelineDesc &pipeline = addPipeline((vertical == 1) ? "ssao.blur.vertical" : "ssao.blur.horizontal", "ssao.blur", frameBuffers.ssaoBlur.renderPass, "fullscreen.vert.spv", "blur.frag.spv");
+			pipeline.setSpecialization(specializationMapEntries, specializationData);
+			pipeline.vertexInputState = &emptyInputState;
+			pipeline.depthWrite = false;
+			pipeline.cullMode = VK_CULL_MODE_NONE;
+
+			if (ssaoComputeSupported)
+			{
+				GraphicsPipelineDesc computePipeline((vertical == 1) ? "ssao.blur.compute.vertical" : "ssao.blur.compute.horizontal", resources.pipelineLayouts->get("ssao.blur.compute"), VK_NULL_HANDLE);
+				computePipeline.addShader(getAssetPath() + "shaders/ssao_blur.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				computePipeline.setSpecialization(specializationMapEntries, specializationData);
+				pipelines.push_back(computePipeline);
+			}
+		}
+
+		// Horizon based AO, depth mip chain passes and one pipeline per preset
+		// Both quality tiers write their target with the same pipelines
+		if (ssaoComputeSupported)
+		{
+			for (int32_t firstLevel = 0; firstLevel < 2; firstLevel++)
+			{
+				std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+					vkTools::initializers::specializationMapEntry(0, 0, sizeof(int32_t)),											// Linearize the G-Buffer depth
+				};
+				GraphicsPipelineDesc computePipeline((firstLevel == 1) ? "ssao.depthmips.linearize" : "ssao.depthmips.downsample", resources.pipelineLayouts->get("ssao.depthmips"), VK_NULL_HANDLE);
+				computePipeline.addShader(getAssetPath() + "shaders/ssao_depth_mips.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				computePipeline.setSpecialization(specializationMapEntries, firstLevel);
+				pipelines.push_back(computePipeline);
+			}
+
+			for (uint32_t method = SSAO_METHOD_HORIZON_LOW; method < SSAO_METHOD_COUNT; method++)
+			{
+				struct SpecializationData {
+					int32_t sliceCount;
+					int32_t stepCount;
+					float radius = SSAO_RADIUS;
+					float power = 1.5f;
+					int32_t mipLevels = SSAO_DEPTH_MIP_LEVELS;
+					int32_t mipOffset = SSAO_DEPTH_MIP_OFFSET;
+				} specializationData;
+				specializationData.sliceCount = ssaoMethods[method].sliceCount;
+				specializationData.stepCount = ssaoMethods[method].stepCount;
+
+				std::vector<VkSpecializationMapEntry> specializationMapEntries = {
+					vkTools::initializers::specializationMapEntry(0, offsetof(SpecializationData, sliceCount), sizeof(int32_t)),	// Screen space directions
+					vkTools::initializers::specializationMapEntry(1, offsetof(SpecializationData, stepCount), sizeof(int32_t)),		// Steps per side of a direction
+					vkTools::initializers::specializationMapEntry(2, offsetof(SpecializationData, radius), sizeof(float)),			// SSAO radius
+					vkTools::initializers::specializationMapEntry(3, offsetof(SpecializationData, power), sizeof(float)),			// SSAO power
+					vkTools::initializers::specializationMapEntry(4, offsetof(SpecializationData, mipLevels), sizeof(int32_t)),		// Levels of the depth mip chain
+					vkTools::initializers::specializationMapEntry(5, offsetof(SpecializationData, mipOffset), sizeof(int32_t)),		// Step distance (log2) of the first level
+				};
+
+				GraphicsPipelineDesc computePipeline(ssaoMethods[method].pipeline, resources.pipelineLayouts->get("ssao.horizon"), VK_NULL_HANDLE);
+				computePipeline.addShader(getAssetPath() + "shaders/ssao_horizon.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				computePipeline.setSpecialization(specializationMapEntries, specializationData);
+				pipelines.push_back(computePipeline);
+			}
+		}
+
+		std::vector<std::string> requiredPipelines = getRequiredPipelines(debugDisplay, enableSSAO, ssaoQuality, ssaoMethod, ssaoComputeBlur, ssaoTemporal, enableBindless, lightingMode, enableMergedPass, enableDepthPrepass);
+		std::vector<GraphicsPipelineDesc> backgroundPipelines;
+		for (auto& pipeline : pipelines)
+		{
+			if (std::find(requiredPipelines.begin(), requiredPipelines.end(), pipeline.name) != requiredPipelines.end())
+			{
+				pipelineCompiler->pipelines.push_back(pipeline);
+			}
+			else
+			{
+				backgroundPipelines.push_back(pipeline);
+			}
+		}
+		pipelineCompiler->compile();
+		for (auto& pipeline : backgroundPipelines)
+		{
+			requestPipeline(pipeline);
+		}
+	}
+
+	// Compile a pipeline in the background, replaces an existing pipeline of the same name once finished
+	void requestPipeline(const GraphicsPipelineDesc &pipeline)
+	{
+		pipelineRequests[pipeline.name] = pipelineCompiler->compileAsync(pipeline);
+		pipelinesPending = true;
+	}
+
+	// True if the user selected render modes that have not been applied yet
+	bool renderModesPending()
+	{
+		return (requestedModes.debugDisplay != debugDisplay) || (requestedModes.enableSSAO != enableSSAO) || (requestedModes.ssaoQuality != ssaoQuality) || (requestedModes.ssaoMethod != ssaoMethod) || (requestedModes.ssaoComputeBlur != ssaoComputeBlur) || (requestedModes.ssaoTemporal != ssaoTemporal) || (requestedModes.enableBindless != enableBindless) || (requestedModes.lightingMode != lightingMode) || (requestedModes.enableMergedPass != enableMergedPass) || (requestedModes.enableDepthPrepass != enableDepthPrepass);
+	}
+
+	// Picks up pipelines compiled in the background and applies requested render modes once all of their pipelines are available
+	// Until then rendering continues with the current pipelines and modes
+	// Called between frames, as submitFrame waits for the queue to become idle no recorded command buffer is in flight
+	void updatePipelines()
+	{
+		if (!pipelinesPending)
+		{
+			return;
+		}
+
+		bool replaced = false;
+		std::vector<GraphicsPipelineDesc> finishedPipelines = pipelineCompiler->poll();
+		for (auto& pipeline : finishedPipelines)
+		{
+			auto request = pipelineRequests.find(pipeline.name);
+			if ((request == pipelineRequests.end()) || (request->second != pipeline.requestId))
+			{
+				// Superseded by a newer request for the same pipeline
+				vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+				continue;
+			}
+			pipelineRequests.erase(request);
+			if (resources.pipelines->present(pipeline.name))
+			{
+				vkDestroyPipeline(device, resources.pipelines->get(pipeline.name), nullptr);
+				replaced = true;
+			}
+			resources.pipelines->add(pipeline.name, pipeline.pipeline);
+			std::cout << "Background compilation of \"" << pipeline.name << "\" took " << pipeline.compileTime << " ms" << std::endl;
+		}
+
+		bool modesChanged = renderModesPending();
+		if (modesChanged)
+		{
+			std::vector<std::string> requiredPipelines = getRequiredPipelines(requestedModes.debugDisplay, requestedModes.enableSSAO, requestedModes.ssaoQuality, requestedModes.ssaoMethod, requestedModes.ssaoComputeBlur, requestedModes.ssaoTemporal, requestedModes.enableBindless, requestedModes.lightingMode, requestedModes.enableMergedPass, requestedModes.enableDepthPrepass);
+			for (auto& name : requiredPipelines)
+			{
+				if (!resources.pipelines->present(name))
+				{
+					modesChanged = false;
+					break;
+				}
+			}
+		}
+		const uint64_t previousModes = getRenderModeKey();
+		const bool mergedPassDisabled = modesChanged && enableMergedPass && !requestedModes.enableMergedPass;
+		if (modesChanged && !enableMergedPass && requestedModes.enableMergedPass)
+		{
+			// Not in use by any command buffer, the cached variants of the merged pass were dropped when it was turned off
+			prepareMergedPassTargets();
+			updateMergedPassDescriptors();
+		}
+		if (modesChanged)
+		{
+			debugDisplay = requestedModes.debugDisplay;
+			enableSSAO = requestedModes.enableSSAO;
+			ssaoQuality = requestedModes.ssaoQuality;
+			ssaoMethod = requestedModes.ssaoMethod;
+			ssaoComputeBlur = requestedModes.ssaoComputeBlur;
+			ssaoTemporal = requestedModes.ssaoTemporal;
+			// History of another resolution or without SSAO is not usable
+			ssaoHistoryValid = false;
+			enableBindless = requestedModes.enableBindless;
+			lightingMode = requestedModes.lightingMode;
+			enableMergedPass = requestedModes.enableMergedPass;
+			enableDepthPrepass = requestedModes.enableDepthPrepass;
+			updateUniformBuffersScreen();
+		}
+
+		if (replaced)
+		{
+			// Cached variants use the replaced pipelines
+			reBuildCommandBuffers();
+			buildDeferredCommandBuffer();
+		}
+		else if (modesChanged)
+		{
+			switchCommandBuffers(previousModes);
+		}
+		if (mergedPassDisabled)
+		{
+			// Cached variants may render into the merged pass targets
+			clearCommandBufferVariants();
+			retireMergedPassTargets();
+		}
+
+		// Shader modules are recreated from the mapped shader pack if further pipelines are requested
+		if (pipelineCompiler->getPendingCount() == 0)
+		{
+			shaderPack->releaseShaderModules();
+		}
+
+		pipelinesPending = (pipelineCompiler->getPendingCount() > 0) || !pipelineRequests.empty() || renderModesPending();
+		if (!finishedPipelines.empty() || modesChanged)
+		{
+			updateTextOverlay();
 		}
+	}
 
-		// SSAO blur pass
-		shaderStages[0] = loadShader(getAssetPath() + "shaders/fullscreen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getAssetPath() + "shaders/blur.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		pipelineCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-		pipelineCreateInfo.layout = resources.pipelineLayouts->get("ssao.blur");
-		resources.pipelines->addGraphicsPipeline("ssao.blur", pipelineCreateInfo, pipelineCache);
+	// Wait for the pipelines started in preparePipelines() and add them to the resource list
+	void finishPipelines()
+	{
+		pipelineCompiler->wait();
+		pipelineCreationTime = pipelineCompiler->getElapsedTime();
+		pipelineThreadCount = pipelineCompiler->getThreadCount();
+		double compileTimeSum = 0.0;
+		slowestPipelines.clear();
+		for (auto& pipeline : pipelineCompiler->pipelines)
+		{
+			resources.pipelines->add(pipeline.name, pipeline.pipeline);
+			compileTimeSum += pipeline.compileTime;
+			slowestPipelines.push_back(std::make_pair(pipeline.name, pipeline.compileTime));
+			if (printPipelineTimes)
+			{
+				std::cout << "  " << pipeline.name << ": " << pipeline.compileTime << " ms" << std::endl;
+			}
+		}
+		std::cout << "Pipeline creation took " << pipelineCreationTime << " ms on " << pipelineThreadCount << " threads (" << compileTimeSum << " ms summed up, " << (pipelineCacheWarm ? "warm" : "cold") << " pipeline cache)" << std::endl;
+		const size_t shownCount = std::min(slowestPipelines.size(), (size_t)PIPELINE_TIMES_SHOWN);
+		std::partial_sort(slowestPipelines.begin(), slowestPipelines.begin() + shownCount, slowestPipelines.end(), [](const std::pair<std::string, double> &a, const std::pair<std::string, double> &b)
+		{
+			return a.second > b.second;
+		});
+		slowestPipelines.resize(shownCount);
+		for (auto& pipeline : slowestPipelines)
+		{
+			std::cout << "  Slowest: " << pipeline.first << " (" << pipeline.second << " ms)" << std::endl;
+		}
+		std::cout << "Shader modules: " << shaderPack->stats.requests << " requested, " << shaderPack->stats.modulesCreated << " created, " << shaderPack->stats.looseFiles << " loose files read (" << shaderPack->stats.looseBytes << " bytes)" << std::endl;
+		pipelineCompiler->pipelines.clear();
 	}
 
 	inline float lerp(float a, float b, float f)
@@ -2143,19 +5037,36 @@ public:
 			&uniformBuffers.sceneMatrices,
 			sizeof(uboSceneMatrices));
 
-		// Deferred fragment shader
+		// Lights used by the composition and tiled lighting, persistently mapped as they're updated every frame
+		vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&storageBuffers.lights,
+			sizeof(LightBufferHeader) + LIGHTS_MAX_COUNT * sizeof(LightData));
+		VK_CHECK_RESULT(storageBuffers.lights.map());
+
+		// Light lists of all clusters, only accessed by the GPU
+		vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&storageBuffers.clusters,
+			CLUSTER_COUNT * sizeof(ClusterData));
+
+		// Tiled and clustered light culling
 		vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.sceneLights,
-			sizeof(uboFragmentLights));
+			&uniformBuffers.lightCulling,
+			sizeof(uboLightCulling));
 
 		setupLights();
 
 		// Update
 		updateUniformBuffersScreen();
 		updateUniformBufferDeferredMatrices();
-		updateUniformBufferDeferredLights();
+		updateUniformBufferLightCulling();
+		updateLights();
+		updateLightBuffer();
 
 		// SSAO
 
@@ -2167,6 +5078,15 @@ public:
 			sizeof(uboSSAOParams));
 		updateUniformBufferSSAOParams();
 
+		// Temporal SSAO parameters
+		vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffers.ssaoTemporal,
+			sizeof(uboSSAOTemporal));
+		previousViewProjection = camera.matrices.perspective * camera.matrices.view;
+		updateUniformBufferSSAOTemporal();
+
 		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
 		std::random_device rndDev;
 		std::default_random_engine rndGen;
@@ -2212,6 +5132,7 @@ public:
 			uboVS.projection = glm::ortho(0.0f, 1.0f, 0.0f, 1.0f, -1.0f, 1.0f);
 		}
 		uboVS.model = glm::mat4();
+		uboVS.renderScale = renderScale;
 
 		VK_CHECK_RESULT(uniformBuffers.fullScreen.map());
 		uniformBuffers.fullScreen.copyTo(&uboVS, sizeof(uboVS));
@@ -2224,6 +5145,7 @@ public:
 		uboSceneMatrices.view = camera.matrices.view;
 		uboSceneMatrices.model = glm::mat4();
 		uboSceneMatrices.viewportDim = glm::vec2(width, height);
+		uboSceneMatrices.renderScale = renderScale;
 
 		uint8_t *pData;
 
@@ -2235,10 +5157,24 @@ public:
 	void updateUniformBufferSSAOParams()
 	{
 		uboSSAOParams.projection = camera.matrices.perspective;
+		uboSSAOParams.invProjection = glm::inverse(camera.matrices.perspective);
+		uboSSAOParams.renderScale = renderScale;
+
+		VK_CHECK_RESULT(uniformBuffers.ssaoParams.map());
+		uniformBuffers.ssaoParams.copyTo(&uboSSAOParams, sizeof(uboSSAOParams));
+		uniformBuffers.ssaoParams.unmap();
+	}
+
+	// Called once per frame, the reprojection is based on the camera of the last rendered frame
+	void updateUniformBufferSSAOTemporal()
+	{
+		uboSSAOTemporal.reprojection = previousViewProjection * glm::inverse(camera.matrices.view);
+		uboSSAOTemporal.frameIndex = ssaoFrameIndex;
+		uboSSAOTemporal.historyValid = ssaoHistoryValid;
 
-		VK_CHECK_RESULT(uniformBuffers.ssaoParams.map());
-		uniformBuffers.ssaoParams.copyTo(&uboSSAOParams, sizeof(uboSSAOParams));
-		uniformBuffers.ssaoParams.unmap();
+		VK_CHECK_RESULT(uniformBuffers.ssaoTemporal.map());
+		uniformBuffers.ssaoTemporal.copyTo(&uboSSAOTemporal, sizeof(uboSSAOTemporal));
+		uniformBuffers.ssaoTemporal.unmap();
 	}
 
 	float rnd(float range)
@@ -2246,98 +5182,131 @@ public:
 		return range * (rand() / double(RAND_MAX));
 	}
 
-	void setupLight(Light *light, glm::vec3 pos, glm::vec3 color, float radius)
+	uint32_t setupLight(glm::vec3 pos, glm::vec3 color, float intensity)
 	{
-		light->position = glm::vec4(pos, 1.0f);
-		light->color = glm::vec4(color, 1.0f);
-		light->radius = radius;
-		// linear and quadratic falloff not used with new shader
+		return lightManager.add(pos, color, intensity, getLightRange(intensity));
 	}
 
 	// Initial light setup for the scene
 	void setupLights()
 	{	
-		// 5 fixed lights
-		std::array<glm::vec3, 5> lightColors;
-		lightColors[0] = glm::vec3(1.0f, 0.0f, 0.0f);
-		lightColors[1] = glm::vec3(1.0f, 0.7f, 0.7f);
-		lightColors[2] = glm::vec3(1.0f, 0.0f, 0.0f);
-		lightColors[3] = glm::vec3(0.0f, 0.0f, 1.0f);
-		lightColors[4] = glm::vec3(1.0f, 0.0f, 0.0f);
+		const float pi = glm::pi<float>();
+
+		// Dynamic light moving over the floor, can be attached to the camera
+		uint32_t index = setupLight({ 0.0f, -2.5f, 0.0f }, glm::vec3(1.0f), 100.0f);
+		lightManager.setPath(index, { 120.0f, 0.0f, 10.0f }, { 1.0f, 0.0f, 8.0f }, { pi, 0.0f, pi * 0.5f });
+
+		// 4 fixed lights
+		std::array<glm::vec3, 4> lightColors;
+		lightColors[0] = glm::vec3(1.0f, 0.7f, 0.7f);
+		lightColors[1] = glm::vec3(1.0f, 0.0f, 0.0f);
+		lightColors[2] = glm::vec3(0.0f, 0.0f, 1.0f);
+		lightColors[3] = glm::vec3(1.0f, 0.0f, 0.0f);
 
 		for (int32_t i = 0; i < lightColors.size(); i++)
 		{
-			setupLight(&uboFragmentLights.lights[i], glm::vec3((float)(i - 2.5f) * 50.0f, -10.0f, 0.0f), lightColors[i], 120.0f);
+			setupLight(glm::vec3((float)(i - 1.5f) * 50.0f, -10.0f, 0.0f), lightColors[i], 120.0f);
 		}
 
-		// Dynamic light moving over the floor
-		setupLight(&uboFragmentLights.lights[0], { -sin(glm::radians(360.0f * timer)) * 120.0f, -2.5f, cos(glm::radians(360.0f * timer * 8.0f)) * 10.0f }, glm::vec3(1.0f), 100.0f);
-
 		// Fire bowls
-		setupLight(&uboFragmentLights.lights[5], { -48.75f, -16.0f, -17.8f }, { 1.0f, 0.6f, 0.0f }, 45.0f);
-		setupLight(&uboFragmentLights.lights[6], { -48.75f, -16.0f,  18.4f }, { 1.0f, 0.6f, 0.0f }, 45.0f);
-		setupLight(&uboFragmentLights.lights[7], { 62.0f, -16.0f, -17.8f }, { 1.0f, 0.6f, 0.0f }, 45.0f);
-		setupLight(&uboFragmentLights.lights[8], { 62.0f, -16.0f,  18.4f }, { 1.0f, 0.6f, 0.0f }, 45.0f);
+		std::array<glm::vec3, 4> fireBowls = {
+			glm::vec3(-48.75f, -16.0f, -17.8f),
+			glm::vec3(-48.75f, -16.0f,  18.4f),
+			glm::vec3(62.0f, -16.0f, -17.8f),
+			glm::vec3(62.0f, -16.0f,  18.4f),
+		};
+		for (uint32_t i = 0; i < fireBowls.size(); i++)
+		{
+			index = setupLight(fireBowls[i], { 1.0f, 0.6f, 0.0f }, 45.0f);
+			lightManager.setFlicker(index, 0.35f, 24.0f, (float)i * 1.3f);
+		}
 
-		setupLight(&uboFragmentLights.lights[9], { 120.0f, -20.0f, -43.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
-		setupLight(&uboFragmentLights.lights[10], { 120.0f, -20.0f, 41.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
-		setupLight(&uboFragmentLights.lights[11], { -110.0f, -20.0f, -43.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
-		setupLight(&uboFragmentLights.lights[12], { -110.0f, -20.0f, 41.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
+		setupLight({ 120.0f, -20.0f, -43.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
+		setupLight({ 120.0f, -20.0f, 41.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
+		setupLight({ -110.0f, -20.0f, -43.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
+		setupLight({ -110.0f, -20.0f, 41.75f }, { 1.0f, 0.8f, 0.3f }, 75.0f);
 
 		// Lion eyes
-		setupLight(&uboFragmentLights.lights[13], { -122.0f, -18.0f, -3.2f }, { 1.0f, 0.3f, 0.3f }, 25.0f);
-		setupLight(&uboFragmentLights.lights[14], { -122.0f, -18.0f,  3.2f }, { 0.3f, 1.0f, 0.3f }, 25.0f);
+		setupLight({ -122.0f, -18.0f, -3.2f }, { 1.0f, 0.3f, 0.3f }, 25.0f);
+		setupLight({ -122.0f, -18.0f,  3.2f }, { 0.3f, 1.0f, 0.3f }, 25.0f);
 
-		setupLight(&uboFragmentLights.lights[15], { 135.0f, -18.0f, -3.2f }, { 0.3f, 0.3f, 1.0f }, 25.0f);
-		setupLight(&uboFragmentLights.lights[16], { 135.0f, -18.0f,  3.2f }, { 1.0f, 1.0f, 0.3f }, 25.0f);
+		setupLight({ 135.0f, -18.0f, -3.2f }, { 0.3f, 0.3f, 1.0f }, 25.0f);
+		setupLight({ 135.0f, -18.0f,  3.2f }, { 1.0f, 1.0f, 0.3f }, 25.0f);
 
 		// Setup particle systems for fire bowls
-		for (uint32_t i = 5; i < 9; i++)
+		for (auto& fireBowl : fireBowls)
 		{
-			resources.particleSystems->add(512, glm::vec3(uboFragmentLights.lights[i].position) + glm::vec3(0.0f, 2.5f, 0.0f), glm::vec3(-2.0f, 0.25f, -2.0f), glm::vec3(2.0f, 2.5f, 2.0f));
+			resources.particleSystems->add(512, fireBowl + glm::vec3(0.0f, 2.5f, 0.0f), glm::vec3(-2.0f, 0.25f, -2.0f), glm::vec3(2.0f, 2.5f, 2.0f));
 		}
-	}
 
-	// Update fragment shader light positions for moving light sources
-	void updateUniformBufferDeferredLights()
-	{
-		// Dynamic light
-		if (attachLight)
-		{
-			// Attach to camera position
-			uboFragmentLights.lights[0].position = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, -1.0f, -1.0f, 1.0f);
-		}
-		else
+		// Small random lights spread over the scene, enabled on demand to compare lighting performance against light count
+		// They drift on small loops and flicker like torches
+		// Fixed seed so measurements are reproducible
+		sceneLightCount = lightManager.size();
+		extraLightCount = std::min(extraLightCount, LIGHTS_MAX_COUNT - sceneLightCount);
+		std::default_random_engine rndGen(42);
+		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+		while (lightManager.size() < LIGHTS_MAX_COUNT)
 		{
-			// Move across the floow
-			uboFragmentLights.lights[0].position.x = -sin(glm::radians(360.0f * timer)) * 120.0f;
-			uboFragmentLights.lights[0].position.z = cos(glm::radians(360.0f * timer * 8.0f)) * 10.0f;
+			glm::vec3 pos(rndDist(rndGen) * 260.0f - 130.0f, -rndDist(rndGen) * 45.0f - 1.0f, rndDist(rndGen) * 100.0f - 50.0f);
+			glm::vec3 color(0.2f + rndDist(rndGen) * 0.8f, 0.2f + rndDist(rndGen) * 0.8f, 0.2f + rndDist(rndGen) * 0.8f);
+			// Low intensities keep the range short (torch sized), so thousands of them don't overflow the cluster light lists
+			index = setupLight(pos, color, 0.5f + rndDist(rndGen) * 2.0f);
+			float radius = 1.0f + rndDist(rndGen) * 4.0f;
+			float cycles = (rndDist(rndGen) < 0.5f) ? 1.0f : 2.0f;
+			float phase = rndDist(rndGen) * 2.0f * pi;
+			lightManager.setPath(index, { radius, radius * 0.25f, radius }, { cycles, cycles * 2.0f, cycles }, { phase, phase, phase + pi * 0.5f });
+			lightManager.setFlicker(index, rndDist(rndGen) * 0.5f, 16.0f + floor(rndDist(rndGen) * 16.0f), rndDist(rndGen) * 2.0f * pi);
 		}
+	}
 
-		// Fire bowls
-		/*
-		uboFragmentLights.lights[5].position.x += (2.5f * sin(glm::radians(360.0f * timer)));
-		uboFragmentLights.lights[5].position.z += (2.5f * cos(glm::radians(360.0f * timer)));
+	// Distance at which the light's attenuation reaches zero
+	float getLightRange(float intensity)
+	{
+		return sqrt(intensity / LIGHT_ATTENUATION_CUTOFF);
+	}
 
-		uboFragmentLights.lights[6].position.x += (2.5f * cos(glm::radians(360.0f * timer)));
-		uboFragmentLights.lights[6].position.z += (2.5f * sin(glm::radians(360.0f * timer)));
-		*/
+	// Animate all active lights (paths, flicker, camera attachment)
+	void updateLights()
+	{
+		lightManager.attachedLight = attachLight ? 0 : -1;
+		// Camera position is negated
+		lightManager.update(getLightCount(), timer, -camera.position);
+	}
 
-		uboFragmentLights.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f);
-		//uboFragmentLights.inv = glm::inverse(camera.matrices.view);
-		uboFragmentLights.view = camera.matrices.view;
-		uboFragmentLights.model = glm::mat4();
+	// Write all active lights to the light buffer
+	// Light positions are transformed to view space here once per frame instead of for every pixel
+	void updateLightBuffer()
+	{
+		LightBufferHeader header = {};
+		header.count = getLightCount();
+		memcpy(storageBuffers.lights.mapped, &header, sizeof(header));
+		LightData *lightData = (LightData*)((uint8_t*)storageBuffers.lights.mapped + sizeof(LightBufferHeader));
+		lightManager.write(header.count, camera.matrices.view, lightData);
+	}
 
-		VK_CHECK_RESULT(uniformBuffers.sceneLights.map());
-		uniformBuffers.sceneLights.copyTo(&uboFragmentLights, sizeof(uboFragmentLights));
-		uniformBuffers.sceneLights.unmap();
+	uint32_t getLightCount()
+	{
+		return sceneLightCount + extraLightCount;
 	}
 
+	void updateUniformBufferLightCulling()
+	{
+		uboLightCulling.invProjection = glm::inverse(camera.matrices.perspective);
+		uboLightCulling.zNear = camera.znear;
+		uboLightCulling.zFar = camera.zfar;
+		uboLightCulling.renderScale = renderScale;
+		uboLightCulling.invView = glm::inverse(camera.matrices.view);
+
+		VK_CHECK_RESULT(uniformBuffers.lightCulling.map());
+		uniformBuffers.lightCulling.copyTo(&uboLightCulling, sizeof(uboLightCulling));
+		uniformBuffers.lightCulling.unmap();
+	}
 
 	void loadScene()
 	{
 		VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
-		scene = new Scene(device, queue, textureLoader, &uniformBuffers.sceneMatrices);
+		scene = new Scene(device, queue, textureLoader, resources.descriptorSetLayouts->get("scene.material"));
 
 #if defined(__ANDROID__)
 		scene->assetManager = androidApp->activity->assetManager;
@@ -2346,31 +5315,111 @@ public:
 
 		scene->load(getAssetPath() + "sponza.dae", copyCmd);
 		vkFreeCommandBuffers(device, cmdPool, 1, &copyCmd);
+
+		prepareSceneStorageBuffers();
+
+		if (bindlessSupported)
+		{
+			updateBindlessDescriptorSet();
+		}
+
+		// Potentially visible sets baked offline by tools/pvsbake
+#if defined(__ANDROID__)
+		bool pvsLoaded = pvs.loadFromFile(androidApp->activity->assetManager, getAssetPath() + "sponza.pvs", static_cast<uint32_t>(scene->meshes.size()));
+#else
+		bool pvsLoaded = pvs.loadFromFile(getAssetPath() + "sponza.pvs", static_cast<uint32_t>(scene->meshes.size()));
+#endif
+		if (pvsLoaded)
+		{
+			std::cout << "PVS: " << pvs.header.dim[0] << " x " << pvs.header.dim[1] << " x " << pvs.header.dim[2] << " cells" << std::endl;
+		}
+		else
+		{
+			std::cout << "No valid PVS for the scene found, rendering all meshes" << std::endl;
+		}
+		pvsVisibleMeshes = static_cast<uint32_t>(scene->meshes.size());
+		updatePVSCell();
+	}
+
+	// Upload static data to a device local storage buffer
+	void createStorageBuffer(vk::Buffer *buffer, VkDeviceSize size, void *data)
+	{
+		vk::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, size, data));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, size));
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = size;
+		vulkanDevice->copyBuffer(&stagingBuffer, buffer, queue, &copyRegion);
+		stagingBuffer.destroy();
+	}
+
+	// Material parameters and instance transforms indexed by the per-draw push constants
+	void prepareSceneStorageBuffers()
+	{
+		std::vector<MaterialData> materialData(scene->materials.size());
+		for (size_t i = 0; i < scene->materials.size(); i++)
+		{
+			const SceneMaterial &material = scene->materials[i];
+			materialData[i].diffuse = material.textureIndices.diffuse;
+			materialData[i].specular = material.textureIndices.specular;
+			materialData[i].bump = material.textureIndices.bump;
+			materialData[i].flags = (material.hasAlpha ? MATERIAL_FLAG_ALPHA : 0) | (material.hasBump ? MATERIAL_FLAG_BUMP : 0);
+		}
+
+		// Scene is pre-transformed on load, so all meshes start with an identity transform
+		std::vector<InstanceData> instanceData(scene->meshes.size());
+		for (auto& instance : instanceData)
+		{
+			instance.model = glm::mat4();
+			instance.normal = glm::transpose(glm::inverse(instance.model));
+		}
+
+		createStorageBuffer(&storageBuffers.materials, materialData.size() * sizeof(MaterialData), materialData.data());
+		createStorageBuffer(&storageBuffers.instances, instanceData.size() * sizeof(InstanceData), instanceData.data());
+
+		VkDescriptorSet targetDS = resources.descriptorSets->get("scene.pass");
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffers.materials.descriptor),		// Binding 0 : Material parameters
+			vkTools::initializers::writeDescriptorSet(targetDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &storageBuffers.instances.descriptor),		// Binding 1 : Instance transforms
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+	}
+
+	// Write all scene textures to the bindless texture array
+	void updateBindlessDescriptorSet()
+	{
+		if (scene->textureDescriptors.size() > BINDLESS_TEXTURE_COUNT)
+		{
+			std::cout << "Scene uses " << scene->textureDescriptors.size() << " textures, bindless path supports max. " << BINDLESS_TEXTURE_COUNT << ", using per-material descriptor sets" << std::endl;
+			bindlessSupported = false;
+			enableBindless = false;
+			requestedModes.enableBindless = false;
+			return;
+		}
+		// All array elements are statically used by the shader, so unused ones point to a valid dummy texture
+		std::vector<VkDescriptorImageInfo> imageDescriptors(scene->textureDescriptors);
+		imageDescriptors.resize(BINDLESS_TEXTURE_COUNT, resources.textures->get("dummy.diffuse").descriptor);
+		VkWriteDescriptorSet writeDescriptorSet = vkTools::initializers::writeDescriptorSet(resources.descriptorSets->get("scene.textures"), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, imageDescriptors.data());
+		writeDescriptorSet.descriptorCount = BINDLESS_TEXTURE_COUNT;
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
 
-		// Offscreen rendering
+		// Offscreen and scene rendering are submitted in a single batch
+		// The offscreen command buffer ends with the render graph's barriers for the composition, so no semaphore is needed between them
+		std::array<VkCommandBuffer, 2> commandBuffers = { offScreenCmdBuffer, drawCmdBuffers[currentBuffer] };
 
 		// Wait for swap chain presentation to finish
 		submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-		// Signal ready with offscreen semaphore
-		submitInfo.pSignalSemaphores = &offscreenSemaphore;
-
-		// Submit work
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &offScreenCmdBuffer;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
-		// Scene rendering
-		// Wait for offscreen semaphore
-		submitInfo.pWaitSemaphores = &offscreenSemaphore;
 		// Signal ready with render complete semaphpre
 		submitInfo.pSignalSemaphores = &semaphores.renderComplete;
+
 		// Submit work
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		submitInfo.pCommandBuffers = commandBuffers.data();
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
 		VulkanExampleBase::submitFrame();
@@ -2399,13 +5448,17 @@ public:
 		deviceMemProps = deviceMemoryProperties;
 
 		generateQuads();
+		generateLightVolume();
 		loadAssets();
 		setupVertexDescriptions();
 		prepareOffscreenFramebuffers();
 		prepareUniformBuffers();
 		setupLayoutsAndDescriptors();
+		// Pipelines are created on worker threads while the scene's textures are loaded
 		preparePipelines();
 		loadScene();
+		finishPipelines();
+		gpuProfiler = new vk::GpuProfiler(device, vulkanDevice->properties.limits, vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits, vulkanDevice->enabledFeatures.pipelineStatisticsQuery);
 		buildCommandBuffers();
 		buildDeferredCommandBuffer();
 		prepared = true;
@@ -2415,33 +5468,280 @@ public:
 	{
 		if (!prepared)
 			return;
+		updatePipelines();
+		if (enableSSAO && ssaoTemporal)
+		{
+			updateUniformBufferSSAOTemporal();
+		}
 		draw();
+		// Next frame reprojects into this frame's view and continues the kernel rotation
+		previousViewProjection = camera.matrices.perspective * camera.matrices.view;
+		ssaoFrameIndex++;
+		ssaoHistoryValid = enableSSAO && ssaoTemporal;
+		// Queue is idle after the frame has been submitted
+		gpuProfiler->update();
+		// Frame timer holds the time of the last frame
+		modeSwitchStats.windowMaxFrameTime = std::max(modeSwitchStats.windowMaxFrameTime, frameTimer * 1000.0f);
+		modeSwitchStats.windowTime += frameTimer;
+		if (modeSwitchStats.windowTime >= 1.0f)
+		{
+			modeSwitchStats.maxFrameTime = modeSwitchStats.windowMaxFrameTime;
+			modeSwitchStats.windowMaxFrameTime = 0.0f;
+			modeSwitchStats.windowTime = 0.0f;
+		}
+		deletionQueue.collect(frameIndex);
+		frameIndex++;
+		if (gpuProfiler->isActive("SSAO"))
+		{
+			ssaoGpuTimes[ssaoQuality] = gpuProfiler->getTime("SSAO");
+		}
+		if (gpuProfiler->isActive("SSAO generation"))
+		{
+			ssaoGenerateGpuTimes[ssaoMethod][ssaoQuality] = gpuProfiler->getTime("SSAO generation");
+		}
+		updateDynamicResolution();
 
 		if (!paused)
 		{
-			updateUniformBufferDeferredLights();
+			updateLights();
+			updateLightBuffer();
 		}
 	}
 
+	// Called by the base class once the swap chain has been recreated, before the swap chain command buffers are built
+	// Only the size dependent targets are recreated, render passes, pipelines and descriptor sets are kept
+	virtual void windowResized()
+	{
+		retireOffscreenTargets();
+		prepareOffscreenFramebuffers();
+		// Sets already exist, this only writes the descriptors of the new targets
+		setupLayoutsAndDescriptors();
+		// Keeps the dynamic resolution scale, history doesn't match the new targets
+		updateRenderScale();
+		// Descriptor updates invalidate the command buffers using the sets
+		buildDeferredCommandBuffer();
+	}
+
 	virtual void viewChanged()
 	{
+		updateSceneDraws();
 		updateUniformBufferDeferredMatrices();
 		updateUniformBufferSSAOParams();
+		updateUniformBufferLightCulling();
+		// View space light positions depend on the camera
+		updateLightBuffer();
 		updateTextOverlay();
 	}
 
 	void toggleDebugDisplay()
 	{
-		debugDisplay = !debugDisplay;
-		reBuildCommandBuffers();
-		updateUniformBuffersScreen();
+		requestedModes.debugDisplay = !requestedModes.debugDisplay;
+		pipelinesPending = true;
+	}
+
+	void togglePVS()
+	{
+		if (!pvs.valid())
+		{
+			return;
+		}
+		enablePVS = !enablePVS;
+		pvsCell = enablePVS ? pvs.getCellIndex(-camera.position) : -1;
+		pvsVisibleMeshes = pvs.visibleCount(pvsCell);
+		buildDeferredCommandBuffer();
+		updateTextOverlay();
+	}
+
+	void toggleBindless()
+	{
+		if (!bindlessSupported)
+		{
+			return;
+		}
+		requestedModes.enableBindless = !requestedModes.enableBindless;
+		pipelinesPending = true;
 	}
 
 	void toggleSSAO()
 	{
-		enableSSAO = !enableSSAO;
-		reBuildCommandBuffers();
-		buildDeferredCommandBuffer(true);
+		requestedModes.enableSSAO = !requestedModes.enableSSAO;
+		pipelinesPending = true;
+	}
+
+	void toggleSSAOQuality()
+	{
+		requestedModes.ssaoQuality = (requestedModes.ssaoQuality == SSAO_QUALITY_HIGH) ? SSAO_QUALITY_LOW : SSAO_QUALITY_HIGH;
+		pipelinesPending = true;
+	}
+
+	// Cycle through the hemisphere kernel and the horizon presets, the horizon methods require compute support
+	void changeSSAOMethod()
+	{
+		if (!ssaoComputeSupported)
+		{
+			return;
+		}
+		requestedModes.ssaoMethod = (SSAOMethod)((requestedModes.ssaoMethod + 1) % SSAO_METHOD_COUNT);
+		pipelinesPending = true;
+	}
+
+	void toggleSSAOTemporal()
+	{
+		requestedModes.ssaoTemporal = !requestedModes.ssaoTemporal;
+		pipelinesPending = true;
+	}
+
+	void toggleSSAOComputeBlur()
+	{
+		if (!ssaoComputeSupported)
+		{
+			return;
+		}
+		requestedModes.ssaoComputeBlur = !requestedModes.ssaoComputeBlur;
+		pipelinesPending = true;
+	}
+
+	// Cycle through full screen, tiled, clustered and light volume lighting
+	// Tiled and clustered lighting are skipped without compute support
+	void changeLightingMode()
+	{
+		LightingMode mode = requestedModes.lightingMode;
+		do
+		{
+			mode = (LightingMode)((mode + 1) % LIGHTING_MODE_COUNT);
+		} while (!computeLightingSupported && ((mode == LIGHTING_TILED) || (mode == LIGHTING_CLUSTERED)));
+		requestedModes.lightingMode = mode;
+		pipelinesPending = true;
+	}
+
+	// Only takes effect with full screen or clustered lighting and without SSAO and debug display
+	void toggleMergedPass()
+	{
+		requestedModes.enableMergedPass = !requestedModes.enableMergedPass;
+		pipelinesPending = true;
+	}
+
+	// Not used while the merged G-Buffer pass is active
+	void toggleDepthPrepass()
+	{
+		requestedModes.enableDepthPrepass = !requestedModes.enableDepthPrepass;
+		pipelinesPending = true;
+	}
+
+	// Cycle through different numbers of random lights added to the scene lights
+	// Counts passed via "-lights" continue with the next step of the cycle
+	void changeExtraLightCount()
+	{
+		const std::array<uint32_t, 5> counts = { 0, 256, 1024, 4096, LIGHTS_MAX_COUNT - sceneLightCount };
+		uint32_t index = 0;
+		while ((index < counts.size()) && (counts[index] != extraLightCount))
+		{
+			index++;
+		}
+		extraLightCount = counts[(index + 1) % counts.size()];
+		assert(sceneLightCount + extraLightCount <= LIGHTS_MAX_COUNT);
+		updateLights();
+		updateLightBuffer();
+		// Light volume draws are recorded per light
+		if (lightingMode == LIGHTING_VOLUMES)
+		{
+			buildDeferredCommandBuffer();
+		}
+		updateTextOverlay();
+	}
+
+	// The current composition pipeline is used until the new ones have been compiled
+	void changeAmbientFactor(float delta)
+	{
+		ambientFactor = glm::clamp(ambientFactor + delta, 0.0f, 1.0f);
+		for (auto& pipeline : getLightingPipelineDescs())
+		{
+			requestPipeline(pipeline);
+		}
+		updateTextOverlay();
+	}
+
+	// Sum of the top level scopes of the last frame in ms
+	double getGpuFrameTime()
+	{
+		double time = 0.0;
+		for (auto& scope : gpuFrameScopes)
+		{
+			time += gpuProfiler->getTime(scope);
+		}
+		return time;
+	}
+
+	// Scale of the rendered part of the G-Buffer, applied between frames
+	// Command buffers are only re-recorded for the new viewports, the attachments keep their size
+	void setRenderScale(float scale)
+	{
+		dynamicResolution.scale = scale;
+		dynamicResolution.framesSinceChange = 0;
+		updateRenderScale();
+		buildDeferredCommandBuffer();
+		updateTextOverlay();
+	}
+
+	// Rendered size is rounded to full pixels of the G-Buffer, the shaders get the exact ratio
+	void updateRenderScale()
+	{
+		const float scale = dynamicResolution.scale;
+		const uint32_t renderWidth = std::max(static_cast<uint32_t>(frameBuffers.offscreen.width * scale + 0.5f), 1u);
+		const uint32_t renderHeight = std::max(static_cast<uint32_t>(frameBuffers.offscreen.height * scale + 0.5f), 1u);
+		renderScale = glm::vec2((float)renderWidth / (float)frameBuffers.offscreen.width, (float)renderHeight / (float)frameBuffers.offscreen.height);
+		updateUniformBuffersScreen();
+		updateUniformBufferDeferredMatrices();
+		updateUniformBufferSSAOParams();
+		updateUniformBufferLightCulling();
+		// History covers a different part of the targets
+		ssaoHistoryValid = false;
+	}
+
+	// Adjusts the render scale to hold the target frame time, called once the last frame's timestamps have been read back
+	// GPU time is assumed to scale with the number of pixels, so the scale changes with the square root of the time ratio
+	void updateDynamicResolution()
+	{
+		// The merged G-Buffer pass always renders at full resolution
+		if ((!dynamicResolution.enabled) || (!gpuProfiler->supported()) || (useMergedPass()))
+		{
+			return;
+		}
+		if (++dynamicResolution.framesSinceChange < DYNAMIC_RESOLUTION_INTERVAL)
+		{
+			return;
+		}
+		const double frameTime = getGpuFrameTime();
+		const float target = dynamicResolution.targetFrameTime;
+		// Frame times between the headroom and the target are kept, so the scale doesn't oscillate
+		if ((frameTime <= 0.0) || ((frameTime <= target) && (frameTime >= target * DYNAMIC_RESOLUTION_HEADROOM)))
+		{
+			return;
+		}
+		// Aim for the middle of the band
+		float scale = dynamicResolution.scale * sqrt(target * (1.0f + DYNAMIC_RESOLUTION_HEADROOM) * 0.5f / (float)frameTime);
+		scale = glm::clamp(round(scale / DYNAMIC_RESOLUTION_STEP) * DYNAMIC_RESOLUTION_STEP, DYNAMIC_RESOLUTION_MIN_SCALE, 1.0f);
+		if (fabs(scale - dynamicResolution.scale) < DYNAMIC_RESOLUTION_STEP * 0.5f)
+		{
+			dynamicResolution.framesSinceChange = 0;
+			return;
+		}
+		setRenderScale(scale);
+	}
+
+	// Disabling dynamic resolution goes back to the full G-Buffer resolution
+	void toggleDynamicResolution()
+	{
+		dynamicResolution.enabled = !dynamicResolution.enabled;
+		if (!dynamicResolution.enabled)
+		{
+			setRenderScale(1.0f);
+		}
+		else
+		{
+			dynamicResolution.framesSinceChange = 0;
+			updateTextOverlay();
+		}
 	}
 
 	virtual void keyPressed(uint32_t keyCode)
@@ -2456,6 +5756,48 @@ public:
 		case KEY_F2:
 			toggleSSAO();
 			break;
+		case KEY_F3:
+			togglePVS();
+			break;
+		case KEY_F4:
+			toggleSSAOQuality();
+			break;
+		case KEY_B:
+			toggleBindless();
+			break;
+		case KEY_C:
+			toggleSSAOComputeBlur();
+			break;
+		case KEY_H:
+			changeSSAOMethod();
+			break;
+		case KEY_O:
+			toggleSSAOTemporal();
+			break;
+		case KEY_R:
+			toggleDynamicResolution();
+			break;
+		case KEY_T:
+			changeLightingMode();
+			break;
+		case KEY_M:
+			toggleMergedPass();
+			break;
+		case KEY_Z:
+			toggleDepthPrepass();
+			break;
+		case KEY_N:
+			changeExtraLightCount();
+			break;
+		case KEY_G:
+			dumpRenderGraph();
+			break;
+		case KEY_KPADD:
+			changeAmbientFactor(0.05f);
+			break;
+		case KEY_KPSUB:
+			changeAmbientFactor(-0.05f);
+			break;
 		case KEY_L:
 		case GAMEPAD_BUTTON_B:
 			attachLight = !attachLight;
@@ -2465,11 +5807,199 @@ public:
 
 	virtual void getOverlayText(VulkanTextOverlay *textOverlay)
 	{
+		float textPos = 65.0f;
 #if defined(__ANDROID__)
-		textOverlay->addText("Press \"Button A\" to toggle render targets", 5.0f, 85.0f, VulkanTextOverlay::alignLeft);
+		textOverlay->addText("Press \"Button A\" to toggle render targets", 5.0f, textPos, VulkanTextOverlay::alignLeft);
+		textPos += 20.0f;
 #else
 		//textOverlay->addText("Press \"1\" to toggle render targets", 5.0f, 85.0f, VulkanTextOverlay::alignLeft);
 #endif
+		if (pvs.valid())
+		{
+			std::stringstream ss;
+			ss << "PVS: " << (enablePVS ? "on" : "off") << ", cell " << pvsCell << ", " << pvsVisibleMeshes << "/" << scene->meshes.size() << " meshes";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			ss << "Pipeline creation: " << std::fixed << std::setprecision(2) << pipelineCreationTime << " ms, " << pipelineThreadCount << " threads (" << (pipelineCacheWarm ? "warm" : "cold") << " cache)";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		if (!slowestPipelines.empty())
+		{
+			std::stringstream ss;
+			ss << "Slowest pipelines:" << std::fixed << std::setprecision(2);
+			for (size_t i = 0; i < slowestPipelines.size(); i++)
+			{
+				ss << (i > 0 ? ", " : " ") << slowestPipelines[i].first << " " << slowestPipelines[i].second << " ms";
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			ss << "Shader modules: " << shaderPack->getModuleCount() << " live, " << shaderPack->stats.modulesCreated << " created for " << shaderPack->stats.requests << " requests" << (shaderPack->isOpen() ? "" : " (no shader pack)");
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			ss << "Mode switch: " << std::fixed << std::setprecision(3) << modeSwitchStats.switchTime << " ms (" << (modeSwitchStats.cached ? "cached" : "recorded") << "), " << commandBufferVariants.size() << " cached variants, max frame time " << std::setprecision(2) << modeSwitchStats.maxFrameTime << " ms";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			ss << "Render graph: " << renderGraph.stats.passes << " passes (" << renderGraph.stats.culledPasses << " culled), " << renderGraph.stats.barriers << " dependencies, ";
+			ss << renderGraph.stats.aliasedImages << " images in " << renderGraph.stats.memorySlots << " shared slots (" << std::fixed << std::setprecision(1) << renderGraph.stats.memorySlotSize / (1024.0 * 1024.0) << " of " << renderGraph.stats.aliasedImageSize / (1024.0 * 1024.0) << " MB)";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			// Overdraw is the number of G-Buffer fragment shader invocations per rendered pixel
+			std::stringstream ss;
+			ss << "Depth prepass: " << (enableDepthPrepass ? "on" : "off") << (enableDepthPrepass && !useDepthPrepass() ? " (not used with merged pass)" : "");
+			if ((gpuProfiler) && (gpuProfiler->statisticsSupported()) && (gpuProfiler->isActive("G-Buffer")))
+			{
+				const VkExtent2D renderExtent = getRenderExtent(frameBuffers.offscreen.width, frameBuffers.offscreen.height);
+				const uint64_t invocations = gpuProfiler->getFragmentInvocations("G-Buffer");
+				ss << ", G-Buffer overdraw " << std::fixed << std::setprecision(2) << (double)invocations / ((double)renderExtent.width * renderExtent.height) << "x (" << invocations << " fragments)";
+			}
+			else
+			{
+				ss << ", overdraw n/a";
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		if (!pipelineRequests.empty())
+		{
+			std::stringstream ss;
+			ss << "Compiling " << pipelineRequests.size() << " pipeline(s) in the background...";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			ss << "Ambient factor: " << std::fixed << std::setprecision(2) << ambientFactor;
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			const std::array<std::string, LIGHTING_MODE_COUNT> modeNames = { "full screen", "tiled compute", "clustered " + std::to_string(CLUSTER_GRID_X) + "x" + std::to_string(CLUSTER_GRID_Y) + "x" + std::to_string(CLUSTER_GRID_Z), "light volumes" };
+			ss << "Lighting: " << modeNames[lightingMode] << ", " << getLightCount() << " lights, CPU update " << std::fixed << std::setprecision(3) << lightManager.stats.animationTime + lightManager.stats.transformTime << " ms" << (LightManager::simd() ? " (SSE)" : "");
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		if ((gpuProfiler) && (gpuProfiler->supported()))
+		{
+			std::stringstream ss;
+			ss << "GPU: " << std::fixed << std::setprecision(2);
+			for (auto& scope : gpuFrameScopes)
+			{
+				if (gpuProfiler->isActive(scope))
+				{
+					ss << scope << " " << gpuProfiler->getTime(scope) << " ms  ";
+				}
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			const VkExtent2D renderExtent = getRenderExtent(frameBuffers.offscreen.width, frameBuffers.offscreen.height);
+			ss << "Dynamic resolution: " << (dynamicResolution.enabled ? "on" : "off") << ", " << renderExtent.width << "x" << renderExtent.height << " (" << std::fixed << std::setprecision(0) << dynamicResolution.scale * 100.0f << "%)";
+			if (dynamicResolution.enabled)
+			{
+				ss << ", target " << std::setprecision(1) << dynamicResolution.targetFrameTime << " ms";
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		if (enableSSAO)
+		{
+			// GPU time of the other tier is kept from the last time it was used
+			const FrameBuffer &target = (ssaoQuality == SSAO_QUALITY_LOW) ? frameBuffers.ssaoHalf : frameBuffers.ssao;
+			const SSAOQuality otherQuality = (ssaoQuality == SSAO_QUALITY_LOW) ? SSAO_QUALITY_HIGH : SSAO_QUALITY_LOW;
+			std::stringstream ss;
+			ss << "SSAO: " << ssaoMethods[ssaoMethod].name << ", " << ((ssaoQuality == SSAO_QUALITY_LOW) ? "half" : "full") << " resolution (" << target.width << "x" << target.height << "), " << (ssaoComputeBlur ? "compute" : "fragment") << " blur, ";
+			if (ssaoMethod != SSAO_METHOD_HEMISPHERE)
+			{
+				ss << (ssaoTemporal ? "temporal " : "") << ssaoMethods[ssaoMethod].sliceCount << " slices x " << 2 * ssaoMethods[ssaoMethod].stepCount << " steps";
+			}
+			else if (ssaoTemporal)
+			{
+				ss << "temporal " << SSAO_TEMPORAL_SAMPLES << "/" << SSAO_KERNEL_SIZE << " samples per frame";
+			}
+			else
+			{
+				ss << SSAO_KERNEL_SIZE << " samples per frame";
+			}
+			if ((gpuProfiler) && (gpuProfiler->supported()))
+			{
+				ss << ", GPU " << std::fixed << std::setprecision(2) << ssaoGpuTimes[ssaoQuality] << " ms, " << ((otherQuality == SSAO_QUALITY_LOW) ? "half" : "full") << " resolution ";
+				if (ssaoGpuTimes[otherQuality] > 0.0)
+				{
+					ss << ssaoGpuTimes[otherQuality] << " ms";
+				}
+				else
+				{
+					ss << "not measured yet";
+				}
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		if (enableSSAO && ssaoComputeSupported && (gpuProfiler) && (gpuProfiler->supported()))
+		{
+			// Occlusion generation of all methods at the current tier, the current method is marked
+			std::stringstream ss;
+			ss << "SSAO generation GPU (" << ((ssaoQuality == SSAO_QUALITY_LOW) ? "half" : "full") << " resolution): " << std::fixed << std::setprecision(2);
+			for (uint32_t method = 0; method < SSAO_METHOD_COUNT; method++)
+			{
+				const double time = ssaoGenerateGpuTimes[method][ssaoQuality];
+				ss << ((method == ssaoMethod) ? "*" : "") << ssaoMethods[method].name << " ";
+				if (time > 0.0)
+				{
+					ss << time << " ms  ";
+				}
+				else
+				{
+					ss << "-  ";
+				}
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			std::stringstream ss;
+			ss << "G-Buffer" << (enableBindless ? " (bindless)" : "") << ": " << sceneQueue.stats.draws << " draws, " << sceneQueue.stats.pipelineBinds << " pipeline / " << sceneQueue.stats.descriptorSetBinds << " set binds, ";
+			ss << sceneQueue.stats.redundantBindsAvoided << " redundant binds avoided, sort " << std::fixed << std::setprecision(3) << sceneQueue.stats.sortTime << " ms";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			// Memory written by the G-Buffer pass (and read by the lighting passes) each frame
+			std::stringstream ss;
+			ss << "G-Buffer size: " << gBufferPixelSize << " bytes/pixel, " << std::fixed << std::setprecision(1) << (double)gBufferPixelSize * frameBuffers.offscreen.width * frameBuffers.offscreen.height / (1024.0 * 1024.0) << " MB at " << frameBuffers.offscreen.width << "x" << frameBuffers.offscreen.height;
+			ss << " (" << (double)gBufferPixelSize * 3840 * 2160 / (1024.0 * 1024.0) << " MB at 3840x2160)";
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
+		{
+			// With the merged pass the G-Buffer is neither stored nor read back from memory
+			std::stringstream ss;
+			ss << "Merged G-Buffer pass: " << (useMergedPass() ? "on" : (enableMergedPass ? "not used with the current modes" : "off"));
+			if (mergedPass.depth.image != VK_NULL_HANDLE)
+			{
+				ss << ", " << (mergedPass.lazilyAllocated ? "lazily allocated" : "device local") << " transient attachments";
+			}
+			textOverlay->addText(ss.str(), 5.0f, textPos, VulkanTextOverlay::alignLeft);
+			textPos += 20.0f;
+		}
 		// Render targets
 		if (debugDisplay)
 		{
@@ -0,0 +1,423 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* Offline potentially visible set (PVS) baker
+*
+* Splits the scene's bounding volume into a grid of cells and ray casts from sample points
+* inside each cell to find the meshes that are visible from it. Meshes with alpha masked
+* materials (foliage, etc.) don't occlude, rays pass through them
+* The result is stored as one bitset per cell (see src/pvs.hpp)
+*
+* Usage: pvsbake scene.dae output.pvs [cellsize] [rays per sample] [samples per cell]
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "threadpool.hpp"
+#include "../src/pvs.hpp"
+
+struct Triangle
+{
+	glm::vec3 v0, e1, e2;
+	uint32_t meshIndex;
+};
+
+struct BVHNode
+{
+	glm::vec3 min, max;
+	// Inner nodes: index of the first child (second child follows), leaves: index of the first triangle
+	uint32_t offset;
+	// 0 for inner nodes
+	uint32_t count;
+};
+
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+	void grow(const glm::vec3 &p)
+	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	void grow(const Bounds &b)
+	{
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+};
+
+class PVSBaker
+{
+private:
+	std::vector<Triangle> triangles;
+	std::vector<Bounds> triangleBounds;
+	std::vector<BVHNode> nodes;
+	// Meshes with alpha masked materials don't occlude
+	std::vector<bool> meshTransparent;
+
+	void buildNode(uint32_t nodeIndex, uint32_t first, uint32_t count)
+	{
+		Bounds bounds, centroidBounds;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			bounds.grow(triangleBounds[i]);
+			centroidBounds.grow((triangleBounds[i].min + triangleBounds[i].max) * 0.5f);
+		}
+		nodes[nodeIndex].min = bounds.min;
+		nodes[nodeIndex].max = bounds.max;
+
+		glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+		uint32_t axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+		if ((count <= 4) || (extent[axis] <= 0.0f))
+		{
+			nodes[nodeIndex].offset = first;
+			nodes[nodeIndex].count = count;
+			return;
+		}
+
+		// Median split along the longest centroid axis
+		uint32_t mid = first + count / 2;
+		std::vector<uint32_t> order(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			order[i] = first + i;
+		}
+		std::nth_element(order.begin(), order.begin() + (mid - first), order.end(), [&](uint32_t a, uint32_t b) {
+			return (triangleBounds[a].min[axis] + triangleBounds[a].max[axis]) < (triangleBounds[b].min[axis] + triangleBounds[b].max[axis]);
+		});
+		std::vector<Triangle> sortedTriangles(count);
+		std::vector<Bounds> sortedBounds(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			sortedTriangles[i] = triangles[order[i]];
+			sortedBounds[i] = triangleBounds[order[i]];
+		}
+		std::copy(sortedTriangles.begin(), sortedTriangles.end(), triangles.begin() + first);
+		std::copy(sortedBounds.begin(), sortedBounds.end(), triangleBounds.begin() + first);
+
+		uint32_t childIndex = static_cast<uint32_t>(nodes.size());
+		nodes.push_back({});
+		nodes.push_back({});
+		nodes[nodeIndex].offset = childIndex;
+		nodes[nodeIndex].count = 0;
+		buildNode(childIndex, first, mid - first);
+		buildNode(childIndex + 1, mid, first + count - mid);
+	}
+
+	static bool intersectBounds(const BVHNode &node, const glm::vec3 &origin, const glm::vec3 &invDir, float tMax)
+	{
+		glm::vec3 t0 = (node.min - origin) * invDir;
+		glm::vec3 t1 = (node.max - origin) * invDir;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		return tEnter <= tExit;
+	}
+
+	// Moeller-Trumbore, two sided
+	static bool intersectTriangle(const Triangle &tri, const glm::vec3 &origin, const glm::vec3 &dir, float &t)
+	{
+		glm::vec3 p = glm::cross(dir, tri.e2);
+		float det = glm::dot(tri.e1, p);
+		if (fabsf(det) < 1e-8f)
+		{
+			return false;
+		}
+		float invDet = 1.0f / det;
+		glm::vec3 s = origin - tri.v0;
+		float u = glm::dot(s, p) * invDet;
+		if ((u < 0.0f) || (u > 1.0f))
+		{
+			return false;
+		}
+		glm::vec3 q = glm::cross(s, tri.e1);
+		float v = glm::dot(dir, q) * invDet;
+		if ((v < 0.0f) || (u + v > 1.0f))
+		{
+			return false;
+		}
+		t = glm::dot(tri.e2, q) * invDet;
+		return t > 1e-4f;
+	}
+
+	// Marks the closest opaque mesh hit by the ray and all transparent meshes in front of it
+	void traceRay(const glm::vec3 &origin, const glm::vec3 &dir, std::vector<std::pair<float, uint32_t>> &transparentHits, std::vector<uint32_t> &stack, PotentiallyVisibleSet &pvs, uint32_t cell)
+	{
+		glm::vec3 invDir = 1.0f / dir;
+		float tClosest = FLT_MAX;
+		int32_t closestMesh = -1;
+		transparentHits.clear();
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const BVHNode &node = nodes[stack.back()];
+			stack.pop_back();
+			if (!intersectBounds(node, origin, invDir, tClosest))
+			{
+				continue;
+			}
+			if (node.count == 0)
+			{
+				stack.push_back(node.offset);
+				stack.push_back(node.offset + 1);
+				continue;
+			}
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				float t;
+				if (intersectTriangle(triangles[i], origin, dir, t) && (t < tClosest))
+				{
+					if (meshTransparent[triangles[i].meshIndex])
+					{
+						transparentHits.push_back(std::make_pair(t, triangles[i].meshIndex));
+					}
+					else
+					{
+						tClosest = t;
+						closestMesh = triangles[i].meshIndex;
+					}
+				}
+			}
+		}
+		if (closestMesh >= 0)
+		{
+			pvs.setVisible(cell, closestMesh);
+		}
+		for (auto &hit : transparentHits)
+		{
+			if (hit.first < tClosest)
+			{
+				pvs.setVisible(cell, hit.second);
+			}
+		}
+	}
+
+public:
+	uint32_t meshCount = 0;
+	std::vector<Bounds> meshBounds;
+	Bounds sceneBounds;
+
+	// Loads the scene with the same post processing and coordinate conventions as the renderer
+	bool loadScene(std::string filename)
+	{
+		Assimp::Importer Importer;
+		int flags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
+		const aiScene* aScene = Importer.ReadFile(filename.c_str(), flags);
+		if (!aScene)
+		{
+			std::cerr << "Error parsing \"" << filename << "\": " << Importer.GetErrorString() << std::endl;
+			return false;
+		}
+
+		meshCount = aScene->mNumMeshes;
+		meshBounds.resize(meshCount);
+		meshTransparent.resize(meshCount);
+		for (uint32_t m = 0; m < meshCount; m++)
+		{
+			const aiMesh *aMesh = aScene->mMeshes[m];
+			meshTransparent[m] = aScene->mMaterials[aMesh->mMaterialIndex]->GetTextureCount(aiTextureType_OPACITY) > 0;
+			std::vector<glm::vec3> positions(aMesh->mNumVertices);
+			for (uint32_t i = 0; i < aMesh->mNumVertices; i++)
+			{
+				const aiVector3D &v = aMesh->mVertices[i];
+				positions[i] = glm::vec3(v.x, v.y, v.z);
+				positions[i].y = -positions[i].y;
+				meshBounds[m].grow(positions[i]);
+			}
+			sceneBounds.grow(meshBounds[m]);
+			for (uint32_t i = 0; i < aMesh->mNumFaces; i++)
+			{
+				if (aMesh->mFaces[i].mNumIndices != 3)
+				{
+					continue;
+				}
+				const glm::vec3 &p0 = positions[aMesh->mFaces[i].mIndices[0]];
+				const glm::vec3 &p1 = positions[aMesh->mFaces[i].mIndices[1]];
+				const glm::vec3 &p2 = positions[aMesh->mFaces[i].mIndices[2]];
+				triangles.push_back({ p0, p1 - p0, p2 - p0, m });
+				Bounds bounds;
+				bounds.grow(p0);
+				bounds.grow(p1);
+				bounds.grow(p2);
+				triangleBounds.push_back(bounds);
+			}
+		}
+
+		std::cout << "Loaded " << meshCount << " meshes, " << triangles.size() << " triangles" << std::endl;
+
+		nodes.reserve(triangles.size() / 2);
+		nodes.push_back({});
+		buildNode(0, 0, static_cast<uint32_t>(triangles.size()));
+		std::cout << "BVH with " << nodes.size() << " nodes" << std::endl;
+
+		return true;
+	}
+
+	void bakeCell(PotentiallyVisibleSet &pvs, uint32_t x, uint32_t y, uint32_t z, uint32_t raysPerSample, uint32_t samplesPerCell)
+	{
+		const uint32_t cell = x + y * pvs.header.dim[0] + z * pvs.header.dim[0] * pvs.header.dim[1];
+		const float cellSize = pvs.header.cellSize;
+		const glm::vec3 cellMin = pvs.getCellCenter(x, y, z) - glm::vec3(cellSize * 0.5f);
+		const glm::vec3 cellMax = cellMin + glm::vec3(cellSize);
+
+		// Meshes overlapping the cell are always visible (camera may be inside of them)
+		for (uint32_t m = 0; m < meshCount; m++)
+		{
+			if (glm::all(glm::lessThanEqual(meshBounds[m].min, cellMax)) && glm::all(glm::greaterThanEqual(meshBounds[m].max, cellMin)))
+			{
+				pvs.setVisible(cell, m);
+			}
+		}
+
+		std::default_random_engine rndGen(cell);
+		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+		std::vector<std::pair<float, uint32_t>> transparentHits;
+		std::vector<uint32_t> stack;
+
+		const float goldenAngle = (float)M_PI * (3.0f - sqrtf(5.0f));
+		for (uint32_t s = 0; s < samplesPerCell; s++)
+		{
+			// First sample at the cell's center, others randomly distributed
+			glm::vec3 origin = (s == 0) ? (cellMin + cellMax) * 0.5f : cellMin + glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * cellSize;
+			// Fibonacci sphere directions with a random rotation per sample
+			float rotation = rndDist(rndGen) * 2.0f * (float)M_PI;
+			for (uint32_t r = 0; r < raysPerSample; r++)
+			{
+				float dy = 1.0f - (r + 0.5f) / (float)raysPerSample * 2.0f;
+				float radius = sqrtf(1.0f - dy * dy);
+				float phi = r * goldenAngle + rotation;
+				glm::vec3 dir(cosf(phi) * radius, dy, sinf(phi) * radius);
+				traceRay(origin, dir, transparentHits, stack, pvs, cell);
+			}
+		}
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: pvsbake scene.dae output.pvs [cellsize] [rays per sample] [samples per cell]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string sceneFile = argv[1];
+	std::string outputFile = argv[2];
+	float cellSize = (argc > 3) ? (float)atof(argv[3]) : 8.0f;
+	uint32_t raysPerSample = (argc > 4) ? atoi(argv[4]) : 4096;
+	uint32_t samplesPerCell = (argc > 5) ? atoi(argv[5]) : 8;
+
+	if ((cellSize <= 0.0f) || (raysPerSample == 0) || (samplesPerCell == 0))
+	{
+		std::cerr << "Invalid bake parameters" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	PVSBaker baker;
+	if (!baker.loadScene(sceneFile))
+	{
+		return EXIT_FAILURE;
+	}
+
+	// Grid covers the scene bounds, padded by one cell so the camera can leave the geometry a bit
+	glm::vec3 origin = baker.sceneBounds.min - glm::vec3(cellSize);
+	glm::vec3 extent = baker.sceneBounds.max - baker.sceneBounds.min + glm::vec3(cellSize * 2.0f);
+	glm::uvec3 dim = glm::uvec3(glm::ceil(extent / cellSize));
+
+	PotentiallyVisibleSet pvs;
+	pvs.create(baker.meshCount, origin, cellSize, dim);
+
+	std::cout << "Baking " << dim.x << " x " << dim.y << " x " << dim.z << " cells (size " << cellSize << "), " << samplesPerCell << " samples per cell, " << raysPerSample << " rays per sample" << std::endl;
+
+	auto tStart = std::chrono::high_resolution_clock::now();
+
+	// Each z slice is a separate job, cells write to disjoint words of the set
+	vkTools::ThreadPool threadPool;
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadPool.setThreadCount(threadCount);
+	for (uint32_t z = 0; z < dim.z; z++)
+	{
+		threadPool.threads[z % threadCount]->addJob([&, z] {
+			for (uint32_t y = 0; y < dim.y; y++)
+			{
+				for (uint32_t x = 0; x < dim.x; x++)
+				{
+					baker.bakeCell(pvs, x, y, z, raysPerSample, samplesPerCell);
+				}
+			}
+		});
+	}
+	threadPool.wait();
+
+	// Dilate by one cell to hide popping when crossing cell borders with a sampling based bake
+	PotentiallyVisibleSet dilated = pvs;
+	for (uint32_t z = 0; z < dim.z; z++)
+	{
+		for (uint32_t y = 0; y < dim.y; y++)
+		{
+			for (uint32_t x = 0; x < dim.x; x++)
+			{
+				uint32_t cell = x + y * dim.x + z * dim.x * dim.y;
+				for (int32_t dz = -1; dz <= 1; dz++)
+				{
+					for (int32_t dy = -1; dy <= 1; dy++)
+					{
+						for (int32_t dx = -1; dx <= 1; dx++)
+						{
+							glm::ivec3 n = glm::ivec3((int32_t)x + dx, (int32_t)y + dy, (int32_t)z + dz);
+							if (glm::any(glm::lessThan(n, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(n, glm::ivec3(dim))))
+							{
+								continue;
+							}
+							uint32_t neighbour = n.x + n.y * dim.x + n.z * dim.x * dim.y;
+							for (uint32_t w = 0; w < pvs.header.wordsPerCell; w++)
+							{
+								dilated.bits[cell * pvs.header.wordsPerCell + w] |= pvs.bits[neighbour * pvs.header.wordsPerCell + w];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "Bake took " << std::chrono::duration<double, std::milli>(tEnd - tStart).count() / 1000.0 << "s" << std::endl;
+
+	uint64_t visibleSum = 0;
+	for (uint32_t i = 0; i < dilated.cellCount(); i++)
+	{
+		visibleSum += dilated.visibleCount(i);
+	}
+	std::cout << "Average visible meshes per cell: " << (double)visibleSum / dilated.cellCount() << " of " << baker.meshCount << std::endl;
+
+	if (!dilated.saveToFile(outputFile))
+	{
+		std::cerr << "Could not write \"" << outputFile << "\"" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Written to \"" << outputFile << "\" (" << sizeof(PVSHeader) + dilated.bits.size() * sizeof(uint32_t) << " bytes)" << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*
+* Vulkan playground for rendering Crytek's Sponza model (deferred renderer)
+*
+* Offline SPIR-V shader packer
+*
+* Stores all given SPIR-V binaries in a single file that is memory mapped at runtime
+* Binaries with identical code are only stored once
+* The file format is defined in base/vulkanshaderpack.hpp
+*
+* Usage: shaderpack output.pack shaderdir file.spv [file.spv ...]
+* File names are relative to the shader directory and are used to look up the shaders at runtime
+*
+* Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+
+#include "vulkanshaderpack.hpp"
+
+bool readFile(const std::string &fileName, std::vector<uint8_t> &data)
+{
+	FILE *file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data.resize(ftell(file));
+	fseek(file, 0, SEEK_SET);
+	size_t read = fread(data.data(), 1, data.size(), file);
+	fclose(file);
+	return read == data.size();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 4)
+	{
+		std::cout << "Usage: shaderpack output.pack shaderdir file.spv [file.spv ...]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string outputFile = argv[1];
+	std::string shaderDir = argv[2];
+	if ((shaderDir.back() != '/') && (shaderDir.back() != '\\'))
+	{
+		shaderDir += "/";
+	}
+
+	// Entry offsets are relative to the data block until the size of the entry table is known
+	std::vector<ShaderPackEntry> entries;
+	std::vector<uint8_t> data;
+	// Index of the first entry storing the code, by hash
+	std::unordered_map<uint64_t, size_t> storedEntries;
+
+	for (int i = 3; i < argc; i++)
+	{
+		std::string name = argv[i];
+		std::replace(name.begin(), name.end(), '\\', '/');
+		if (name.size() >= SHADERPACK_MAX_NAME)
+		{
+			std::cerr << "Shader name too long: \"" << name << "\"" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::vector<uint8_t> code;
+		if (!readFile(shaderDir + name, code) || code.empty() || (code.size() % 4 != 0))
+		{
+			std::cerr << "Could not read SPIR-V file \"" << shaderDir + name << "\"" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		ShaderPackEntry entry = {};
+		strncpy(entry.name, name.c_str(), SHADERPACK_MAX_NAME - 1);
+		entry.hash = shaderPackHash(code.data(), code.size());
+		entry.size = static_cast<uint32_t>(code.size());
+
+		auto stored = storedEntries.find(entry.hash);
+		if ((stored != storedEntries.end()) && (entries[stored->second].size == entry.size) && (memcmp(&data[entries[stored->second].offset], code.data(), code.size()) == 0))
+		{
+			entry.offset = entries[stored->second].offset;
+			std::cout << name << ": same code as " << entries[stored->second].name << std::endl;
+		}
+		else
+		{
+			entry.offset = static_cast<uint32_t>(data.size());
+			data.insert(data.end(), code.begin(), code.end());
+			storedEntries[entry.hash] = entries.size();
+			std::cout << name << ": " << code.size() << " bytes" << std::endl;
+		}
+		entries.push_back(entry);
+	}
+
+	ShaderPackHeader header;
+	header.entryCount = static_cast<uint32_t>(entries.size());
+	header.dataSize = static_cast<uint32_t>(data.size());
+	const uint32_t dataOffset = static_cast<uint32_t>(sizeof(ShaderPackHeader) + entries.size() * sizeof(ShaderPackEntry));
+	for (auto& entry : entries)
+	{
+		entry.offset += dataOffset;
+	}
+
+	FILE *file = fopen(outputFile.c_str(), "wb");
+	if (!file)
+	{
+		std::cerr << "Could not open \"" << outputFile << "\" for writing" << std::endl;
+		return EXIT_FAILURE;
+	}
+	bool result = fwrite(&header, sizeof(ShaderPackHeader), 1, file) == 1;
+	result &= fwrite(entries.data(), sizeof(ShaderPackEntry), entries.size(), file) == entries.size();
+	result &= fwrite(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	if (!result)
+	{
+		std::cerr << "Could not write \"" << outputFile << "\"" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Packed " << entries.size() << " shaders (" << storedEntries.size() << " unique, " << data.size() << " bytes) into \"" << outputFile << "\"" << std::endl;
+
+	return EXIT_SUCCESS;
+}